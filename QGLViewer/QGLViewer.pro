@@ -15,6 +15,7 @@ QGL_HEADERS = qglviewer.h \
 	  frame.h \
 	  constraint.h \
 	  keyFrameInterpolator.h \
+	  frustumCuller.h \
 	  mouseGrabber.h \
 	  quaternion.h \
 	  vec.h \
@@ -29,11 +30,13 @@ SOURCES = qglviewer.cpp \
 	  saveSnapshot.cpp \
 	  constraint.cpp \
 	  keyFrameInterpolator.cpp \
+	  frustumCuller.cpp \
 	  mouseGrabber.cpp \
 	  quaternion.cpp \
 	  vec.cpp
 
 HEADERS *= $${QGL_HEADERS}
+HEADERS *= batchTransform.h
 DISTFILES *= qglviewer-icon.xpm
 DESTDIR =$$_PRO_FILE_PWD_/../bin
 
@@ -42,6 +42,11 @@
 
 *****************************************************************************/
 
+#include <algorithm>
+#include <QRunnable>
+#include <QSemaphore>
+#include <QThread>
+#include <QThreadPool>
 #include "VRender.h"
 #include "Primitive.h"
 #include "SortMethod.h"
@@ -57,66 +62,144 @@ typedef enum { BSP_CROSS_PLANE, BSP_UPPER, BSP_LOWER } BSPPosition;
 
 class BSPNode;
 
+//  Statistics of the BSP construction.
+
+struct BSPStats
+{
+	BSPStats() : nb_splits(0), nb_nodes(0), depth(0) {}
+
+	void add(const BSPStats& s)
+	{
+		nb_splits += s.nb_splits;
+		nb_nodes += s.nb_nodes;
+		depth = max(depth,s.depth);
+	}
+
+	size_t nb_splits;	// number of polygons and segments split
+	size_t nb_nodes;
+	size_t depth;
+};
+
+//  A subtree left to be built by a separate task.
+
+struct BSPBuildJob
+{
+	vector<Polygone *> polygons;
+	BSPNode **node;
+	size_t depth;
+};
+
 class BSPTree
 {
 	public:
 		BSPTree();
 		~BSPTree();
 
-		void insert(Polygone *);
-		void insert(Segment *);
+		void build(vector<Polygone *>&,BSPStats&,vector<BSPBuildJob>&);
+		void insert(Segment *,BSPStats&);
 		void insert(Point *);
 
-		void recursFillPrimitiveArray(vector<PtrPrimitive>&) const;
+		void fillPrimitiveArray(vector<PtrPrimitive>&) const;
 	private:
 		BSPNode *_root;
 		vector<Segment *> _segments;	// these are for storing segments and points when _root is null
 		vector<Point *> _points;
 };
 
+//  Builds one of the subtrees left by BSPTree::build().
+
+class BSPBuildTask: public QRunnable
+{
+	public:
+		BSPBuildTask(BSPBuildJob& job,BSPStats& stats,QSemaphore *done)
+			: _job(job), _stats(stats), _done(done)
+		{
+			setAutoDelete(true);
+		}
+
+		virtual void run();
+
+	private:
+		BSPBuildJob& _job;
+		BSPStats& _stats;
+		QSemaphore *_done;
+};
+
 void BSPSortMethod::sortPrimitives(std::vector<PtrPrimitive>& primitive_tab,VRenderParams& vparams)
 {
 	// 1 - build BSP using polygons only
 
 	BSPTree tree;
-	Polygone *P;
-
-        unsigned int N = primitive_tab.size()/200 +1;
-	int nbinserted = 0;
+	BSPStats stats;
 
+	vector<Polygone *> polygons;
 	vector<PtrPrimitive> segments_and_points;	// Store segments and points for pass 2, because polygons are deleted
-																// by the insertion and can not be dynamic_casted anymore.
-	for(unsigned int i=0;i<primitive_tab.size();++i,++nbinserted)
-	{
-		if((P = dynamic_cast<Polygone *>(primitive_tab[i])) != NULL)
-			tree.insert(P);
+																// by the construction and can not be accessed anymore.
+	for(unsigned int i=0;i<primitive_tab.size();++i)
+		if(primitive_tab[i]->type() == Primitive::POLYGON)
+			polygons.push_back(static_cast<Polygone *>(primitive_tab[i]));
 		else
 			segments_and_points.push_back(primitive_tab[i]);
 
-		if(nbinserted%N==0)
-			vparams.progress(nbinserted/(float)primitive_tab.size(), QGLViewer::tr("BSP Construction"));
-	}
+	vector<BSPBuildJob> jobs;
+	tree.build(polygons,stats,jobs);
 
-	// 2 - insert points and segments into the BSP
+	vector<BSPStats> jobs_stats(jobs.size());
+	QSemaphore done;
+
+	for(size_t i=0;i<jobs.size();++i)
+		QThreadPool::globalInstance()->start(new BSPBuildTask(jobs[i],jobs_stats[i],&done));
 
-	Segment *S;
-	Point *p;
+	//  progress() throws if the render is cancelled. The jobs must then be waited
+	// for, and the primitives, some of which were split and deleted, given back
+	// to the caller which deletes them.
 
-	for(unsigned int j=0;j<segments_and_points.size();++j,++nbinserted)
+	size_t nb_done = 0;
+
+	try
+	{
+		for(;nb_done<jobs.size();++nb_done)
+		{
+			done.acquire();
+			vparams.progress(nb_done/(float)jobs.size(), QGLViewer::tr("BSP Construction"));
+		}
+	}
+	catch(exception&)
 	{
-		if((S = dynamic_cast<Segment *>(segments_and_points[j])) != NULL)
-			tree.insert(S);
-		else if((p = dynamic_cast<Point *>(segments_and_points[j])) != NULL)
-			tree.insert(p);
+		done.acquire(int(jobs.size() - nb_done - 1));
+
+		primitive_tab.resize(0);
+		tree.fillPrimitiveArray(primitive_tab);
+		primitive_tab.insert(primitive_tab.end(),segments_and_points.begin(),segments_and_points.end());
 
-		if(nbinserted%N==0)
-			vparams.progress(nbinserted/(float)primitive_tab.size(), QGLViewer::tr("BSP Construction"));
+		throw;
 	}
 
+	for(size_t i=0;i<jobs.size();++i)
+		stats.add(jobs_stats[i]);
+
+	// 2 - insert points and segments into the BSP
+
+	for(unsigned int j=0;j<segments_and_points.size();++j)
+	{
+		if(segments_and_points[j]->type() == Primitive::SEGMENT)
+			tree.insert(static_cast<Segment *>(segments_and_points[j]),stats);
+		else if(segments_and_points[j]->type() == Primitive::POINT)
+			tree.insert(static_cast<Point *>(segments_and_points[j]));
+	}
+
+	_nb_splits = stats.nb_splits;
+	_nb_nodes = stats.nb_nodes;
+	_depth = stats.depth;
+
+#ifdef _VRENDER_DEBUG
+	cout << "BSP: " << _nb_nodes << " nodes, depth " << _depth << ", " << _nb_splits << " splits." << endl;
+#endif
+
 	// 3 - refill the array with the content of the BSP
 
 	primitive_tab.resize(0);
-	tree.recursFillPrimitiveArray(primitive_tab);
+	tree.fillPrimitiveArray(primitive_tab);
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////
@@ -127,10 +210,13 @@ class BSPNode
 		BSPNode(Polygone *);
 		~BSPNode();
 
-		void recursFillPrimitiveArray(vector<PtrPrimitive>&) const;
+		//  Builds the subtree of the given polygons in node. Polygons are split when
+		// needed, and the vector is emptied. If jobs is not NULL, subtrees at depth
+		// jobs_depth are not built, but added to jobs.
+		static void build(vector<Polygone *>& polygons,BSPNode *& node,size_t depth,
+								vector<BSPBuildJob> *jobs,size_t jobs_depth,BSPStats& stats);
 
-		void insert(Polygone *);
-		void insert(Segment *);
+		void insert(Segment *,BSPStats&);
 		void insert(Point *);
 
 	private:
@@ -147,13 +233,25 @@ class BSPNode
 
 		Polygone *polygone;
 
-		void Classify(Polygone *, Polygone * &, Polygone * &);
-		void Classify(Segment *, Segment * &, Segment * &);
-		int  Classify(Point *);
+		// Classify() return true when the primitive was split.
+		bool Classify(Polygone *, Polygone * &, Polygone * &) const;
+		bool Classify(Segment *, Segment * &, Segment * &) const;
+		int  Classify(Point *) const;
+
+		static BSPPosition Position(const Polygone *P,double a,double b,double c,double d);
+		static size_t chooseSplitter(const vector<Polygone *>& polygons);
+		static void initEquation(const Polygone *P,double & a, double & b, double & c, double & d);
 
-		void initEquation(const Polygone *P,double & a, double & b, double & c, double & d);
+		friend class BSPTree;
 };
 
+
+void BSPBuildTask::run()
+{
+	BSPNode::build(_job.polygons,*_job.node,_job.depth,NULL,0,_stats);
+	_done->release();
+}
+
 BSPTree::BSPTree()
 {
 	_root = NULL;
@@ -165,12 +263,71 @@ BSPTree::~BSPTree()
 }
 
 void BSPTree::insert(Point *P) 	{ if(_root == NULL) _points.push_back(P) 	; else _root->insert(P); }
-void BSPTree::insert(Segment *S) { if(_root == NULL) _segments.push_back(S); else _root->insert(S); }
-void BSPTree::insert(Polygone *P){ if(_root == NULL) _root = new BSPNode(P); else _root->insert(P); }
+void BSPTree::insert(Segment *S,BSPStats& stats) { if(_root == NULL) _segments.push_back(S); else _root->insert(S,stats); }
 
-void BSPTree::recursFillPrimitiveArray(vector<PtrPrimitive>& tab) const
+void BSPTree::build(vector<Polygone *>& polygons,BSPStats& stats,vector<BSPBuildJob>& jobs)
 {
-	if(_root != NULL) _root->recursFillPrimitiveArray(tab);
+	//  Only the first levels are built here, until there are enough independent
+	// subtrees to keep all threads busy. The remaining subtrees are left in jobs.
+
+	size_t nb_threads = (size_t)max(1,QThread::idealThreadCount());
+	size_t jobs_depth = 0;
+
+	while((size_t(1) << jobs_depth) < 4*nb_threads)
+		++jobs_depth;
+
+	BSPNode::build(polygons,_root,0,&jobs,jobs_depth,stats);
+}
+
+void BSPTree::fillPrimitiveArray(vector<PtrPrimitive>& tab) const
+{
+	//  Back to front traversal: upper side, then the node, then lower side. Each
+	// node is visited three times, hence the stage stored with it in the stack.
+
+	vector< pair<const BSPNode *,int> > stack;
+
+	if(_root != NULL)
+		stack.push_back(make_pair((const BSPNode *)_root,0));
+
+	while(!stack.empty())
+	{
+		const BSPNode *N = stack.back().first;
+		int stage = stack.back().second;
+
+		stack.pop_back();
+
+		switch(stage)
+		{
+			case 0:
+				stack.push_back(make_pair(N,1));
+
+				if(N->fils_plus != NULL)
+					stack.push_back(make_pair((const BSPNode *)N->fils_plus,0));
+				break;
+
+			case 1:
+				for(unsigned int i=0;i<N->seg_plus.size();++i)
+					tab.push_back(N->seg_plus[i]);
+				for(unsigned int j=0;j<N->pts_plus.size();++j)
+					tab.push_back(N->pts_plus[j]);
+
+				if(N->polygone != NULL)
+					tab.push_back(N->polygone);
+
+				stack.push_back(make_pair(N,2));
+
+				if(N->fils_moins != NULL)
+					stack.push_back(make_pair((const BSPNode *)N->fils_moins,0));
+				break;
+
+			case 2:
+				for(unsigned int i2=0;i2<N->seg_moins.size();++i2)
+					tab.push_back(N->seg_moins[i2]);
+				for(unsigned int j2=0;j2<N->pts_moins.size();++j2)
+					tab.push_back(N->pts_moins[j2]);
+				break;
+		}
+	}
 
 	for(unsigned int i=0;i<_points.size();++i) tab.push_back(_points[i]);
 	for(unsigned int j=0;j<_segments.size();++j) tab.push_back(_segments[j]);
@@ -184,7 +341,7 @@ BSPNode::~BSPNode()
 	delete fils_plus;
 }
 
-int BSPNode::Classify(Point *P)
+int BSPNode::Classify(Point *P) const
 {
   double Z = P->sommet3DColor(0).x() * a + P->sommet3DColor(0).y() * b + P->sommet3DColor(0).z() * c - d;
 
@@ -194,7 +351,7 @@ int BSPNode::Classify(Point *P)
     return -1;
 }
 
-void BSPNode::Classify(Segment *S, Segment * & moins_, Segment * & plus_)
+bool BSPNode::Classify(Segment *S, Segment * & moins_, Segment * & plus_) const
 {
 	double Z1 = S->sommet3DColor(0).x() * a + S->sommet3DColor(0).y() * b + S->sommet3DColor(0).z() * c - d;
 	double Z2 = S->sommet3DColor(1).x() * a + S->sommet3DColor(1).y() * b + S->sommet3DColor(1).z() * c - d;
@@ -221,7 +378,7 @@ void BSPNode::Classify(Segment *S, Segment * & moins_, Segment * & plus_)
 		{
 			moins_ = S;
 			plus_  = NULL;
-			return;
+			return false;
 		}
 		else
 		{
@@ -247,7 +404,7 @@ void BSPNode::Classify(Segment *S, Segment * & moins_, Segment * & plus_)
 			}
 
 			delete S;
-			return;
+			return true;
 		}
 	}
 	else if(s1 == s2)
@@ -256,13 +413,13 @@ void BSPNode::Classify(Segment *S, Segment * & moins_, Segment * & plus_)
 		{
 			moins_ = S;
 			plus_ = NULL;
-			return;
+			return false;
 		}
 		else
 		{
 			moins_ = NULL;
 			plus_  = S;
-			return;
+			return false;
 		}
 	}
 	else if(s1 == 0)
@@ -271,13 +428,13 @@ void BSPNode::Classify(Segment *S, Segment * & moins_, Segment * & plus_)
 		{
 			moins_ = NULL;
 			plus_  = S;
-			return;
+			return false;
 		}
 		else
 		{
 			moins_ = S;
 			plus_  = NULL;
-			return;
+			return false;
 		}
 	}
 	else if(s2 == 0)
@@ -286,23 +443,24 @@ void BSPNode::Classify(Segment *S, Segment * & moins_, Segment * & plus_)
 		{
 			moins_ = NULL;
 			plus_  = S;
-			return;
+			return false;
 		}
 		else
 		{
 			moins_ = S;
 			plus_  = NULL;
-			return;
+			return false;
 		}
 	}
 	//else
 		//printf("BSPNode::Classify: unexpected classification case !!\n");
+
+	return false;
 }
 
-void BSPNode::Classify(Polygone *P, Polygone * & moins_, Polygone * & plus_)
+bool BSPNode::Classify(Polygone *P, Polygone * & moins_, Polygone * & plus_) const
 {
-	static int Signs[100];
-	static double Zvals[100];
+	static const int MAX_STACK_VERTICES = 32;
 
 	moins_ = NULL;
 	plus_ = NULL;
@@ -310,11 +468,29 @@ void BSPNode::Classify(Polygone *P, Polygone * & moins_, Polygone * & plus_)
 	if(P == NULL)
 	{
 		//printf("BSPNode::Classify: Error. Null polygon.\n");
-		return;
+		return false;
 	}
 
 	int n = P->nbVertices();
 
+	// Pas de tableaux statiques: plusieurs noeuds sont classes en parallele.
+
+	int Signs_buffer[MAX_STACK_VERTICES];
+	double Zvals_buffer[MAX_STACK_VERTICES];
+	vector<int> Signs_vector;
+	vector<double> Zvals_vector;
+
+	int *Signs = Signs_buffer;
+	double *Zvals = Zvals_buffer;
+
+	if(n > MAX_STACK_VERTICES)
+	{
+		Signs_vector.resize(n);
+		Zvals_vector.resize(n);
+		Signs = &Signs_vector[0];
+		Zvals = &Zvals_vector[0];
+	}
+
 	int Smin = 1;
 	int Smax = -1;
 
@@ -343,7 +519,7 @@ void BSPNode::Classify(Polygone *P, Polygone * & moins_, Polygone * & plus_)
 	{
 		moins_ = P;
 		plus_  = NULL;
-		return;
+		return false;
 	}
 
 	// Polygone tout positif
@@ -352,7 +528,7 @@ void BSPNode::Classify(Polygone *P, Polygone * & moins_, Polygone * & plus_)
 	{
 		plus_  = P;
 		moins_ = NULL;
-		return;
+		return false;
 	}
 
 	// Polygone tout negatif
@@ -361,21 +537,21 @@ void BSPNode::Classify(Polygone *P, Polygone * & moins_, Polygone * & plus_)
 	{
 		plus_ = NULL;
 		moins_ = P;
-		return;
+		return false;
 	}
 
 	if((Smin == -1)&&(Smax == 0))
 	{
 		plus_ = NULL;
 		moins_ = P;
-		return;
+		return false;
 	}
 
 	if((Smin == 0)&&(Smax == 1))
 	{
 		plus_ = P;
 		moins_ = NULL;
-		return;
+		return false;
 	}
 
 	// Reste le cas Smin = -1 et Smax = 1. Il faut couper
@@ -405,7 +581,7 @@ void BSPNode::Classify(Polygone *P, Polygone * & moins_, Polygone * & plus_)
 
 		moins_ = P;
 		plus_  = NULL;
-		return;
+		return false;
 	}
 
 	int dep=0;
@@ -484,53 +660,142 @@ void BSPNode::Classify(Polygone *P, Polygone * & moins_, Polygone * & plus_)
 	moins_ = new Polygone(Ms);
 
 	delete  P;
+
+	return true;
 }
 
-void BSPNode::insert(Polygone *P)
+//  Position of a polygon relative to a plane, consistent with Classify().
+
+BSPPosition BSPNode::Position(const Polygone *P,double a,double b,double c,double d)
 {
-	Polygone *side_plus = NULL, *side_moins = NULL;
+	int Smin = 1;
+	int Smax = -1;
 
-	// 1 - Check on which size the polygon is, possibly split.
+	for(size_t i=0;i<P->nbVertices();i++)
+	{
+		double Z = P->vertex(i).x() * a + P->vertex(i).y() * b + P->vertex(i).z() * c - d;
+		int S = (Z < -EGALITY_EPS)?-1:((Z > EGALITY_EPS)?1:0);
 
-	Classify(P,side_moins,side_plus);
+		if(Smin > S) Smin = S;
+		if(Smax < S) Smax = S;
+	}
 
-	// 2 - insert polygons
+	if(Smin == -1 && Smax == 1)
+		return BSP_CROSS_PLANE;
 
-	if(side_plus != NULL) {
-		if(fils_plus == NULL)
-			fils_plus = new BSPNode(side_plus);
-		else
-			fils_plus->insert(side_plus);
-	}
-	
-	if(side_moins != NULL) {
-		if(fils_moins == NULL)
-			fils_moins = new BSPNode(side_moins);
-		else
-			fils_moins->insert(side_moins);
+	if(Smin >= 0 && Smax == 1)
+		return BSP_UPPER;
+
+	return BSP_LOWER;
+}
+
+//  Chooses the splitting polygon among a few evenly spaced candidates, by
+// classifying a sample of the polygons against each of them. Splits are
+// penalized more than imbalance.
+
+size_t BSPNode::chooseSplitter(const vector<Polygone *>& polygons)
+{
+	static const size_t NB_CANDIDATES = 8;
+	static const size_t NB_SAMPLES = 64;
+	static const double SPLIT_WEIGHT = 8.0;
+
+	size_t n = polygons.size();
+
+	if(n <= 2)
+		return 0;
+
+	size_t nb_candidates = min(n,NB_CANDIDATES);
+	size_t nb_samples = min(n,NB_SAMPLES);
+
+	size_t best = 0;
+	double best_score = -1.0;
+
+	for(size_t k=0;k<nb_candidates;++k)
+	{
+		size_t cand = (k*n)/nb_candidates;
+		double a,b,c,d;
+
+		initEquation(polygons[cand],a,b,c,d);
+
+		size_t nb_cross = 0;
+		long balance = 0;
+
+		// Samples are shifted so as not to fall on the candidates.
+
+		for(size_t l=0;l<nb_samples;++l)
+		{
+			size_t i = ((2*l+1)*n)/(2*nb_samples);
+
+			if(i == cand)
+				continue;
+
+			switch(Position(polygons[i],a,b,c,d))
+			{
+				case BSP_CROSS_PLANE: ++nb_cross; break;
+				case BSP_UPPER: ++balance; break;
+				case BSP_LOWER: --balance; break;
+			}
+		}
+
+		double score = SPLIT_WEIGHT*nb_cross + fabs((double)balance);
+
+		if(best_score < 0.0 || score < best_score)
+		{
+			best_score = score;
+			best = cand;
+		}
 	}
+
+	return best;
 }
 
-void BSPNode::recursFillPrimitiveArray(vector<PtrPrimitive>& primitive_tab) const
+void BSPNode::build(vector<Polygone *>& polygons,BSPNode *& node,size_t depth,
+						  vector<BSPBuildJob> *jobs,size_t jobs_depth,BSPStats& stats)
 {
-  if(fils_plus != NULL)
-    fils_plus->recursFillPrimitiveArray(primitive_tab);
+	node = NULL;
+
+	if(polygons.empty())
+		return;
+
+	if(jobs != NULL && depth == jobs_depth)
+	{
+		jobs->push_back(BSPBuildJob());
+		jobs->back().polygons.swap(polygons);
+		jobs->back().node = &node;
+		jobs->back().depth = depth;
+		return;
+	}
+
+	// 1 - choose the splitting polygon, and classify all others.
 
-  for(unsigned int i=0;i<seg_plus.size();++i)
-    primitive_tab.push_back(seg_plus[i]);
-  for(unsigned int j=0;j<pts_plus.size();++j)
-    primitive_tab.push_back(pts_plus[j]);
+	size_t splitter = chooseSplitter(polygons);
+
+	node = new BSPNode(polygons[splitter]);
+
+	++stats.nb_nodes;
+	stats.depth = max(stats.depth,depth+1);
+
+	vector<Polygone *> side_plus_tab;
+	vector<Polygone *> side_moins_tab;
+
+	for(size_t i=0;i<polygons.size();++i)
+		if(i != splitter)
+		{
+			Polygone *side_plus = NULL, *side_moins = NULL;
+
+			if(node->Classify(polygons[i],side_moins,side_plus))
+				++stats.nb_splits;
+
+			if(side_plus != NULL) side_plus_tab.push_back(side_plus);
+			if(side_moins != NULL) side_moins_tab.push_back(side_moins);
+		}
 
-  if(polygone != NULL)
-    primitive_tab.push_back(polygone);
+	vector<Polygone *>().swap(polygons);
 
-  if(fils_moins != NULL)
-    fils_moins->recursFillPrimitiveArray(primitive_tab);
+	// 2 - build subtrees
 
-  for(unsigned int i2=0;i2<seg_moins.size();++i2)
-    primitive_tab.push_back(seg_moins[i2]);
-  for(unsigned int j2=0;j2<pts_moins.size();++j2)
-    primitive_tab.push_back(pts_moins[j2]);
+	build(side_plus_tab,node->fils_plus,depth+1,jobs,jobs_depth,stats);
+	build(side_moins_tab,node->fils_moins,depth+1,jobs,jobs_depth,stats);
 }
 
 void BSPNode::insert(Point *P)
@@ -552,24 +817,25 @@ void BSPNode::insert(Point *P)
 	}
 }
 
-void BSPNode::insert(Segment *S)
+void BSPNode::insert(Segment *S,BSPStats& stats)
 {
 	Segment *side_plus = NULL, *side_moins = NULL;
 
-	Classify(S,side_moins,side_plus);
+	if(Classify(S,side_moins,side_plus))
+		++stats.nb_splits;
 
 	if(side_plus != NULL) {
 		if(fils_plus == NULL)
 			seg_plus.push_back(side_plus);
 		else
-			fils_plus->insert(side_plus);
+			fils_plus->insert(side_plus,stats);
 	}
 
 	if(side_moins != NULL) {
 		if(fils_moins == NULL)
 			seg_moins.push_back(side_moins);
 		else
-			fils_moins->insert(side_moins);
+			fils_moins->insert(side_moins,stats);
 	}
 }
 
@@ -43,6 +43,9 @@
 *****************************************************************************/
 
 #include <vector>
+#include <QRunnable>
+#include <QSemaphore>
+#include <QThreadPool>
 #include "VRender.h"
 #include "Optimizer.h"
 #include "Primitive.h"
@@ -50,32 +53,124 @@
 using namespace std ;
 using namespace vrender ;
 
-// Over-simplified algorithm to check wether a polygon is front-facing or not.
-// Only works for convex polygons.
+// Number of primitives tested by one BackFaceCullingTask.
 
-void BackFaceCullingOptimizer::optimize(std::vector<PtrPrimitive>& primitives_tab,VRenderParams&)
+static const size_t BFC_CHUNK_SIZE = 16384 ;
+
+namespace vrender
 {
-	Polygone *P ;
-	int nb_culled = 0 ;
+	//  Flags the back-facing polygons among primitives [begin,end). The 2D
+	// vertices of the polygons are first gathered in contiguous arrays, each
+	// polygon followed by its two first vertices again, so that the signed area
+	// of all corners is computed by one loop without indirections nor modulos.
+
+	class BackFaceCullingTask: public QRunnable
+	{
+		public:
+			BackFaceCullingTask(const vector<PtrPrimitive>& primitives_tab,size_t begin,size_t end,vector<unsigned char>& culled,QSemaphore& done)
+				: _primitives_tab(primitives_tab), _begin(begin), _end(end), _culled(culled), _done(done)
+			{
+				setAutoDelete(true) ;
+			}
+
+			virtual void run() ;
+
+		private:
+			const vector<PtrPrimitive>& _primitives_tab ;
+			size_t _begin ;
+			size_t _end ;
+			vector<unsigned char>& _culled ;
+			QSemaphore& _done ;
+	};
+}
 
-	for(size_t i=0;i<primitives_tab.size();++i)
-		if((P = dynamic_cast<Polygone *>(primitives_tab[i])) != NULL)
+void BackFaceCullingTask::run()
+{
+	vector<size_t> polygons ;	// index in _primitives_tab
+	vector<size_t> offsets ;	// first vertex in x and y, plus one past the end
+	vector<double> x ;
+	vector<double> y ;
+
+	polygons.reserve(_end-_begin) ;
+	offsets.reserve(_end-_begin+1) ;
+	x.reserve(5*(_end-_begin)) ;
+	y.reserve(5*(_end-_begin)) ;
+
+	for(size_t i=_begin;i<_end;++i)
+		if(_primitives_tab[i] != NULL && _primitives_tab[i]->type() == Primitive::POLYGON)
 		{
-						for(unsigned int j=0;j<P->nbVertices();++j)
-				if(( (P->vertex(j+2) - P->vertex(j+1))^(P->vertex(j+1) - P->vertex(j))).z() > 0.0 )
-				{
-					delete primitives_tab[i] ;
-					primitives_tab[i] = NULL ;
-					++nb_culled ;
-					break ;
-				}
+			const Polygone *P = static_cast<const Polygone *>(_primitives_tab[i]) ;
+			const Feedback3DColor *v = P->sommets3DColor() ;
+			size_t n = P->nbVertices() ;
+
+			if(n == 0)
+				continue ;
+
+			polygons.push_back(i) ;
+			offsets.push_back(x.size()) ;
+
+			for(size_t j=0;j<n;++j)
+			{
+				x.push_back(v[j].x()) ;
+				y.push_back(v[j].y()) ;
+			}
+
+			x.push_back(v[0].x()) ; x.push_back(v[1%n].x()) ;
+			y.push_back(v[0].y()) ; y.push_back(v[1%n].y()) ;
 		}
 
-	// Rule out gaps. This avoids testing for null primitives later.
+	offsets.push_back(x.size()) ;
+
+	// z component of (v[j+2]-v[j+1])^(v[j+1]-v[j]), for all j. Corners across
+	// two polygons are computed too, and ignored.
+
+	size_t nb_corners = (x.size() >= 2)?(x.size()-2):0 ;
+	vector<unsigned char> front(nb_corners) ;
+
+	for(size_t j=0;j<nb_corners;++j)
+		front[j] = ((x[j+2]-x[j+1])*(y[j+1]-y[j]) - (y[j+2]-y[j+1])*(x[j+1]-x[j]) > 0.0) ;
+
+	// Over-simplified algorithm to check wether a polygon is front-facing or not.
+	// Only works for convex polygons.
+
+	for(size_t k=0;k<polygons.size();++k)
+	{
+		unsigned char culled = 0 ;
+
+		for(size_t j=offsets[k];j<offsets[k+1]-2;++j)
+			culled |= front[j] ;
+
+		_culled[polygons[k]] = culled ;
+	}
+
+	_done.release() ;
+}
+
+void BackFaceCullingOptimizer::optimize(std::vector<PtrPrimitive>& primitives_tab,VRenderParams&)
+{
+	size_t nb_chunks = (primitives_tab.size() + BFC_CHUNK_SIZE - 1)/BFC_CHUNK_SIZE ;
+	vector<unsigned char> culled(primitives_tab.size(),0) ;
+	QSemaphore done ;
+
+	for(size_t c=0;c<nb_chunks;++c)
+		QThreadPool::globalInstance()->start(new BackFaceCullingTask(primitives_tab,c*BFC_CHUNK_SIZE,min((c+1)*BFC_CHUNK_SIZE,primitives_tab.size()),culled,done)) ;
+
+	done.acquire((int)nb_chunks) ;
+
+	//  Culled polygons are deleted here rather than in the tasks, where they would
+	// all wait for the lock of the primitive pool. Gaps are ruled out at the same
+	// time. This avoids testing for null primitives later.
+
+	int nb_culled = 0 ;
+	size_t j=0 ;
 
-	int j=0 ;
 	for(size_t k=0;k<primitives_tab.size();++k)
-		if(primitives_tab[k] != NULL)
+		if(culled[k])
+		{
+			delete primitives_tab[k] ;
+			++nb_culled ;
+		}
+		else if(primitives_tab[k] != NULL)
 			primitives_tab[j++] = primitives_tab[k] ;
 
 	primitives_tab.resize(j) ;
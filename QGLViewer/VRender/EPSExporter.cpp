@@ -51,17 +51,53 @@ using namespace vrender ;
 using namespace std ;
 
 const double EPSExporter::EPS_GOURAUD_THRESHOLD = 0.05 ;
-const char *EPSExporter::CREATOR = "VRender library - (c) Cyril Soler 2005" ;
 
-float EPSExporter::last_r = -1.0 ;
-float EPSExporter::last_g = -1.0 ;
-float EPSExporter::last_b = -1.0 ;
+// Largest value of the 24 bit coordinates of the vertices of shadings.
+static const double EPS_SHADING_COORD_MAX = 16777215.0 ;
+const char *EPSExporter::CREATOR = "VRender library - (c) Cyril Soler 2005" ;
 
 EPSExporter::EPSExporter()
 {
 	last_r = -1 ;
 	last_g = -1 ;
 	last_b = -1 ;
+
+	_level3Shading = false ;
+	_inShading = false ;
+}
+
+void EPSExporter::setLevel3Shading(bool b) { _level3Shading = b ; }
+
+Exporter *EPSExporter::clone() const { return new EPSExporter(*this) ; }
+Exporter *PSExporter::clone() const { return new PSExporter(*this) ; }
+
+void EPSExporter::skipPrimitives(const vector<PtrPrimitive>& primitive_tab,size_t begin,size_t end)
+{
+	//  The current color, and whether a shading is open, are set by every
+	// primitive that is drawn, except by the ones that draw nothing, such as
+	// smooth polygons of less than 3 vertices without level 3 shadings. So
+	// walk back to the last primitive that sets them. Colors are never
+	// negative, except -1 when unknown, hence the -2 marker.
+
+	for(size_t i=end;i>begin;--i)
+		if(primitive_tab[i-1] != NULL)
+		{
+			float r = last_r, g = last_g, b = last_b ;
+			bool in_shading = _inShading ;
+
+			last_r = last_g = last_b = -2.0 ;
+
+			ExportBuffer scratch(_referenceFormatting) ;
+			spewPrimitive(primitive_tab[i-1],scratch) ;
+
+			if(last_r != -2.0)
+				return ;
+
+			last_r = r ;
+			last_g = g ;
+			last_b = b ;
+			_inShading = in_shading ;
+		}
 }
 
 void EPSExporter::writeHeader(QTextStream& out) const
@@ -73,6 +109,10 @@ void EPSExporter::writeHeader(QTextStream& out) const
 	out << "%%%%HiResBoundingBox: " << _xmin << " " << _ymin << " " << _xmax << " " << _ymax << "\n";
 
 	out << "%%%%Creator: " << CREATOR << " (using OpenGL feedback)\n";
+
+	if(_level3Shading)
+		out << "%%LanguageLevel: 3\n";
+
 	out << "%%EndComments\n\ngsave\n\n";
 
 	out << "%\n";
@@ -88,10 +128,23 @@ void EPSExporter::writeHeader(QTextStream& out) const
 	out << "%        Xfig3.2 (and EPS) format\n";
 	out << "%\n\n";
 
-	out << "/threshold " << EPS_GOURAUD_THRESHOLD << " def\n";
+	if(_level3Shading)
+	{
+		//  gsh paints the type 4 shading whose vertices follow in the file, as
+		// hexadecimal flag, x, y (24 bits each, over the bounding box) and rgb.
+
+		out << "/gsh { << /ShadingType 4 /ColorSpace /DeviceRGB\n";
+		out << "/BitsPerCoordinate 24 /BitsPerComponent 8 /BitsPerFlag 8\n";
+		out << "/Decode [" << _xmin << " " << max(_xmax,_xmin+1.0f) << " " << _ymin << " " << max(_ymax,_ymin+1.0f) << " 0 1 0 1 0 1]\n";
+		out << "/DataSource currentfile /ASCIIHexDecode filter >> shfill } bind def\n";
+	}
+	else
+	{
+		out << "/threshold " << EPS_GOURAUD_THRESHOLD << " def\n";
 
-	for(int i = 0; GOURAUD_TRIANGLE_EPS[i] != NULL; i++)
-		out << GOURAUD_TRIANGLE_EPS[i] << "\n";
+		for(int i = 0; GOURAUD_TRIANGLE_EPS[i] != NULL; i++)
+			out << GOURAUD_TRIANGLE_EPS[i] << "\n";
+	}
 #ifdef A_VOIR
 	out <<  "\n" <<  << " setlinewidth\n\n", _lineWidth;
 #endif
@@ -106,6 +159,9 @@ void EPSExporter::writeHeader(QTextStream& out) const
 
 void EPSExporter::writeFooter(QTextStream& out) const
 {
+	if(_inShading)
+		out << ">\n";
+
 	out << "grestore\n\n";
 
 	out << "% uncomment next line to be able to print to a printer.\n";
@@ -114,6 +170,9 @@ void EPSExporter::writeFooter(QTextStream& out) const
 
 void PSExporter::writeFooter(QTextStream& out) const
 {
+	if(_inShading)
+		out << ">\n";
+
 	out << "showpage\n";
 }
 
@@ -149,7 +208,7 @@ const char *EPSExporter::GOURAUD_TRIANGLE_EPS[] =
 	NULL
 };
 
-void EPSExporter::spewPolygone(const Polygone *P, QTextStream& out)
+void EPSExporter::spewPolygone(const Polygone *P, ExportBuffer& out)
 {
 	int nvertices;
 	GLfloat red, green, blue;
@@ -171,7 +230,22 @@ void EPSExporter::spewPolygone(const Polygone *P, QTextStream& out)
 			if(fabs(red - P->sommet3DColor(i).red()) > 0.01 || fabs(green - P->sommet3DColor(i).green()) > 0.01 || fabs(blue - P->sommet3DColor(i).blue()) > 0.01)
 				smooth = true;
 
-		if(smooth && !_blackAndWhite)
+		if(smooth && !_blackAndWhite && _level3Shading && nvertices >= 3)
+		{
+			/* Smooth shaded polygon, added to the current shading as a fan of
+				triangles: the first one is given by 3 vertices with flag 0, and the
+				next ones by one vertex with flag 2 (shared edge va-vc). Degenerate
+				polygons would leave an incomplete triangle in the shading data, and
+				are drawn flat instead. */
+
+			beginShading(out) ;
+
+			for (int j = 0; j < nvertices; j++)
+				spewShadingVertex(out, (j < 3)?0:2, P->sommet3DColor(j)) ;
+
+			out << "\n";
+		}
+		else if(smooth && !_blackAndWhite && !_level3Shading)
 		{
 			/* Smooth shaded polygon; varying colors at vertices. */
 			/* Break polygon into "nvertices-2" triangle fans. */
@@ -192,6 +266,8 @@ void EPSExporter::spewPolygone(const Polygone *P, QTextStream& out)
 		{
 			/* Flat shaded polygon and white polygons; all vertex colors the same. */
 
+			endShading(out) ;
+
 			out <<  "newpath\n";
 
 			if(_blackAndWhite)
@@ -211,7 +287,7 @@ void EPSExporter::spewPolygone(const Polygone *P, QTextStream& out)
 	}
 }
 
-void EPSExporter::spewSegment(const Segment *S, QTextStream& out)
+void EPSExporter::spewSegment(const Segment *S, ExportBuffer& out)
 {
   GLdouble dx, dy;
   GLfloat dr, dg, db, absR, absG, absB, colormax;
@@ -269,6 +345,8 @@ void EPSExporter::spewSegment(const Segment *S, QTextStream& out)
   else
 	  steps = 0; /* Single color line. */
 
+  endShading(out) ;
+
   if(_blackAndWhite)
 	  setColor(out,0.0,0.0,0.0) ;
   else
@@ -293,10 +371,12 @@ void EPSExporter::spewSegment(const Segment *S, QTextStream& out)
   out << P2.x() << " " << P2.y() << " lineto stroke\n";
 }
 
-void EPSExporter::spewPoint(const Point *P, QTextStream& out)
+void EPSExporter::spewPoint(const Point *P, ExportBuffer& out)
 {
 	const Feedback3DColor& p = Feedback3DColor(P->sommet3DColor(0)) ;
 
+	endShading(out) ;
+
 	if(_blackAndWhite)
 		setColor(out,0.0,0.0,0.0) ;
 	else
@@ -305,7 +385,7 @@ void EPSExporter::spewPoint(const Point *P, QTextStream& out)
 	out << p.x() << " " << p.y() << " " << (_pointSize / 2.0) << " 0 360 arc fill\n\n";
 }
 
-void EPSExporter::setColor(QTextStream& out, float red, float green, float blue)
+void EPSExporter::setColor(ExportBuffer& out, float red, float green, float blue)
 {
 	if(last_r != red || last_g != green || last_b != blue)
 		out << red << " " << green << " " << blue << " setrgbcolor\n";
@@ -315,3 +395,51 @@ void EPSExporter::setColor(QTextStream& out, float red, float green, float blue)
 	last_b = blue ;
 }
 
+//  Vertices of smooth polygons are written in the data of a shading, which is
+// kept open as long as smooth polygons follow each other.
+
+void EPSExporter::beginShading(ExportBuffer& out)
+{
+	if(!_inShading)
+		out << "gsh\n";
+
+	_inShading = true ;
+
+	last_r = last_g = last_b = -1.0 ;
+}
+
+void EPSExporter::endShading(ExportBuffer& out)
+{
+	if(_inShading)
+		out << ">\n";
+
+	_inShading = false ;
+}
+
+void EPSExporter::spewShadingVertex(ExportBuffer& out,int flag,const Feedback3DColor& v)
+{
+	static const char HEX[] = "0123456789abcdef" ;
+
+	double sx = (v.x() - _xmin)/max(_xmax - _xmin,1.0f) ;
+	double sy = (v.y() - _ymin)/max(_ymax - _ymin,1.0f) ;
+
+	unsigned int values[6] = {	(unsigned int)flag,
+										(unsigned int)(0.5 + EPS_SHADING_COORD_MAX*max(0.0,min(1.0,sx))),
+										(unsigned int)(0.5 + EPS_SHADING_COORD_MAX*max(0.0,min(1.0,sy))),
+										(unsigned int)(0.5f + 255*max(0.0f,min(1.0f,v.red()))),
+										(unsigned int)(0.5f + 255*max(0.0f,min(1.0f,v.green()))),
+										(unsigned int)(0.5f + 255*max(0.0f,min(1.0f,v.blue()))) } ;
+	static const int digits[6] = { 2, 6, 6, 2, 2, 2 } ;
+
+	char hex[22] ;
+	int n = 0 ;
+
+	for(int i=0;i<6;++i)
+		for(int d=digits[i]-1;d>=0;--d)
+			hex[n++] = HEX[(values[i] >> (4*d)) & 15] ;
+
+	hex[n++] = ' ' ;
+	hex[n] = 0 ;
+
+	out << hex ;
+}
@@ -47,51 +47,469 @@
 #include "../qglviewer.h"
 
 #include <QFile>
-#include <QMessageBox>
+#include <QRunnable>
+#include <QSemaphore>
+#include <QThread>
+#include <QThreadPool>
+
+#include <math.h>
+#include <string.h>
 
 using namespace vrender ;
 using namespace std ;
 
+// Number of primitives formatted together by one task.
+
+static const size_t EXPORT_CHUNK_SIZE = 4096 ;
+
+// Expected size of the output of one primitive, used to preallocate buffers.
+
+static const size_t EXPORT_BYTES_PER_PRIMITIVE = 80 ;
+
+namespace vrender
+{
+	//  Formats primitives [begin,end) with its own copy of the exporter, and
+	// signals done when finished.
+
+	class ExportChunkTask: public QRunnable
+	{
+		public:
+			ExportChunkTask(Exporter *exporter,const vector<PtrPrimitive>& primitive_tab,size_t begin,size_t end,ExportBuffer& buffer,QSemaphore& done)
+				: _exporter(exporter), _primitive_tab(primitive_tab), _begin(begin), _end(end), _buffer(buffer), _done(done)
+			{
+				setAutoDelete(true) ;
+			}
+
+			virtual void run()
+			{
+				for(size_t i=_begin;i<_end;++i)
+					_exporter->spewPrimitive(_primitive_tab[i],_buffer) ;
+
+				delete _exporter ;
+				_done.release() ;
+			}
+
+		private:
+			Exporter *_exporter ;
+			const vector<PtrPrimitive>& _primitive_tab ;
+			size_t _begin ;
+			size_t _end ;
+			ExportBuffer& _buffer ;
+			QSemaphore& _done ;
+	};
+}
+
+//  Chunk waiting to be written to the file.
+
+struct ExportChunk
+{
+	ExportChunk(bool reference_formatting) : buffer(reference_formatting) {}
+
+	ExportBuffer buffer ;
+	QSemaphore done ;
+};
+
+ExportBuffer::ExportBuffer(bool reference_formatting)
+	: _size(0), _reference_formatting(reference_formatting)
+{
+}
+
+void ExportBuffer::reserve(size_t n)
+{
+	if(_data.size() < n)
+		_data.resize(n) ;
+}
+
+//  Returns a pointer to n more bytes at the end of the buffer.
+
+char *ExportBuffer::grow(size_t n)
+{
+	if(_size + n > _data.size())
+		_data.resize(max(2*_data.size(),_size + n)) ;
+
+	char *p = &_data[_size] ;
+	_size += n ;
+
+	return p ;
+}
+
+ExportBuffer& ExportBuffer::operator<<(const char *s)
+{
+	size_t n = strlen(s) ;
+	memcpy(grow(n),s,n) ;
+
+	return *this ;
+}
+
+ExportBuffer& ExportBuffer::operator<<(char c)
+{
+	*grow(1) = c ;
+
+	return *this ;
+}
+
+ExportBuffer& ExportBuffer::operator<<(int v)
+{
+	char tmp[16] ;
+	int n = 0 ;
+	unsigned int u = (v < 0)?(0u - (unsigned int)v):(unsigned int)v ;
+
+	do
+	{
+		tmp[n++] = char('0' + u%10) ;
+		u /= 10 ;
+	}
+	while(u > 0) ;
+
+	if(v < 0)
+		tmp[n++] = '-' ;
+
+	char *p = grow(n) ;
+
+	while(n > 0)
+		*(p++) = tmp[--n] ;
+
+	return *this ;
+}
+
+ExportBuffer& ExportBuffer::operator<<(double v)
+{
+	if(_reference_formatting || !appendShortNumber(v))
+		appendReferenceNumber(v) ;
+
+	return *this ;
+}
+
+ExportBuffer& ExportBuffer::appendFixed(double v,int nb_decimals)
+{
+	static const double POW10[] = { 1e0,1e1,1e2,1e3,1e4,1e5,1e6 } ;
+
+	if(nb_decimals < 0 || nb_decimals > 6 || !(fabs(v*POW10[nb_decimals]) < 1e15))
+		return *this << v ;
+
+	long long n = (long long)floor(v*POW10[nb_decimals] + 0.5) ;
+	long long unit = (long long)POW10[nb_decimals] ;
+
+	if(n < 0)
+	{
+		*this << '-' ;
+		n = -n ;
+	}
+
+	char tmp[24] ;
+	int len = 0 ;
+	long long ipart = n / unit ;
+
+	do
+	{
+		tmp[len++] = char('0' + ipart%10) ;
+		ipart /= 10 ;
+	}
+	while(ipart > 0) ;
+
+	char *p = grow(len) ;
+
+	while(len > 0)
+		*(p++) = tmp[--len] ;
+
+	long long fpart = n % unit ;
+
+	if(fpart > 0)
+	{
+		int nb = nb_decimals ;
+
+		while(fpart % 10 == 0)
+		{
+			fpart /= 10 ;
+			--nb ;
+		}
+
+		p = grow(nb+1) ;
+		*p = '.' ;
+
+		for(int i=nb;i>0;--i)
+		{
+			p[i] = char('0' + fpart%10) ;
+			fpart /= 10 ;
+		}
+	}
+
+	return *this ;
+}
+
+void ExportBuffer::appendReferenceNumber(double v)
+{
+	// Same as QTextStream: 'g' format, 6 significant digits, C locale.
+
+	QByteArray s = QString::number(v,'g',6).toLatin1() ;
+
+	memcpy(grow(s.size()),s.constData(),s.size()) ;
+}
+
+//  Writes v with 6 significant digits in fixed notation, as QTextStream would.
+// v is scaled to a 6 digit integer, which is exact for float values and within
+// a tiny error for doubles. Returns false, without writing anything, when the
+// result could differ from Qt's: exponent notation, rounding ties, and
+// special values. These are then formatted by Qt.
+
+bool ExportBuffer::appendShortNumber(double v)
+{
+	static const double POW10[] = { 1e0,1e1,1e2,1e3,1e4,1e5,1e6,1e7,1e8,1e9,1e10,1e11 } ;
+	static const double TIE_EPS = 1e-6 ;
+
+	if(v == 0.0)
+	{
+		if(1.0/v < 0.0)	// -0
+			return false ;
+
+		*grow(1) = '0' ;
+		return true ;
+	}
+
+	double a = fabs(v) ;
+
+	if(!(a >= 1e-5 && a < 1e6))	// also rejects NaN
+		return false ;
+
+	// a = scaled x 10^(e-5), with 10^5 <= scaled < 10^6
+
+	int e = 5 ;
+
+	while(e > -5 && a < POW10[e+5]*1e-5)
+		--e ;
+
+	double scaled = a*POW10[5-e] ;
+
+	if(scaled < 1e5)
+	{
+		if(e == -5)
+			return false ;
+
+		--e ;
+		scaled = a*POW10[5-e] ;
+	}
+
+	double r = floor(scaled) ;
+	double frac = scaled - r ;
+
+	if(fabs(frac - 0.5) < TIE_EPS)
+		return false ;
+
+	long digits = long(r) + ((frac > 0.5)?1:0) ;
+
+	if(digits >= 1000000)
+	{
+		digits /= 10 ;
+		++e ;
+	}
+
+	if(e < -4 || e > 5)
+		return false ;
+
+	char tmp[6] ;
+
+	for(int i=5;i>=0;--i)
+	{
+		tmp[i] = char('0' + digits%10) ;
+		digits /= 10 ;
+	}
+
+	int nb_digits = 6 ;
+
+	while(nb_digits > 1 && nb_digits > e+1 && tmp[nb_digits-1] == '0')
+		--nb_digits ;
+
+	char *p = grow((v < 0.0) + nb_digits + ((e < 0)?(1-e):(nb_digits > e+1))) ;
+
+	if(v < 0.0)
+		*(p++) = '-' ;
+
+	if(e < 0)
+	{
+		*(p++) = '0' ;
+		*(p++) = '.' ;
+
+		for(int i=0;i<-e-1;++i)
+			*(p++) = '0' ;
+
+		memcpy(p,tmp,nb_digits) ;
+	}
+	else
+	{
+		memcpy(p,tmp,e+1) ;
+		p += e+1 ;
+
+		if(nb_digits > e+1)
+		{
+			*(p++) = '.' ;
+			memcpy(p,tmp+e+1,nb_digits-e-1) ;
+		}
+	}
+
+	return true ;
+}
+
 Exporter::Exporter()
 {
 	_xmin=_xmax=_ymin=_ymax=_zmin=_zmax = 0.0 ;
 	_pointSize=1 ;
+	_referenceFormatting = false ;
+	_file = NULL ;
+	_out = NULL ;
+}
+
+Exporter::~Exporter()
+{
+	delete _out ;
+	delete _file ;
 }
 
 void Exporter::exportToFile(const QString& filename,
 							const vector<PtrPrimitive>& primitive_tab,
 							VRenderParams& vparams)
 {
-	QFile file(filename);
+	beginExport(filename) ;
+	exportPrimitives(primitive_tab,vparams) ;
+	endExport() ;
+}
 
-	if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
-		QMessageBox::warning(NULL, QGLViewer::tr("Exporter error", "Message box window title"), QGLViewer::tr("Unable to open file %1.").arg(filename));
-		return;
+void Exporter::beginExport(const QString& filename)
+{
+	_filename = filename ;
+	_file = new QFile(filename) ;
+
+	if (!_file->open(QIODevice::WriteOnly | QIODevice::Text)) {
+		delete _file ;
+		_file = NULL ;
+		throw std::runtime_error(QGLViewer::tr("Unable to open file %1.").arg(filename).toLatin1().constData()) ;
 	}
 
-	QTextStream out(&file);
+	_out = new QTextStream(_file) ;
+
+	writeHeader(*_out) ;
+	_out->flush() ;
+}
+
+void Exporter::endExport()
+{
+	if(_file == NULL)
+		return ;
+
+	writeFooter(*_out) ;
+	_out->flush() ;
+
+	delete _out ;
+	_out = NULL ;
 
-	writeHeader(out) ;
+	_file->close() ;
+	delete _file ;
+	_file = NULL ;
+}
+
+void Exporter::exportPrimitives(const vector<PtrPrimitive>& primitive_tab,VRenderParams& vparams)
+{
+	size_t nb_chunks = (primitive_tab.size() + EXPORT_CHUNK_SIZE - 1)/EXPORT_CHUNK_SIZE ;
 
-		unsigned int N = primitive_tab.size()/200 + 1 ;
+	if(_file == NULL)
+		return ;
 
-	for(unsigned int i=0;i<primitive_tab.size();++i)
+	if(_referenceFormatting)
 	{
-		Point *p = dynamic_cast<Point *>(primitive_tab[i]) ;
-		Segment *s = dynamic_cast<Segment *>(primitive_tab[i]) ;
-		Polygone *P = dynamic_cast<Polygone *>(primitive_tab[i]) ;
+		ExportBuffer buffer(true) ;
+
+		for(size_t c=0;c<nb_chunks;++c)
+		{
+			size_t end = min((c+1)*EXPORT_CHUNK_SIZE,primitive_tab.size()) ;
+
+			buffer.clear() ;
 
-		if(p != NULL) spewPoint(p,out) ;
-		if(s != NULL) spewSegment(s,out) ;
-		if(P != NULL) spewPolygone(P,out) ;
+			for(size_t i=c*EXPORT_CHUNK_SIZE;i<end;++i)
+				spewPrimitive(primitive_tab[i],buffer) ;
 
-		if(i%N == 0)
-			vparams.progress(i/(float)primitive_tab.size(),QGLViewer::tr("Exporting to file %1").arg(filename)) ;
+			_file->write(buffer.data(),buffer.size()) ;
+
+			vparams.progress(end/(float)primitive_tab.size(),QGLViewer::tr("Exporting to file %1").arg(_filename)) ;
+		}
 	}
+	else
+	{
+		//  Chunks are formatted in parallel, each by its own copy of the exporter,
+		// and written in order. This exporter skips each chunk once its copy is
+		// made, which is cheap, so that it always has the state at the beginning
+		// of the next chunk. The number of chunks in memory is bounded.
+
+		size_t max_pending = 2*(size_t)max(1,QThread::idealThreadCount()) ;
+		vector<ExportChunk *> chunks(nb_chunks,(ExportChunk *)NULL) ;
+		size_t next = 0 ;
+		size_t c = 0 ;
+
+		try
+		{
+			for(;c<nb_chunks;++c)
+			{
+				for(;next < nb_chunks && next < c + max_pending;++next)
+				{
+					size_t begin = next*EXPORT_CHUNK_SIZE ;
+					size_t end = min(begin + EXPORT_CHUNK_SIZE,primitive_tab.size()) ;
+
+					chunks[next] = new ExportChunk(false) ;
+					chunks[next]->buffer.reserve((end-begin)*EXPORT_BYTES_PER_PRIMITIVE) ;
+
+					Exporter *copy = clone() ;
+					copy->_file = NULL ;
+					copy->_out = NULL ;
+
+					QThreadPool::globalInstance()->start(new ExportChunkTask(copy,primitive_tab,begin,end,chunks[next]->buffer,chunks[next]->done)) ;
+
+					skipPrimitives(primitive_tab,begin,end) ;
+				}
+
+				chunks[c]->done.acquire() ;
+				_file->write(chunks[c]->buffer.data(),chunks[c]->buffer.size()) ;
+
+				delete chunks[c] ;
+				chunks[c] = NULL ;
 
-	writeFooter(out) ;
+				vparams.progress((c+1)/(float)nb_chunks,QGLViewer::tr("Exporting to file %1").arg(_filename)) ;
+			}
+		}
+		catch(exception&)
+		{
+			//  The render was cancelled: chunks still being formatted are waited
+			// for, since they use the primitives.
+
+			for(;c<next;++c)
+				if(chunks[c] != NULL)
+				{
+					chunks[c]->done.acquire() ;
+					delete chunks[c] ;
+				}
+
+			throw ;
+		}
+	}
+}
+
+void Exporter::spewPrimitive(const Primitive *P,ExportBuffer& out)
+{
+	if(P != NULL)
+		switch(P->type())
+		{
+			case Primitive::POINT:   spewPoint(static_cast<const Point *>(P),out) ;
+				break ;
+			case Primitive::SEGMENT: spewSegment(static_cast<const Segment *>(P),out) ;
+				break ;
+			case Primitive::POLYGON: spewPolygone(static_cast<const Polygone *>(P),out) ;
+				break ;
+		}
+}
+
+void Exporter::skipPrimitives(const vector<PtrPrimitive>& primitive_tab,size_t begin,size_t end)
+{
+	ExportBuffer scratch(_referenceFormatting) ;
 
-	file.close();
+	for(size_t i=begin;i<end;++i)
+		spewPrimitive(primitive_tab[i],scratch) ;
 }
 
 void Exporter::setBoundingBox(float xmin,float ymin,float xmax,float ymax)
@@ -105,4 +523,5 @@ void Exporter::setBoundingBox(float xmin,float ymin,float xmax,float ymax)
 void Exporter::setClearColor(float r, float g, float b) { _clearR=r; _clearG=g; _clearB=b; }
 void Exporter::setClearBackground(bool b) { _clearBG=b; }
 void Exporter::setBlackAndWhite(bool b) { _blackAndWhite = b; }
+void Exporter::setReferenceFormatting(bool b) { _referenceFormatting = b; }
 
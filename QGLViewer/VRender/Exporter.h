@@ -50,33 +50,91 @@
 #include "Primitive.h"
 
 #include "../config.h"
+#include <QFile>
 #include <QTextStream>
 #include <QString>
 
 namespace vrender
 {
 	class VRenderParams ;
+
+	//  Growable byte buffer in which primitives are formatted before being written
+	// to the file. Numbers are formatted like QTextStream does (6 significant
+	// digits), either by a fast formatter that falls back on Qt when it can not
+	// guarantee the same result, or by Qt only (reference formatting).
+
+	class ExportBuffer
+	{
+		public:
+			ExportBuffer(bool reference_formatting) ;
+
+			ExportBuffer& operator<<(const char *) ;
+			ExportBuffer& operator<<(char) ;
+			ExportBuffer& operator<<(int) ;
+			ExportBuffer& operator<<(double) ;
+
+			// Writes v in fixed notation, rounded to nb_decimals, without trailing zeros.
+			ExportBuffer& appendFixed(double v,int nb_decimals) ;
+
+			const char *data() const { return _data.empty()?NULL:&_data[0] ; }
+			size_t size() const { return _size ; }
+			void clear() { _size = 0 ; }
+			void reserve(size_t) ;
+
+		private:
+			char *grow(size_t) ;
+			bool appendShortNumber(double) ;
+			void appendReferenceNumber(double) ;
+
+			std::vector<char> _data ;
+			size_t _size ;
+			bool _reference_formatting ;
+	};
+
 	class Exporter
 	{
 		public:
 			Exporter() ;
-			virtual ~Exporter() {};
+			virtual ~Exporter() ;
 
+			//  Throws a std::runtime_error if the file can not be opened. No message
+			// box is shown, since exports may run outside of the GUI thread.
 			virtual void exportToFile(const QString& filename,const std::vector<PtrPrimitive>&,VRenderParams&) ;
 
+			//  Same as exportToFile(), with primitives given in several successive
+			// calls to exportPrimitives(), in rendering order.
+			void beginExport(const QString& filename) ;
+			void exportPrimitives(const std::vector<PtrPrimitive>&,VRenderParams&) ;
+			void endExport() ;
+
 			void setBoundingBox(float xmin,float ymin,float xmax,float ymax) ;
 			void setClearColor(float r,float g,float b) ;
 			void setClearBackground(bool b) ;
 			void setBlackAndWhite(bool b) ;
 
+			//  When set, numbers are formatted by Qt and primitives are written one
+			// after the other, as in previous versions. The output is the same, only slower.
+			void setReferenceFormatting(bool b) ;
+
 		protected:
-			virtual void spewPoint(const Point *, QTextStream& out) = 0 ;
-			virtual void spewSegment(const Segment *, QTextStream& out) = 0 ;
-			virtual void spewPolygone(const Polygone *, QTextStream& out) = 0 ;
+			//  Copy of the exporter, in its current state, used to format a chunk of
+			// primitives in a separate thread.
+			virtual Exporter *clone() const = 0 ;
+
+			//  Updates the state of the exporter (current color, depth, ...) as if
+			// primitives [begin,end) had been spewed. The default implementation
+			// formats them into a scratch buffer.
+			virtual void skipPrimitives(const std::vector<PtrPrimitive>&,size_t begin,size_t end) ;
+
+			virtual void spewPoint(const Point *, ExportBuffer& out) = 0 ;
+			virtual void spewSegment(const Segment *, ExportBuffer& out) = 0 ;
+			virtual void spewPolygone(const Polygone *, ExportBuffer& out) = 0 ;
 
 			virtual void writeHeader(QTextStream& out) const = 0 ;
 			virtual void writeFooter(QTextStream& out) const = 0 ;
 
+			void spewPrimitive(const Primitive *, ExportBuffer& out) ;
+
 			float _clearR,_clearG,_clearB ;
 			float _pointSize ;
 			float _lineWidth ;
@@ -84,6 +142,13 @@ namespace vrender
 			GLfloat _xmin,_xmax,_ymin,_ymax,_zmin,_zmax ;
 
 			bool _clearBG,_blackAndWhite ;
+			bool _referenceFormatting ;
+
+			QString _filename ;
+			QFile *_file ;
+			QTextStream *_out ;
+
+			friend class ExportChunkTask ;
 	};
 
 	// Exports to encapsulated postscript.
@@ -94,24 +159,40 @@ namespace vrender
 			EPSExporter() ;
 			virtual ~EPSExporter() {};
 
+			//  When set, runs of smooth shaded polygons are drawn as PostScript Level 3
+			// free-form triangle meshes (type 4 shadings), instead of triangles that
+			// are recursively subdivided by the printer.
+			void setLevel3Shading(bool b) ;
+
 		protected:
-			virtual void spewPoint(const Point *, QTextStream& out) ;
-			virtual void spewSegment(const Segment *, QTextStream& out) ;
-			virtual void spewPolygone(const Polygone *, QTextStream& out) ;
+			virtual Exporter *clone() const ;
+			virtual void skipPrimitives(const std::vector<PtrPrimitive>&,size_t begin,size_t end) ;
+
+			virtual void spewPoint(const Point *, ExportBuffer& out) ;
+			virtual void spewSegment(const Segment *, ExportBuffer& out) ;
+			virtual void spewPolygone(const Polygone *, ExportBuffer& out) ;
 
 			virtual void writeHeader(QTextStream& out) const ;
 			virtual void writeFooter(QTextStream& out) const ;
 
+			bool _inShading ;	// inside the data of a shading
+
 		private:
-			void setColor(QTextStream& out,float,float,float) ;
+			void setColor(ExportBuffer& out,float,float,float) ;
+
+			void beginShading(ExportBuffer& out) ;
+			void endShading(ExportBuffer& out) ;
+			void spewShadingVertex(ExportBuffer& out,int flag,const Feedback3DColor&) ;
 
 			static const double EPS_GOURAUD_THRESHOLD ;
 			static const char *GOURAUD_TRIANGLE_EPS[] ;
 			static const char *CREATOR ;
 
-			static float last_r ;
-			static float last_g ;
-			static float last_b ;
+			float last_r ;
+			float last_g ;
+			float last_b ;
+
+			bool _level3Shading ;
 	};
 
 	//  Exports to postscript. The only difference is the filename extension and
@@ -122,6 +203,7 @@ namespace vrender
 		public:
 			virtual ~PSExporter() {};
 		protected:
+			virtual Exporter *clone() const ;
 			virtual void writeFooter(QTextStream& out) const ;
 	};
 
@@ -132,9 +214,12 @@ namespace vrender
 			virtual ~FIGExporter() {};
 
 		protected:
-			virtual void spewPoint(const Point *, QTextStream& out) ;
-			virtual void spewSegment(const Segment *, QTextStream& out) ;
-			virtual void spewPolygone(const Polygone *, QTextStream& out) ;
+			virtual Exporter *clone() const ;
+			virtual void skipPrimitives(const std::vector<PtrPrimitive>&,size_t begin,size_t end) ;
+
+			virtual void spewPoint(const Point *, ExportBuffer& out) ;
+			virtual void spewSegment(const Segment *, ExportBuffer& out) ;
+			virtual void spewPolygone(const Polygone *, ExportBuffer& out) ;
 
 			virtual void writeHeader(QTextStream& out) const ;
 			virtual void writeFooter(QTextStream& out) const ;
@@ -148,18 +233,39 @@ namespace vrender
 			int FigCoordY(double) const ;
 			int FigGrayScaleIndex(float red, float green, float blue) const ;
 	};
-#ifdef A_FAIRE
+
+	//  Exports to SVG. Consecutive primitives of the same kind and color are
+	// merged into a single path element, and coordinates are written with a fixed
+	// number of decimals.
+
 	class SVGExporter: public Exporter
 	{
+		public:
+			SVGExporter() ;
+			virtual ~SVGExporter() {};
+
 		protected:
-			virtual void spewPoint(const Point *, QTextStream& out) ;
-			virtual void spewSegment(const Segment *, QTextStream& out) ;
-			virtual void spewPolygone(const Polygone *, QTextStream& out) ;
+			virtual Exporter *clone() const ;
+			virtual void skipPrimitives(const std::vector<PtrPrimitive>&,size_t begin,size_t end) ;
+
+			virtual void spewPoint(const Point *, ExportBuffer& out) ;
+			virtual void spewSegment(const Segment *, ExportBuffer& out) ;
+			virtual void spewPolygone(const Polygone *, ExportBuffer& out) ;
 
 			virtual void writeHeader(QTextStream& out) const ;
 			virtual void writeFooter(QTextStream& out) const ;
+
+		private:
+			enum PathKind { NO_PATH, POINT_PATH, SEGMENT_PATH, POLYGON_PATH } ;
+
+			void setPath(ExportBuffer& out,PathKind kind,float red,float green,float blue) ;
+			void spewVertex(ExportBuffer& out,char command,const Feedback3DColor&) ;
+
+			static const int SVG_DECIMALS ;
+
+			PathKind _pathKind ;
+			unsigned int _pathColor ;
 	};
-#endif
 }
 
 #endif
@@ -87,6 +87,22 @@ FIGExporter::FIGExporter()
 {
 }
 
+Exporter *FIGExporter::clone() const { return new FIGExporter(*this) ; }
+
+void FIGExporter::skipPrimitives(const vector<PtrPrimitive>& primitive_tab,size_t begin,size_t end)
+{
+	// Same depth updates as the spew functions.
+
+	for(size_t i=begin;i<end;++i)
+		if(primitive_tab[i] != NULL)
+		{
+			if(!(primitive_tab[i]->type() == Primitive::POLYGON && primitive_tab[i]->nbVertices() == 0))
+				_depth-- ;
+
+			if(_depth > 0) _depth = 0 ;
+		}
+}
+
 void FIGExporter::writeHeader(QTextStream& out) const
 {
 	out << "#FIG 3.2\nPortrait\nCenter\nInches\nLetter\n100.00\nSingle\n0\n1200 2\n";
@@ -100,7 +116,7 @@ void FIGExporter::writeFooter(QTextStream& out) const
 	Q_UNUSED(out);
 }
 
-void FIGExporter::spewPoint(const Point *P, QTextStream& out)
+void FIGExporter::spewPoint(const Point *P, ExportBuffer& out)
 {
 	out << "2 1 0 5 0 7 " << (_depth--) << " 0 -1 0.000 0 1 -1 0 0 1\n";
 
@@ -108,7 +124,7 @@ void FIGExporter::spewPoint(const Point *P, QTextStream& out)
 	if(_depth > 0) _depth = 0 ;
 }
 
-void FIGExporter::spewSegment(const Segment *S, QTextStream& out)
+void FIGExporter::spewSegment(const Segment *S, ExportBuffer& out)
 {
 	const Feedback3DColor& P1 = Feedback3DColor(S->sommet3DColor(0)) ;
 	const Feedback3DColor& P2 = Feedback3DColor(S->sommet3DColor(1)) ;
@@ -176,7 +192,7 @@ void FIGExporter::spewSegment(const Segment *S, QTextStream& out)
 	if(_depth > 0) _depth = 0 ;
 }
 
-void FIGExporter::spewPolygone(const Polygone *P, QTextStream& out)
+void FIGExporter::spewPolygone(const Polygone *P, ExportBuffer& out)
 {
 	int nvertices;
 	GLfloat red, green, blue;
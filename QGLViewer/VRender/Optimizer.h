@@ -70,13 +70,27 @@ namespace vrender
 			virtual ~VisibilityOptimizer() {} ;
 	};
 
+	//  Approximate and much faster version of VisibilityOptimizer. Primitives are
+	// rasterized into an item buffer (see VRenderParams::rasterResolution()), and those
+	// whose pixels are all covered by later polygons are culled. Segments and points never
+	// hide anything. Primitives too small to cover any pixel are kept.
+
+	class RasterVisibilityOptimizer: public Optimizer
+	{
+		public:
+			virtual void optimize(std::vector<PtrPrimitive>&,VRenderParams&) ;
+			virtual ~RasterVisibilityOptimizer() {} ;
+	};
+
 	//  Optimizes by collapsing together primitives which can be, without
-	// perturbating the back to front painting algorithm.
+	// perturbating the back to front painting algorithm. Adjacent coplanar
+	// polygons of the same flat color (typically fragments of a face split by the
+	// sorting) are merged back into convex polygons.
 
 	class PrimitiveSplitOptimizer: public Optimizer
 	{
 		public:
-			virtual void optimize(std::vector<PtrPrimitive>&,VRenderParams&) {}
+			virtual void optimize(std::vector<PtrPrimitive>&,VRenderParams&) ;
 			virtual ~PrimitiveSplitOptimizer() {} ;
 	};
 
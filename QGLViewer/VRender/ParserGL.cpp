@@ -45,37 +45,72 @@
 #include <assert.h>
 #include <math.h>
 #include <stdio.h>
+#include <string.h>
+
+#include <QRunnable>
+#include <QSemaphore>
+#include <QThread>
+#include <QThreadPool>
 
 #include "VRender.h"
 #include "ParserGL.h"
+#include "PrimitiveCapture.h"
+#include "PrimitiveStream.h"
 
 using namespace vrender ;
 using namespace std;
 
+//  Position of a primitive in the feedback buffer: its token, its number of
+// vertices, and the offset of its first vertex. The index of all primitives is
+// built by a first walk through the tokens, after which the vertices can be
+// processed in any order, and in parallel.
+
+struct FeedbackToken
+{
+	size_t offset ;
+	int token ;
+	int nb_vertices ;
+} ;
+
+struct ParserStats
+{
+	ParserStats()
+		: nb_lines(0), nb_polys(0), nb_points(0),
+		  nb_degenerated_lines(0), nb_degenerated_polys(0), nb_degenerated_points(0) {}
+
+	int nb_lines ;
+	int nb_polys ;
+	int nb_points ;
+	int nb_degenerated_lines ;
+	int nb_degenerated_polys ;
+	int nb_degenerated_points ;
+} ;
+
 class ParserUtils
 {
 	public:
-		static void NormalizeBufferCoordinates(GLint size, GLfloat * buffer, GLfloat MaxSize, GLfloat& zmin, GLfloat& zmax) ;
+		static void IndexBuffer(GLint size, const GLfloat * buffer, std::vector<FeedbackToken>& index) ;
+
+		static void NormalizeBufferCoordinates(GLfloat * buffer, const std::vector<FeedbackToken>& index, GLfloat MaxSize, GLfloat& zmin, GLfloat& zmax) ;
 
 		static PtrPrimitive checkPoint(Point *& P);
 		static PtrPrimitive checkSegment(Segment *& P);
 		static PtrPrimitive checkPolygon(Polygone *& P);
 
-		static void ComputeBufferBB(GLint size, GLfloat * buffer,
+		static void ComputeBufferBB(const GLfloat * buffer, const std::vector<FeedbackToken>& index,
 				GLfloat & xmin, GLfloat & xmax,
 				GLfloat & ymin, GLfloat & ymax,
 				GLfloat & zmin, GLfloat & zmax) ;
 
+		//  Kernels applied to the n primitives starting at tokens, by ParserRangeTask.
+		static void ComputeRangeBB(const GLfloat * buffer, const FeedbackToken *tokens, size_t n, GLfloat bb[6]) ;
+		static void NormalizeRange(GLfloat * buffer, const FeedbackToken *tokens, size_t n, GLfloat MaxSize, GLfloat zmin, GLfloat zmax) ;
+		static void ParseRange(const GLfloat * buffer, const FeedbackToken *tokens, size_t n, PtrPrimitive *output, ParserStats& stats) ;
+
 	private:
 		static void print3DcolorVertex(GLint size, GLint * count, GLfloat * buffer) ;
 		static void debug_printBuffer(GLint size, GLfloat *buffer) ;
 
-		static void NormalizePrimitiveCoordinates(GLfloat * & loc,GLfloat MaxSize,GLfloat zmin,GLfloat zmax) ;
-		static void ComputePrimitiveBB(	GLfloat * & loc,
-				GLfloat & xmin,GLfloat & xmax,
-				GLfloat & ymin,GLfloat & ymax,
-				GLfloat & zmin,GLfloat & zmax);
-
 		static const char *nameOfToken(int token);
 
 		static const double EGALITY_EPS ;
@@ -83,12 +118,162 @@ class ParserUtils
 
 const double ParserUtils::EGALITY_EPS = 0.00001 ;
 
+// Number of primitives parsed before they are written to the stream, when streaming.
+static const size_t STREAM_CHUNK_SIZE = 65536 ;
+
+// Minimum number of primitives processed by one ParserRangeTask.
+static const size_t PARSER_RANGE_SIZE = 8192 ;
+
+//  Applies one pass of the parser to the primitives [begin,end) of the token
+// index. Tasks are not deleted by the thread pool: their result is read once
+// wait() returns.
+
+class ParserRangeTask: public QRunnable
+{
+	public:
+		enum Pass { BOUNDING_BOX, NORMALIZATION, PARSING } ;
+
+		ParserRangeTask(Pass pass,GLfloat *buffer,const vector<FeedbackToken>& index,size_t begin,size_t end)
+			: _pass(pass), _buffer(buffer), _index(index), _begin(begin), _end(end), _output(NULL),
+			  _max_size(0.0f), _zmin(0.0f), _zmax(0.0f)
+		{
+			setAutoDelete(false) ;
+
+			_bb[0] = _bb[2] = _bb[4] = FLT_MAX ;
+			_bb[1] = _bb[3] = _bb[5] = -FLT_MAX ;
+		}
+
+		//  Splits [begin,end) into a few ranges per thread, of at least
+		// PARSER_RANGE_SIZE primitives each.
+		static void split(Pass,GLfloat *,const vector<FeedbackToken>&,size_t begin,size_t end,vector<ParserRangeTask *>& tasks) ;
+
+		//  Runs all the tasks in the thread pool, and waits for them.
+		static void runAll(vector<ParserRangeTask *>& tasks) ;
+
+		inline size_t begin() const { return _begin ; }
+		inline size_t end() const { return _end ; }
+
+		void setOutput(PtrPrimitive *output) { _output = output ; }
+		void setNormalization(GLfloat MaxSize,GLfloat zmin,GLfloat zmax) { _max_size = MaxSize ; _zmin = zmin ; _zmax = zmax ; }
+
+		// xmin, xmax, ymin, ymax, zmin, zmax.
+		inline const GLfloat *boundingBox() const { return _bb ; }
+		inline const ParserStats& stats() const { return _stats ; }
+
+		void wait() { _done.acquire() ; }
+
+		virtual void run()
+		{
+			if(_begin < _end)
+				switch(_pass)
+			{
+					case BOUNDING_BOX:
+						ParserUtils::ComputeRangeBB(_buffer,&_index[_begin],_end-_begin,_bb) ;
+						break ;
+					case NORMALIZATION:
+						ParserUtils::NormalizeRange(_buffer,&_index[_begin],_end-_begin,_max_size,_zmin,_zmax) ;
+						break ;
+					case PARSING:
+						ParserUtils::ParseRange(_buffer,&_index[_begin],_end-_begin,_output,_stats) ;
+						break ;
+				}
+
+			_done.release() ;
+		}
+
+	private:
+		Pass _pass ;
+		GLfloat *_buffer ;
+		const vector<FeedbackToken>& _index ;
+		size_t _begin ;
+		size_t _end ;
+
+		PtrPrimitive *_output ;
+		GLfloat _max_size ;
+		GLfloat _zmin ;
+		GLfloat _zmax ;
+
+		GLfloat _bb[6] ;
+		ParserStats _stats ;
+
+		QSemaphore _done ;
+};
+
+void ParserRangeTask::split(Pass pass,GLfloat *buffer,const vector<FeedbackToken>& index,size_t begin,size_t end,vector<ParserRangeTask *>& tasks)
+{
+	size_t nb_ranges = 4*(size_t)max(1,QThread::idealThreadCount()) ;
+	nb_ranges = max((size_t)1,min(nb_ranges,(end-begin)/PARSER_RANGE_SIZE)) ;
+
+	for(size_t i=0;i<nb_ranges;++i)
+		tasks.push_back(new ParserRangeTask(pass,buffer,index,begin + (end-begin)*i/nb_ranges,begin + (end-begin)*(i+1)/nb_ranges)) ;
+}
+
+void ParserRangeTask::runAll(vector<ParserRangeTask *>& tasks)
+{
+	for(size_t i=0;i<tasks.size();++i)
+		QThreadPool::globalInstance()->start(tasks[i]) ;
+
+	for(size_t i=0;i<tasks.size();++i)
+		tasks[i]->wait() ;
+}
+
 void ParserGL::parseFeedbackBuffer(	GLfloat *buffer,int size,
 												std::vector<PtrPrimitive>& primitive_tab,
 												VRenderParams& vparams)
 {
-	int token;
-	int nvertices = 0 ;
+	parseFeedbackBuffer(buffer,size,primitive_tab,NULL,vparams) ;
+}
+
+void ParserGL::parseFeedbackBuffer(	GLfloat *buffer,int size,
+												PrimitiveStream& stream,
+												VRenderParams& vparams)
+{
+	std::vector<PtrPrimitive> primitive_tab ;
+
+	try
+	{
+		parseFeedbackBuffer(buffer,size,primitive_tab,&stream,vparams) ;
+	}
+	catch(exception&)
+	{
+		for(size_t i=0;i<primitive_tab.size();++i)
+			delete primitive_tab[i] ;
+
+		throw ;
+	}
+}
+
+void ParserGL::parseCapture(	const PrimitiveCapture& capture,
+										std::vector<PtrPrimitive>& primitive_tab,
+										VRenderParams& vparams)
+{
+	parseCapture(capture,primitive_tab,NULL,vparams) ;
+}
+
+void ParserGL::parseCapture(	const PrimitiveCapture& capture,
+										PrimitiveStream& stream,
+										VRenderParams& vparams)
+{
+	std::vector<PtrPrimitive> primitive_tab ;
+
+	try
+	{
+		parseCapture(capture,primitive_tab,&stream,vparams) ;
+	}
+	catch(exception&)
+	{
+		for(size_t i=0;i<primitive_tab.size();++i)
+			delete primitive_tab[i] ;
+
+		throw ;
+	}
+}
+
+void ParserGL::parseFeedbackBuffer(	GLfloat *buffer,int size,
+												std::vector<PtrPrimitive>& primitive_tab,
+												PrimitiveStream *stream,
+												VRenderParams& vparams)
+{
 	nb_lines = 0 ;
 	nb_polys = 0 ;
 	nb_points = 0 ;
@@ -96,6 +281,12 @@ void ParserGL::parseFeedbackBuffer(	GLfloat *buffer,int size,
 	nb_degenerated_polys = 0 ;
 	nb_degenerated_points = 0 ;
 
+	//  The tokens are read once, sequentially. All the following passes work on
+	// the vertices of the index, in parallel.
+
+	vector<FeedbackToken> index ;
+	ParserUtils::IndexBuffer(size,buffer,index) ;
+
 	// pre-treatment of coordinates so as to get something more consistent
 
 	_xmin = FLT_MAX ;
@@ -105,35 +296,160 @@ void ParserGL::parseFeedbackBuffer(	GLfloat *buffer,int size,
 	_ymax = -FLT_MAX ;
 	_zmax = -FLT_MAX ;
 
-	ParserUtils::ComputeBufferBB(size, buffer, _xmin,_xmax,_ymin,_ymax,_zmin,_zmax) ;
+	ParserUtils::ComputeBufferBB(buffer,index,_xmin,_xmax,_ymin,_ymax,_zmin,_zmax) ;
 
 #ifdef DEBUGEPSRENDER
 	printf("Buffer bounding box: %f %f %f %f %f %f\n",xmin,xmax,ymin,ymax,zmin,zmax) ;
 #endif
 	float Zdepth = max(_ymax-_ymin,_xmax-_xmin) ;
-	ParserUtils::NormalizeBufferCoordinates(size,buffer,Zdepth,_zmin,_zmax) ;
+	ParserUtils::NormalizeBufferCoordinates(buffer,index,Zdepth,_zmin,_zmax) ;
 
-	// now, read buffer
-	GLfloat *end = buffer + size;
+	if(stream != NULL)
+		stream->setDepthRange(_zmin,_zmax) ;
 
-	GLfloat *loc = buffer ;
-	int next_step = 0 ;
-	int N = size/200 + 1 ;
+	//  Now, create the primitives. Each token gives exactly one entry of
+	// primitive_tab (possibly NULL), so that ranges of the index are parsed in
+	// parallel directly into their place. When streaming, this is done by
+	// chunks which are written to the stream in turn.
 
-	while (loc < end)
+	size_t batch_size = (stream != NULL)?STREAM_CHUNK_SIZE:max(index.size(),(size_t)1) ;
+
+	for(size_t batch=0;batch<index.size();batch+=batch_size)
 	{
-		token = int(0.5f + *loc) ;
-		loc++;
+		size_t batch_end = min(batch + batch_size,index.size()) ;
+		size_t first = primitive_tab.size() ;
 
-		if((end-loc)/N >= next_step)
-			vparams.progress((end-loc)/(float)size, QGLViewer::tr("Parsing feedback buffer.")), ++next_step ;
+		primitive_tab.resize(first + batch_end - batch,(PtrPrimitive)NULL) ;
 
-		switch (token)
+		vector<ParserRangeTask *> tasks ;
+		ParserRangeTask::split(ParserRangeTask::PARSING,buffer,index,batch,batch_end,tasks) ;
+
+		for(size_t i=0;i<tasks.size();++i)
 		{
-			case GL_LINE_TOKEN:
-			case GL_LINE_RESET_TOKEN:
+			tasks[i]->setOutput(&primitive_tab[first + tasks[i]->begin() - batch]) ;
+			QThreadPool::globalInstance()->start(tasks[i]) ;
+		}
+
+		size_t t = 0 ;
+
+		try
+		{
+			for(;t<tasks.size();++t)
+			{
+				tasks[t]->wait() ;
+
+				nb_lines += tasks[t]->stats().nb_lines ;
+				nb_polys += tasks[t]->stats().nb_polys ;
+				nb_points += tasks[t]->stats().nb_points ;
+				nb_degenerated_lines += tasks[t]->stats().nb_degenerated_lines ;
+				nb_degenerated_polys += tasks[t]->stats().nb_degenerated_polys ;
+				nb_degenerated_points += tasks[t]->stats().nb_degenerated_points ;
+
+				size_t parsed = tasks[t]->end() ;
+
+				delete tasks[t] ;
+				tasks[t] = NULL ;
+
+				vparams.progress(parsed/(float)index.size(), QGLViewer::tr("Parsing feedback buffer.")) ;
+			}
+		}
+		catch(exception&)
+		{
+			//  The render was cancelled: ranges still being parsed are waited for,
+			// since they write into primitive_tab.
+
+			for(;t<tasks.size();++t)
+				if(tasks[t] != NULL)
+				{
+					tasks[t]->wait() ;
+					delete tasks[t] ;
+				}
+
+			throw ;
+		}
+
+		if(stream != NULL)
+			stream->append(primitive_tab) ;
+	}
+}
+
+void ParserGL::parseCapture(	const PrimitiveCapture& capture,
+										std::vector<PtrPrimitive>& primitive_tab,
+										PrimitiveStream *stream,
+										VRenderParams& vparams)
+{
+	nb_lines = 0 ;
+	nb_polys = 0 ;
+	nb_points = 0 ;
+	nb_degenerated_lines = 0 ;
+	nb_degenerated_polys = 0 ;
+	nb_degenerated_points = 0 ;
+
+	const std::vector<GLfloat>& vertices = capture.vertices() ;
+	const size_t size = PrimitiveCapture::sizeInBuffer() ;
+	const size_t nb_vertices = vertices.size() / size ;
+
+	// Bounding box. No tokens here: all vertices are contiguous.
+
+	_xmin = FLT_MAX ;
+	_ymin = FLT_MAX ;
+	_zmin = FLT_MAX ;
+	_xmax = -FLT_MAX ;
+	_ymax = -FLT_MAX ;
+	_zmax = -FLT_MAX ;
+
+	for(size_t i=0;i<nb_vertices;++i)
+	{
+		const GLfloat *v = &vertices[i*size] ;
+
+		_xmin = min(_xmin,v[0]) ; _xmax = max(_xmax,v[0]) ;
+		_ymin = min(_ymin,v[1]) ; _ymax = max(_ymax,v[1]) ;
+		_zmin = min(_zmin,v[2]) ; _zmax = max(_zmax,v[2]) ;
+	}
+
+	// Same z normalization as ParserUtils::NormalizeBufferCoordinates, done on
+	// the fly since the capture is not modified.
+
+	float Zdepth = max(_ymax-_ymin,_xmax-_xmin) ;
+	bool normalize = (_zmax != _zmin) ;
+	GLfloat zmin = _zmin ;
+	GLfloat zscale = normalize?(Zdepth/(_zmax-_zmin)):1.0f ;
+
+	if(normalize)
+	{
+		_zmin = 0.0 ;
+		_zmax = Zdepth ;
+	}
+
+	if(stream != NULL)
+		stream->setDepthRange(_zmin,_zmax) ;
+	else
+		primitive_tab.reserve(primitive_tab.size() + capture.nbPrimitives()) ;
+
+	GLfloat verts[3][7] ;
+	size_t offset = 0 ;
+	size_t N = capture.nbPrimitives()/200 + 1 ;
+
+	for(size_t i=0;i<capture.nbPrimitives();++i)
+	{
+		if(i%N == 0)
+			vparams.progress(i/(float)capture.nbPrimitives(), QGLViewer::tr("Parsing captured primitives.")) ;
+
+		int n = capture.type(i) ;
+
+		for(int j=0;j<n;++j,offset+=size)
+		{
+			memcpy(verts[j],&vertices[offset],size*sizeof(GLfloat)) ;
+
+			if(normalize)
+				verts[j][2] = (verts[j][2] - zmin)*zscale ;
+		}
+
+		switch(n)
+		{
+			case PrimitiveCapture::SEGMENT:
 				{
-					Segment *S = new Segment(Feedback3DColor(loc),Feedback3DColor(loc+Feedback3DColor::sizeInBuffer())) ;
+					Segment *S = new Segment(Feedback3DColor(verts[0]),Feedback3DColor(verts[1])) ;
 
 					primitive_tab.push_back(ParserUtils::checkSegment(S)) ;
 
@@ -141,21 +457,18 @@ void ParserGL::parseFeedbackBuffer(	GLfloat *buffer,int size,
 						nb_degenerated_lines++ ;
 
 					nb_lines++ ;
-					loc += 2*Feedback3DColor::sizeInBuffer();
 				}
-				break;
+				break ;
 
-			case GL_POLYGON_TOKEN:
+			case PrimitiveCapture::TRIANGLE:
 				{
-					nvertices = int(0.5f + *loc) ;
-					loc++;
-
-					std::vector<Feedback3DColor> verts ;
+					std::vector<Feedback3DColor> tverts ;
+					tverts.reserve(3) ;
 
-					for(int i=0;i<nvertices;++i)
-						verts.push_back(Feedback3DColor(loc)),loc+=Feedback3DColor::sizeInBuffer() ;
+					for(int j=0;j<3;++j)
+						tverts.push_back(Feedback3DColor(verts[j])) ;
 
-					Polygone *P = new Polygone(verts) ;
+					Polygone *P = new Polygone(tverts) ;
 
 					primitive_tab.push_back(ParserUtils::checkPolygon(P)) ;
 
@@ -166,24 +479,18 @@ void ParserGL::parseFeedbackBuffer(	GLfloat *buffer,int size,
 				}
 				break ;
 
-			case GL_POINT_TOKEN:
-				{
-					Point *Pt = new Point(Feedback3DColor(loc)) ;
-
-					primitive_tab.push_back(Pt);//ParserUtils::checkPoint(Pt)) ;
-
-					if(Pt == NULL)
-						nb_degenerated_points++ ;
-
-					nb_points++ ;
-					loc += Feedback3DColor::sizeInBuffer();
-				}
-				break;
-			default:
-				break;
+			case PrimitiveCapture::POINT:
+				primitive_tab.push_back(new Point(Feedback3DColor(verts[0]))) ;
+				nb_points++ ;
+				break ;
 		}
+
+		if(stream != NULL && primitive_tab.size() >= STREAM_CHUNK_SIZE)
+			stream->append(primitive_tab) ;
 	}
 
+	if(stream != NULL)
+		stream->append(primitive_tab) ;
 }
 
 // Traitement des cas degeneres. Renvoie false si le polygone est degenere.
@@ -299,132 +606,167 @@ void ParserUtils::debug_printBuffer(GLint size, GLfloat * buffer)
 	}
 }
 
-void ParserUtils::NormalizePrimitiveCoordinates(GLfloat * & loc,GLfloat MaxSize,GLfloat zmin,GLfloat zmax)
+//  Records the position of each point, segment and polygon of the buffer.
+// Other tokens are skipped, and so is a primitive cut by the end of the buffer.
+
+void ParserUtils::IndexBuffer(GLint size, const GLfloat * buffer, vector<FeedbackToken>& index)
 {
-	int token;
-	int nvertices, i;
+	const size_t vsize = Feedback3DColor::sizeInBuffer() ;
+	const size_t end = (size_t)max(size,0) ;
+	size_t loc = 0 ;
 
-	token = int(*loc) ;
-	loc++;
-	int size = Feedback3DColor::sizeInBuffer() ;
+	// Mostly triangles: token, number of vertices, and 3 vertices each.
+	index.reserve(end/(2+3*vsize) + 1) ;
 
-	switch (token)
+	while (loc < end)
 	{
-		case GL_LINE_RESET_TOKEN:
-		case GL_LINE_TOKEN:
-			{
-				for (i = 0; i < 2; i++)
-					(loc+size*i)[2] = ((loc+size*i)[2] - zmin)/(zmax-zmin)*MaxSize ;
+		FeedbackToken t ;
+		t.token = int(0.5f + buffer[loc]) ;
+		loc++;
 
-				loc += 2*size;          /* Each vertex element in the feedback buffer is size GLfloats. */
-				break;
-			}
-		case GL_POLYGON_TOKEN:
-			{
-				nvertices = int(*loc) ;
+		switch (t.token)
+		{
+			case GL_LINE_TOKEN:
+			case GL_LINE_RESET_TOKEN:
+				t.nb_vertices = 2 ;
+				break ;
+
+			case GL_POLYGON_TOKEN:
+				if(loc >= end)
+					return ;
+
+				t.nb_vertices = max(0,int(0.5f + buffer[loc])) ;
 				loc++;
+				break ;
 
-				for (i = 0; i < nvertices; i++)
-					(loc+size*i)[2] = ((loc+size*i)[2] - zmin)/(zmax-zmin)*MaxSize ;
+			case GL_POINT_TOKEN:
+				t.nb_vertices = 1 ;
+				break ;
 
-				loc += nvertices * size;  /* Each vertex element in the feedback buffer is size GLfloats. */
-				break;
-			}
-		case GL_POINT_TOKEN:
-			{
-				loc[2] = (loc[2] - zmin)/(zmax-zmin)*MaxSize ;
+			case GL_PASS_THROUGH_TOKEN:
+				loc++;
+				continue ;
 
-				loc += size;           /* Each vertex element in the feedback buffer is size GLfloats. */
-				break;
-			}
-		default:
-			/* XXX Left as an excersie to the reader. */
+			case GL_BITMAP_TOKEN:
+			case GL_DRAW_PIXEL_TOKEN:
+			case GL_COPY_PIXEL_TOKEN:
+				loc += vsize ;
+				continue ;
+
+			default:
 #ifdef DEBUGEPSRENDER
-			printf("%s (%d) not handled yet. Sorry.\n", ParserUtils::nameOfToken(token), token);
+				printf("%s (%d) not handled yet. Sorry.\n", ParserUtils::nameOfToken(t.token), t.token);
 #endif
-			;
+				continue ;
+		}
+
+		t.offset = loc ;
+		loc += t.nb_vertices*vsize ;
+
+		if(loc > end)
+			return ;
+
+		index.push_back(t) ;
 	}
 }
 
-void ParserUtils::ComputePrimitiveBB(GLfloat * & loc,GLfloat & xmin,GLfloat & xmax,GLfloat & ymin,GLfloat & ymax, GLfloat & zmin,GLfloat & zmax)
+//  The vertices of a range of primitives are contiguous, apart from the tokens
+// in between. The kernels below go through them with branch free min/max and
+// arithmetic, and are run in parallel on ranges of the index.
+
+void ParserUtils::ComputeRangeBB(const GLfloat * buffer, const FeedbackToken *tokens, size_t n, GLfloat bb[6])
 {
-	int token;
-	int nvertices, i;
+	const size_t size = Feedback3DColor::sizeInBuffer() ;
 
-	token = int(*loc) ;
-	loc++;
-	int size = Feedback3DColor::sizeInBuffer() ;
+	GLfloat xmin = bb[0], xmax = bb[1] ;
+	GLfloat ymin = bb[2], ymax = bb[3] ;
+	GLfloat zmin = bb[4], zmax = bb[5] ;
 
-	switch (token)
+	for(size_t i=0;i<n;++i)
 	{
-		case GL_LINE_RESET_TOKEN:
-		case GL_LINE_TOKEN:
-			{
-				for (i = 0; i < 2; i++)
+		const GLfloat *v = buffer + tokens[i].offset ;
+		const GLfloat *end = v + tokens[i].nb_vertices*size ;
+
+		for(;v<end;v+=size)
+		{
+			xmin = min(xmin,v[0]) ; xmax = max(xmax,v[0]) ;
+			ymin = min(ymin,v[1]) ; ymax = max(ymax,v[1]) ;
+			zmin = min(zmin,v[2]) ; zmax = max(zmax,v[2]) ;
+		}
+	}
+
+	bb[0] = xmin ; bb[1] = xmax ;
+	bb[2] = ymin ; bb[3] = ymax ;
+	bb[4] = zmin ; bb[5] = zmax ;
+}
+
+void ParserUtils::NormalizeRange(GLfloat * buffer, const FeedbackToken *tokens, size_t n, GLfloat MaxSize, GLfloat zmin, GLfloat zmax)
+{
+	const size_t size = Feedback3DColor::sizeInBuffer() ;
+
+	for(size_t i=0;i<n;++i)
+	{
+		GLfloat *v = buffer + tokens[i].offset ;
+		GLfloat *end = v + tokens[i].nb_vertices*size ;
+
+		for(;v<end;v+=size)
+			v[2] = (v[2] - zmin)/(zmax-zmin)*MaxSize ;
+	}
+}
+
+void ParserUtils::ParseRange(const GLfloat * buffer, const FeedbackToken *tokens, size_t n, PtrPrimitive *output, ParserStats& stats)
+{
+	const size_t size = Feedback3DColor::sizeInBuffer() ;
+	std::vector<Feedback3DColor> verts ;
+
+	for(size_t i=0;i<n;++i)
+	{
+		const GLfloat *loc = buffer + tokens[i].offset ;
+
+		switch (tokens[i].token)
+		{
+			case GL_LINE_TOKEN:
+			case GL_LINE_RESET_TOKEN:
 				{
-					Feedback3DColor f(loc+size*i) ;
-
-					if(f.x() < xmin) xmin = GLfloat(f.x()) ;
-					if(f.y() < ymin) ymin = GLfloat(f.y()) ;
-					if(f.z() < zmin) zmin = GLfloat(f.z()) ;
-					if(f.x() > xmax) xmax = GLfloat(f.x()) ;
-					if(f.y() > ymax) ymax = GLfloat(f.y()) ;
-					if(f.z() > zmax) zmax = GLfloat(f.z()) ;
-				}
+					Segment *S = new Segment(Feedback3DColor(loc),Feedback3DColor(loc+size)) ;
+
+					output[i] = checkSegment(S) ;
 
-				loc += 2*size;          /* Each vertex element in the feedback
-													buffer is size GLfloats. */
+					if(S == NULL)
+						stats.nb_degenerated_lines++ ;
+
+					stats.nb_lines++ ;
+				}
 				break;
-			}
-		case GL_POLYGON_TOKEN:
-			{
-				nvertices = int(*loc) ;
-				loc++;
 
-				for (i = 0; i < nvertices; i++)
+			case GL_POLYGON_TOKEN:
 				{
-					Feedback3DColor f(loc+size*i) ;
-
-					if(f.x() < xmin) xmin = GLfloat(f.x()) ;
-					if(f.y() < ymin) ymin = GLfloat(f.y()) ;
-					if(f.z() < zmin) zmin = GLfloat(f.z()) ;
-					if(f.x() > xmax) xmax = GLfloat(f.x()) ;
-					if(f.y() > ymax) ymax = GLfloat(f.y()) ;
-					if(f.z() > zmax) zmax = GLfloat(f.z()) ;
-				}
+					verts.clear() ;
 
-				loc += nvertices * size;  /* Each vertex element in the
-													  feedback buffer is size GLfloats. */
-				break;
-			}
-		case GL_POINT_TOKEN:
-			{
-				Feedback3DColor f(loc) ;
+					for(int j=0;j<tokens[i].nb_vertices;++j)
+						verts.push_back(Feedback3DColor(loc)),loc+=size ;
 
-				if(f.x() < xmin) xmin = GLfloat(f.x()) ;
-				if(f.y() < ymin) ymin = GLfloat(f.y()) ;
-				if(f.z() < zmin) zmin = GLfloat(f.z()) ;
-				if(f.x() > xmax) xmax = GLfloat(f.x()) ;
-				if(f.y() > ymax) ymax = GLfloat(f.y()) ;
-				if(f.z() > zmax) zmax = GLfloat(f.z()) ;
+					Polygone *P = new Polygone(verts) ;
+
+					output[i] = checkPolygon(P) ;
+
+					if(P == NULL)
+						stats.nb_degenerated_polys++ ;
+
+					stats.nb_polys++ ;
+				}
+				break ;
 
-				loc += size;           /* Each vertex element in the feedback
-												  buffer is size GLfloats. */
+			case GL_POINT_TOKEN:
+				output[i] = new Point(Feedback3DColor(loc)) ;
+				stats.nb_points++ ;
 				break;
-			}
-		default:
-			/* XXX Left as an excersie to the reader. */
-#ifdef DEBUGEPSRENDER
-			printf("Incomplete implementation.  Unexpected token (%d).\n", token);
-#endif
-			;
+		}
 	}
 }
 
-void ParserUtils::NormalizeBufferCoordinates(GLint size, GLfloat * buffer, GLfloat MaxSize, GLfloat& zmin,GLfloat& zmax)
+void ParserUtils::NormalizeBufferCoordinates(GLfloat * buffer, const vector<FeedbackToken>& index, GLfloat MaxSize, GLfloat& zmin,GLfloat& zmax)
 {
-	GLfloat *loc, *end;
-
 	if(zmax == zmin)
 	{
 #ifdef DEBUGEPSRENDER
@@ -433,28 +775,41 @@ void ParserUtils::NormalizeBufferCoordinates(GLint size, GLfloat * buffer, GLflo
 		return ;
 	}
 
-	loc = buffer;
-	end = buffer + size;
+	vector<ParserRangeTask *> tasks ;
+	ParserRangeTask::split(ParserRangeTask::NORMALIZATION,buffer,index,0,index.size(),tasks) ;
 
-	while (loc < end)
-		NormalizePrimitiveCoordinates(loc,MaxSize,zmin,zmax);
+	for(size_t i=0;i<tasks.size();++i)
+		tasks[i]->setNormalization(MaxSize,zmin,zmax) ;
+
+	ParserRangeTask::runAll(tasks) ;
+
+	for(size_t i=0;i<tasks.size();++i)
+		delete tasks[i] ;
 
 	zmin = 0.0 ;
 	zmax = MaxSize ;
 }
 
-void ParserUtils::ComputeBufferBB(GLint size, GLfloat * buffer,
+void ParserUtils::ComputeBufferBB(const GLfloat * buffer, const vector<FeedbackToken>& index,
 		     GLfloat & xmin, GLfloat & xmax,
 		     GLfloat & ymin, GLfloat & ymax,
 		     GLfloat & zmin, GLfloat & zmax)
 {
-	GLfloat *loc, *end;
+	vector<ParserRangeTask *> tasks ;
+	ParserRangeTask::split(ParserRangeTask::BOUNDING_BOX,const_cast<GLfloat *>(buffer),index,0,index.size(),tasks) ;
 
-	loc = buffer;
-	end = buffer + size;
+	ParserRangeTask::runAll(tasks) ;
 
-	while (loc < end)
-		ComputePrimitiveBB(loc,xmin,xmax,ymin,ymax,zmin,zmax);
+	for(size_t i=0;i<tasks.size();++i)
+	{
+		const GLfloat *bb = tasks[i]->boundingBox() ;
+
+		xmin = min(xmin,bb[0]) ; xmax = max(xmax,bb[1]) ;
+		ymin = min(ymin,bb[2]) ; ymax = max(ymax,bb[3]) ;
+		zmin = min(zmin,bb[4]) ; zmax = max(zmax,bb[5]) ;
+
+		delete tasks[i] ;
+	}
 }
 
 typedef struct _DepthIndex {
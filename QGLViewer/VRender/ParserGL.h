@@ -53,6 +53,9 @@
 
 namespace vrender
 {
+	class PrimitiveCapture ;
+	class PrimitiveStream ;
+
 	class ParserGL
 	{
 		public:
@@ -60,6 +63,24 @@ namespace vrender
 												int size,
 												std::vector<PtrPrimitive>& primitive_tab,
 												VRenderParams& vparams) ;
+
+			//  Same as parseFeedbackBuffer, from primitives directly pushed in a
+			// PrimitiveCapture. The capture is left unchanged.
+			void parseCapture(	const PrimitiveCapture& capture,
+									std::vector<PtrPrimitive>& primitive_tab,
+									VRenderParams& vparams) ;
+
+			//  Streaming versions of the above: primitives are written to the
+			// stream by chunks as they are parsed, instead of being all kept in
+			// memory.
+			void parseFeedbackBuffer(	GLfloat *,
+												int size,
+												PrimitiveStream& stream,
+												VRenderParams& vparams) ;
+			void parseCapture(	const PrimitiveCapture& capture,
+									PrimitiveStream& stream,
+									VRenderParams& vparams) ;
+
 			void printStats() const ;
 
 			inline GLfloat xmin() const { return _xmin ; }
@@ -69,6 +90,9 @@ namespace vrender
 			inline GLfloat ymax() const { return _ymax ; }
 			inline GLfloat zmax() const { return _zmax ; }
 		private:
+			void parseFeedbackBuffer(GLfloat *,int,std::vector<PtrPrimitive>&,PrimitiveStream *,VRenderParams&) ;
+			void parseCapture(const PrimitiveCapture&,std::vector<PtrPrimitive>&,PrimitiveStream *,VRenderParams&) ;
+
 			int nb_lines ;
 			int nb_polys ;
 			int nb_points ;
@@ -44,15 +44,207 @@
 
 #include <math.h>
 #include <assert.h>
+#include <limits.h>
+#include <new>
+#include <QAtomicInt>
+#include <QMutex>
 #include "Primitive.h"
 #include "Types.h"
 
 using namespace vrender ;
 using namespace std ;
 
+#if __cplusplus >= 201103L
+#define POOL_THREAD_LOCAL   thread_local
+#elif defined(_MSC_VER)
+#define POOL_THREAD_LOCAL   __declspec(thread)
+#else
+#define POOL_THREAD_LOCAL   __thread
+#endif
+
+//  Pool allocator for primitives. Blocks are carved out of large chunks and
+// recycled through one free list per block size. Each thread has its own free
+// lists and its own current chunk, so that the parallel stages do not contend
+// on a lock: the mutex is only taken to get a new chunk. A block deleted by
+// another thread than the one that allocated it simply goes to the free list
+// of the deleting thread.
+//
+//  All the primitives of a render are deleted at its end, at which point the
+// chunks are given back to the system. The thread caches then refer to freed
+// memory: bumping _epoch tells each of them to start over.
+
+class PrimitivePool
+{
+	public:
+		static void *allocate(size_t size) ;
+		static void release(void *p,size_t size) ;
+
+	private:
+		struct FreeBlock { FreeBlock *next ; } ;
+
+		static const size_t GRANULARITY = 16 ;
+		static const size_t NB_SIZES    = 32 ;	// blocks up to 512 bytes
+		static const size_t CHUNK_SIZE  = 1 << 16 ;
+
+		// Value of _nb_allocated while the chunks are being released.
+		static const int RELEASING = INT_MIN/2 ;
+
+		struct ThreadCache
+		{
+			int epoch ;
+			FreeBlock *free_blocks[NB_SIZES+1] ;
+			char *chunk_free ;
+			char *chunk_end ;
+		} ;
+
+		static ThreadCache& threadCache() ;
+		static void unreference() ;
+
+		static POOL_THREAD_LOCAL ThreadCache _cache ;
+
+		static std::vector<char *> _chunks ;
+		static QMutex _mutex ;
+		static QAtomicInt _nb_allocated ;
+		static QAtomicInt _epoch ;
+} ;
+
+POOL_THREAD_LOCAL PrimitivePool::ThreadCache PrimitivePool::_cache ;
+std::vector<char *> PrimitivePool::_chunks ;
+QMutex PrimitivePool::_mutex ;
+QAtomicInt PrimitivePool::_nb_allocated(0) ;
+QAtomicInt PrimitivePool::_epoch(1) ;
+
+PrimitivePool::ThreadCache& PrimitivePool::threadCache()
+{
+	ThreadCache& cache = _cache ;
+#if QT_VERSION >= 0x050000
+	int epoch = _epoch.loadAcquire() ;
+#else
+	int epoch = _epoch ;
+#endif
+
+	if(cache.epoch != epoch)
+	{
+		for(size_t i=0;i<=NB_SIZES;++i)
+			cache.free_blocks[i] = NULL ;
+
+		cache.chunk_free = NULL ;
+		cache.chunk_end = NULL ;
+		cache.epoch = epoch ;
+	}
+
+	return cache ;
+}
+
+void *PrimitivePool::allocate(size_t size)
+{
+	size_t indx = (size + GRANULARITY - 1)/GRANULARITY ;
+
+	if(indx > NB_SIZES)
+		return ::operator new(size) ;
+
+	if(_nb_allocated.fetchAndAddOrdered(1) < 0)
+	{
+		// Another thread is releasing the chunks. Wait until it is done.
+		QMutexLocker locker(&_mutex) ;
+	}
+
+	ThreadCache& cache = threadCache() ;
+	FreeBlock *block = cache.free_blocks[indx] ;
+
+	if(block != NULL)
+	{
+		cache.free_blocks[indx] = block->next ;
+		return block ;
+	}
+
+	size_t block_size = indx*GRANULARITY ;
+
+	if(cache.chunk_free + block_size > cache.chunk_end)
+	{
+		QMutexLocker locker(&_mutex) ;
+		char *chunk = NULL ;
+
+		try
+		{
+			chunk = static_cast<char *>(::operator new(CHUNK_SIZE)) ;
+			_chunks.push_back(chunk) ;
+		}
+		catch(std::bad_alloc&)
+		{
+			::operator delete(chunk) ;
+			locker.unlock() ;
+			unreference() ;
+			throw ;
+		}
+
+		cache.chunk_free = chunk ;
+		cache.chunk_end = chunk + CHUNK_SIZE ;
+	}
+
+	void *p = cache.chunk_free ;
+	cache.chunk_free += block_size ;
+
+	return p ;
+}
+
+void PrimitivePool::release(void *p,size_t size)
+{
+	if(p == NULL)
+		return ;
+
+	size_t indx = (size + GRANULARITY - 1)/GRANULARITY ;
+
+	if(indx > NB_SIZES)
+	{
+		::operator delete(p) ;
+		return ;
+	}
+
+	ThreadCache& cache = threadCache() ;
+
+	FreeBlock *block = static_cast<FreeBlock *>(p) ;
+	block->next = cache.free_blocks[indx] ;
+	cache.free_blocks[indx] = block ;
+
+	unreference() ;
+}
+
+void PrimitivePool::unreference()
+{
+	if(_nb_allocated.fetchAndAddOrdered(-1) != 1)
+		return ;
+
+	// Last primitive deleted. Give everything back, unless another thread
+	// allocated a new one in the meantime.
+
+	QMutexLocker locker(&_mutex) ;
+
+	if(!_nb_allocated.testAndSetOrdered(0,RELEASING))
+		return ;
+
+	for(size_t i=0;i<_chunks.size();++i)
+		::operator delete(_chunks[i]) ;
+
+	_chunks.clear() ;
+
+	_epoch.fetchAndAddOrdered(1) ;
+	_nb_allocated.fetchAndAddOrdered(-RELEASING) ;
+}
+
+void *Primitive::operator new(size_t size)
+{
+	return PrimitivePool::allocate(size) ;
+}
+
+void Primitive::operator delete(void *p,size_t size)
+{
+	PrimitivePool::release(p,size) ;
+}
+
 
 Point::Point(const Feedback3DColor& f)
-	: _position_and_color(f)
+	: Primitive(POINT), _position_and_color(f)
 {
 }
 
@@ -101,14 +293,44 @@ const Vector3& Polygone::vertex(size_t i) const
 
 
 Polygone::Polygone(const vector<Feedback3DColor>& fc)
-	: _vertices(fc)
+	: Primitive(POLYGON)
+{
+	init(fc.empty()?NULL:&fc[0],fc.size()) ;
+}
+
+Polygone::Polygone(const Feedback3DColor *fc,size_t n)
+	: Primitive(POLYGON)
+{
+	init(fc,n) ;
+}
+
+void Polygone::init(const Feedback3DColor *fc,size_t n)
 {
+	_nb_vertices = n ;
+
+	if(n <= NB_INLINE_VERTICES)
+		_vertices = reinterpret_cast<Feedback3DColor *>(_inline_vertices) ;
+	else
+		_vertices = static_cast<Feedback3DColor *>(::operator new(n*sizeof(Feedback3DColor))) ;
+
+	for(size_t i=0;i<n;i++)
+		new(_vertices+i) Feedback3DColor(fc[i]) ;
+
 	initNormal() ;
 
-	for(size_t i=0;i<fc.size();i++)
+	for(size_t i=0;i<n;i++)
 		_bbox.include(fc[i].pos()) ;
 }
 
+Polygone::~Polygone()
+{
+	for(size_t i=0;i<_nb_vertices;i++)
+		_vertices[i].~Feedback3DColor() ;
+
+	if(_vertices != reinterpret_cast<Feedback3DColor *>(_inline_vertices))
+		::operator delete(_vertices) ;
+}
+
 AxisAlignedBox_xyz Polygone::bbox() const
 {
 	return _bbox ;
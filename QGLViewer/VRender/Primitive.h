@@ -74,7 +74,7 @@ namespace vrender
 	class Feedback3DColor
 	{
 	public:
-		Feedback3DColor(GLfloat *loc)
+		Feedback3DColor(const GLfloat *loc)
 			: 	_pos(loc[0],loc[1],loc[2]),
 			_red(loc[3]),_green(loc[4]),_blue(loc[5]),_alpha(loc[6]) {}
 
@@ -103,6 +103,7 @@ namespace vrender
 		static size_t sizeInBuffer() { return 7 ; }
 
 		friend std::ostream& operator<<(std::ostream&,const Feedback3DColor&) ;
+		friend class PrimitiveFile ;
 
 		protected:
 		Feedback3DColor(FLOAT x, FLOAT y, FLOAT z, GLfloat r, GLfloat g, GLfloat b, GLfloat a)
@@ -117,11 +118,23 @@ namespace vrender
 
 	// A primitive is an entity
 	//
+	//  Primitives carry an explicit type tag, so that sorting methods, optimizers
+	// and exporters can dispatch on it with a static_cast instead of RTTI. They
+	// are also allocated from a pool (see Primitive.cpp), since millions of them
+	// are created and deleted for a single render.
+	//
 	class Primitive
 	{
 	public:
+		enum PrimitiveType { POINT, SEGMENT, POLYGON } ;
+
 		virtual ~Primitive() {}
 
+		inline PrimitiveType type() const { return _type ; }
+
+		static void *operator new(size_t) ;
+		static void operator delete(void *,size_t) ;
+
 
 		virtual const Feedback3DColor& sommet3DColor(size_t) const =0 ;
 
@@ -143,7 +156,9 @@ namespace vrender
 		virtual size_t nbVertices() const = 0 ;
 
 		protected:
+		Primitive(PrimitiveType t) : _type(t) {}
 
+		PrimitiveType _type ;
 		int _vibility ;
 	} ;
 
@@ -165,7 +180,7 @@ namespace vrender
 	class Segment: public Primitive
 	{
 	public:
-		Segment(const Feedback3DColor & p1, const Feedback3DColor & p2): P1(p1), P2(p2) {}
+		Segment(const Feedback3DColor & p1, const Feedback3DColor & p2): Primitive(SEGMENT), P1(p1), P2(p2) {}
 		virtual ~Segment() {}
 		virtual size_t nbVertices() const { return 2 ; }
 		virtual const Vector3& vertex(size_t) const ;
@@ -185,7 +200,8 @@ namespace vrender
 	{
 	public:
 		Polygone(const std::vector<Feedback3DColor>&) ;
-		virtual ~Polygone() {}
+		Polygone(const Feedback3DColor *,size_t) ;
+		virtual ~Polygone() ;
 #ifdef A_FAIRE
 		virtual int IsAPolygon() { return 1 ; }
 		virtual void Split(const Vector3&,FLOAT,Primitive * &,Primitive * &) ;
@@ -193,8 +209,10 @@ namespace vrender
 #endif
 		virtual const Feedback3DColor& sommet3DColor(size_t) const ;
 		virtual const Vector3& vertex(size_t) const ;
-		virtual size_t nbVertices() const { return _vertices.size() ; }
+		virtual size_t nbVertices() const { return _nb_vertices ; }
 		virtual AxisAlignedBox_xyz bbox() const ;
+		// All vertices at once, without the virtual call and modulo of sommet3DColor().
+		const Feedback3DColor *sommets3DColor() const { return _vertices ; }
 		double equation(const Vector3& p) const ;
 		const NVector3& normal() const { return _normal ; }
 		double c() const { return _c ; }
@@ -206,13 +224,30 @@ namespace vrender
 		void CheckInfoForPositionOperators() ;
 
 		AxisAlignedBox_xyz _bbox ;
-		std::vector<Feedback3DColor> _vertices ;
+
+		//  Vertices are stored inside the polygon when there are few of them
+		// (which is by far the most common case), and on the heap otherwise.
+		static const size_t NB_INLINE_VERTICES = 4 ;
+
+		Feedback3DColor *_vertices ;
+		size_t _nb_vertices ;
+		union
+		{
+			char _inline_vertices[NB_INLINE_VERTICES*sizeof(Feedback3DColor)] ;
+			double _inline_alignment ;
+		} ;
 		// std::vector<FLOAT> _sommetsProjetes ;
 		// Vector3 N,M,L ;
 		double anglefactor ;		//  Determine a quel point un polygone est plat.
 		// Comparer a FLAT_POLYGON_EPS
 		double _c ;
 		NVector3 _normal ;
+
+		private:
+		void init(const Feedback3DColor *,size_t) ;
+
+		Polygone(const Polygone&) ;
+		Polygone& operator=(const Polygone&) ;
 	} ;
 }
 #endif
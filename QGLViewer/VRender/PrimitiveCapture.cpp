@@ -0,0 +1,301 @@
+/*
+ This file is part of the VRender library.
+ Copyright (C) 2005 Cyril Soler (Cyril.Soler@imag.fr)
+ Version 1.0.0, released on June 27, 2005.
+
+ http://artis.imag.fr/Members/Cyril.Soler/VRender
+
+ VRender is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 2 of the License, or
+ (at your option) any later version.
+
+ VRender is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with VRender; if not, write to the Free Software Foundation, Inc.,
+ 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+/****************************************************************************
+
+ Copyright (C) 2002-2014 Gilles Debunne. All rights reserved.
+
+ This file is part of the QGLViewer library version 2.6.3.
+
+ http://www.libqglviewer.com - contact@libqglviewer.com
+
+ This file may be used under the terms of the GNU General Public License 
+ versions 2.0 or 3.0 as published by the Free Software Foundation and
+ appearing in the LICENSE file included in the packaging of this file.
+ In addition, as a special exception, Gilles Debunne gives you certain 
+ additional rights, described in the file GPL_EXCEPTION in this package.
+
+ libQGLViewer uses dual licensing. Commercial/proprietary software must
+ purchase a libQGLViewer Commercial License.
+
+ This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+ WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+
+*****************************************************************************/
+
+
+#include <string.h>
+
+#include "PrimitiveCapture.h"
+
+using namespace vrender ;
+using namespace std ;
+
+PrimitiveCapture::PrimitiveCapture()
+{
+	for(int i=0;i<16;++i)
+		_matrix[i] = (i%5 == 0)?1.0:0.0 ;
+
+	for(int i=0;i<4;++i)
+		_viewport[i] = 0.0f ;
+
+	setColor(0.0f,0.0f,0.0f,1.0f) ;
+}
+
+void PrimitiveCapture::clear()
+{
+	_vertices.clear() ;
+	_types.clear() ;
+}
+
+void PrimitiveCapture::reserve(size_t nb_vertices)
+{
+	_vertices.reserve(nb_vertices*sizeInBuffer()) ;
+	_types.reserve(nb_vertices) ;
+}
+
+void PrimitiveCapture::addWindowPoint(const GLfloat *v)
+{
+	_vertices.insert(_vertices.end(),v,v+sizeInBuffer()) ;
+	_types.push_back(POINT) ;
+}
+
+void PrimitiveCapture::addWindowSegment(const GLfloat *v0,const GLfloat *v1)
+{
+	_vertices.insert(_vertices.end(),v0,v0+sizeInBuffer()) ;
+	_vertices.insert(_vertices.end(),v1,v1+sizeInBuffer()) ;
+	_types.push_back(SEGMENT) ;
+}
+
+void PrimitiveCapture::addWindowTriangle(const GLfloat *v0,const GLfloat *v1,const GLfloat *v2)
+{
+	_vertices.insert(_vertices.end(),v0,v0+sizeInBuffer()) ;
+	_vertices.insert(_vertices.end(),v1,v1+sizeInBuffer()) ;
+	_vertices.insert(_vertices.end(),v2,v2+sizeInBuffer()) ;
+	_types.push_back(TRIANGLE) ;
+}
+
+void PrimitiveCapture::setMatrices(const GLdouble modelview[16],const GLdouble projection[16],const GLint viewport[4])
+{
+	for(int i=0;i<4;++i)
+		for(int j=0;j<4;++j)
+		{
+			GLdouble sum = 0.0 ;
+
+			for(int k=0;k<4;++k)
+				sum += projection[i+4*k]*modelview[k+4*j] ;
+
+			_matrix[i+4*j] = sum ;
+		}
+
+	for(int i=0;i<4;++i)
+		_viewport[i] = GLfloat(viewport[i]) ;
+}
+
+void PrimitiveCapture::setMatricesFromGL()
+{
+	GLdouble modelview[16],projection[16] ;
+	GLint viewport[4] ;
+
+	glGetDoublev(GL_MODELVIEW_MATRIX,modelview) ;
+	glGetDoublev(GL_PROJECTION_MATRIX,projection) ;
+	glGetIntegerv(GL_VIEWPORT,viewport) ;
+
+	setMatrices(modelview,projection,viewport) ;
+}
+
+void PrimitiveCapture::setColor(GLfloat r,GLfloat g,GLfloat b,GLfloat a)
+{
+	_color[0] = r ;
+	_color[1] = g ;
+	_color[2] = b ;
+	_color[3] = a ;
+}
+
+void PrimitiveCapture::toClipSpace(const GLdouble *p,const GLfloat *col,ClipVertex& v) const
+{
+	for(int i=0;i<4;++i)
+	{
+		v.c[i] = _matrix[i]*p[0] + _matrix[i+4]*p[1] + _matrix[i+8]*p[2] + _matrix[i+12] ;
+		v.col[i] = col[i] ;
+	}
+}
+
+// Same conversion as the one done by OpenGL before writing into the feedback buffer.
+
+void PrimitiveCapture::toWindow(const ClipVertex& v,GLfloat *res) const
+{
+	GLdouble w = 1.0/v.c[3] ;
+
+	res[0] = GLfloat(_viewport[0] + _viewport[2]*(v.c[0]*w+1.0)*0.5) ;
+	res[1] = GLfloat(_viewport[1] + _viewport[3]*(v.c[1]*w+1.0)*0.5) ;
+	res[2] = GLfloat((v.c[2]*w+1.0)*0.5) ;
+
+	for(int i=0;i<4;++i)
+		res[3+i] = v.col[i] ;
+}
+
+//  Signed distance to the clipping planes -w<=x, x<=w, -w<=y, y<=w, -w<=z, z<=w,
+// positive inside the frustum.
+
+GLdouble PrimitiveCapture::distance(const ClipVertex& v,int plane)
+{
+	return (plane & 1)?(v.c[3] - v.c[plane >> 1]):(v.c[3] + v.c[plane >> 1]) ;
+}
+
+bool PrimitiveCapture::inside(const ClipVertex& v,int plane)
+{
+	return distance(v,plane) >= 0.0 ;
+}
+
+void PrimitiveCapture::interpolate(const ClipVertex& v0,const ClipVertex& v1,GLdouble t,ClipVertex& res)
+{
+	for(int i=0;i<4;++i)
+	{
+		res.c[i] = v0.c[i] + t*(v1.c[i]-v0.c[i]) ;
+		res.col[i] = GLfloat(v0.col[i] + t*(v1.col[i]-v0.col[i])) ;
+	}
+}
+
+void PrimitiveCapture::addPoint(const GLdouble *p)
+{
+	ClipVertex v ;
+	toClipSpace(p,_color,v) ;
+
+	for(int plane=0;plane<6;++plane)
+		if(!inside(v,plane))
+			return ;
+
+	GLfloat w[7] ;
+	toWindow(v,w) ;
+	addWindowPoint(w) ;
+}
+
+void PrimitiveCapture::addSegment(const GLdouble *p0,const GLdouble *p1)
+{
+	addSegment(p0,p1,_color,_color) ;
+}
+
+void PrimitiveCapture::addSegment(const GLdouble *p0,const GLdouble *p1,const GLfloat *c0,const GLfloat *c1)
+{
+	ClipVertex v0,v1 ;
+	toClipSpace(p0,c0,v0) ;
+	toClipSpace(p1,c1,v1) ;
+
+	// Liang-Barsky clipping of the [v0,v1] parameter range
+
+	GLdouble t0 = 0.0 ;
+	GLdouble t1 = 1.0 ;
+
+	for(int plane=0;plane<6;++plane)
+	{
+		GLdouble d0 = distance(v0,plane) ;
+		GLdouble d1 = distance(v1,plane) ;
+
+		if(d0 < 0.0 && d1 < 0.0)
+			return ;
+
+		if(d0 < 0.0)
+			t0 = max(t0,d0/(d0-d1)) ;
+		else if(d1 < 0.0)
+			t1 = min(t1,d0/(d0-d1)) ;
+	}
+
+	if(t0 > t1)
+		return ;
+
+	ClipVertex c0v,c1v ;
+	interpolate(v0,v1,t0,c0v) ;
+	interpolate(v0,v1,t1,c1v) ;
+
+	GLfloat w0[7],w1[7] ;
+	toWindow(c0v,w0) ;
+	toWindow(c1v,w1) ;
+	addWindowSegment(w0,w1) ;
+}
+
+void PrimitiveCapture::addTriangle(const GLdouble *p0,const GLdouble *p1,const GLdouble *p2)
+{
+	addTriangle(p0,p1,p2,_color,_color,_color) ;
+}
+
+void PrimitiveCapture::addTriangle(const GLdouble *p0,const GLdouble *p1,const GLdouble *p2,const GLfloat *c0,const GLfloat *c1,const GLfloat *c2)
+{
+	// A triangle clipped by the 6 planes has at most 9 vertices.
+
+	ClipVertex poly[2][9] ;
+	int n = 3 ;
+	int cur = 0 ;
+
+	toClipSpace(p0,c0,poly[0][0]) ;
+	toClipSpace(p1,c1,poly[0][1]) ;
+	toClipSpace(p2,c2,poly[0][2]) ;
+
+	for(int plane=0;plane<6;++plane)
+	{
+		bool all_inside = true ;
+
+		for(int i=0;i<n && all_inside;++i)
+			all_inside = inside(poly[cur][i],plane) ;
+
+		if(all_inside)
+			continue ;
+
+		// Sutherland-Hodgman
+
+		int m = 0 ;
+
+		for(int i=0;i<n;++i)
+		{
+			const ClipVertex& a = poly[cur][i] ;
+			const ClipVertex& b = poly[cur][(i+1)%n] ;
+
+			GLdouble da = distance(a,plane) ;
+			GLdouble db = distance(b,plane) ;
+
+			if(da >= 0.0)
+				poly[1-cur][m++] = a ;
+
+			if((da >= 0.0) != (db >= 0.0))
+				interpolate(a,b,da/(da-db),poly[1-cur][m++]) ;
+		}
+
+		cur = 1-cur ;
+		n = m ;
+
+		if(n < 3)
+			return ;
+	}
+
+	// Fan triangulation of the clipped polygon
+
+	GLfloat w0[7],w1[7],w2[7] ;
+	toWindow(poly[cur][0],w0) ;
+	toWindow(poly[cur][1],w1) ;
+
+	for(int i=2;i<n;++i)
+	{
+		toWindow(poly[cur][i],w2) ;
+		addWindowTriangle(w0,w1,w2) ;
+		memcpy(w1,w2,sizeof(w1)) ;
+	}
+}
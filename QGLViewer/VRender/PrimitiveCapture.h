@@ -0,0 +1,125 @@
+/*
+ This file is part of the VRender library.
+ Copyright (C) 2005 Cyril Soler (Cyril.Soler@imag.fr)
+ Version 1.0.0, released on June 27, 2005.
+
+ http://artis.imag.fr/Members/Cyril.Soler/VRender
+
+ VRender is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 2 of the License, or
+ (at your option) any later version.
+
+ VRender is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with VRender; if not, write to the Free Software Foundation, Inc.,
+ 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+/****************************************************************************
+
+ Copyright (C) 2002-2014 Gilles Debunne. All rights reserved.
+
+ This file is part of the QGLViewer library version 2.6.3.
+
+ http://www.libqglviewer.com - contact@libqglviewer.com
+
+ This file may be used under the terms of the GNU General Public License 
+ versions 2.0 or 3.0 as published by the Free Software Foundation and
+ appearing in the LICENSE file included in the packaging of this file.
+ In addition, as a special exception, Gilles Debunne gives you certain 
+ additional rights, described in the file GPL_EXCEPTION in this package.
+
+ libQGLViewer uses dual licensing. Commercial/proprietary software must
+ purchase a libQGLViewer Commercial License.
+
+ This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+ WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+
+*****************************************************************************/
+
+
+#ifndef _VRENDER_PRIMITIVECAPTURE_H
+#define _VRENDER_PRIMITIVECAPTURE_H
+
+//  This class stores points, segments and triangles pushed directly by the
+// application, as an alternative to the OpenGL feedback buffer. Vertices are
+// stored in the feedback buffer GL_3D_COLOR layout (window x, y, z, then r, g,
+// b, a), but without tokens, so that ParserGL can convert them without any
+// parsing and without having to render the scene several times.
+//
+//  Primitives can either be given in window coordinates (already transformed
+// and clipped), or in object coordinates, in which case they are transformed
+// with the matrices given to setMatrices() and clipped against the view frustum.
+
+#include <stddef.h>
+#include <vector>
+#include "Types.h"
+
+namespace vrender
+{
+	class PrimitiveCapture
+	{
+		public:
+			enum PrimitiveType { POINT = 1, SEGMENT = 2, TRIANGLE = 3 } ;
+
+			PrimitiveCapture() ;
+
+			void clear() ;
+			void reserve(size_t nb_vertices) ;
+
+			// Window coordinates primitives. Each vertex holds 7 floats: x, y, z, r, g, b, a.
+
+			void addWindowPoint(const GLfloat *v) ;
+			void addWindowSegment(const GLfloat *v0,const GLfloat *v1) ;
+			void addWindowTriangle(const GLfloat *v0,const GLfloat *v1,const GLfloat *v2) ;
+
+			// Object coordinates primitives, transformed and clipped using the current matrices.
+
+			void setMatrices(const GLdouble modelview[16],const GLdouble projection[16],const GLint viewport[4]) ;
+			void setMatricesFromGL() ;
+
+			void setColor(GLfloat r,GLfloat g,GLfloat b,GLfloat a = 1.0f) ;
+
+			void addPoint(const GLdouble *p) ;
+			void addSegment(const GLdouble *p0,const GLdouble *p1) ;
+			void addTriangle(const GLdouble *p0,const GLdouble *p1,const GLdouble *p2) ;
+
+			// Same, with one RGBA color per vertex.
+			void addSegment(const GLdouble *p0,const GLdouble *p1,const GLfloat *c0,const GLfloat *c1) ;
+			void addTriangle(const GLdouble *p0,const GLdouble *p1,const GLdouble *p2,const GLfloat *c0,const GLfloat *c1,const GLfloat *c2) ;
+
+			// Access to the captured data
+
+			inline size_t nbPrimitives() const { return _types.size() ; }
+			inline PrimitiveType type(size_t i) const { return PrimitiveType(_types[i]) ; }
+			inline const std::vector<GLfloat>& vertices() const { return _vertices ; }
+			inline const GLfloat *viewport() const { return _viewport ; }
+
+			static size_t sizeInBuffer() { return 7 ; }
+
+		private:
+			// Clip space vertex: x, y, z, w, r, g, b, a
+			struct ClipVertex { GLdouble c[4] ; GLfloat col[4] ; } ;
+
+			void toClipSpace(const GLdouble *p,const GLfloat *col,ClipVertex& v) const ;
+			void toWindow(const ClipVertex& v,GLfloat *res) const ;
+
+			static bool inside(const ClipVertex& v,int plane) ;
+			static GLdouble distance(const ClipVertex& v,int plane) ;
+			static void interpolate(const ClipVertex& v0,const ClipVertex& v1,GLdouble t,ClipVertex& res) ;
+
+			std::vector<GLfloat> _vertices ;
+			std::vector<unsigned char> _types ;
+
+			GLdouble _matrix[16] ;	// projection * modelview
+			GLfloat _viewport[4] ;
+			GLfloat _color[4] ;
+	};
+}
+
+#endif
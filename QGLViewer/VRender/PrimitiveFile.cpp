@@ -0,0 +1,346 @@
+/*
+ This file is part of the VRender library.
+ Copyright (C) 2005 Cyril Soler (Cyril.Soler@imag.fr)
+ Version 1.0.0, released on June 27, 2005.
+
+ http://artis.imag.fr/Members/Cyril.Soler/VRender
+
+ VRender is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 2 of the License, or
+ (at your option) any later version.
+
+ VRender is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with VRender; if not, write to the Free Software Foundation, Inc.,
+ 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+/****************************************************************************
+
+ Copyright (C) 2002-2014 Gilles Debunne. All rights reserved.
+
+ This file is part of the QGLViewer library version 2.6.3.
+
+ http://www.libqglviewer.com - contact@libqglviewer.com
+
+ This file may be used under the terms of the GNU General Public License 
+ versions 2.0 or 3.0 as published by the Free Software Foundation and
+ appearing in the LICENSE file included in the packaging of this file.
+ In addition, as a special exception, Gilles Debunne gives you certain 
+ additional rights, described in the file GPL_EXCEPTION in this package.
+
+ libQGLViewer uses dual licensing. Commercial/proprietary software must
+ purchase a libQGLViewer Commercial License.
+
+ This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+ WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+
+*****************************************************************************/
+
+
+#include <string.h>
+#include <stdexcept>
+#include <algorithm>
+
+#include <QFile>
+
+#include "Primitive.h"
+#include "PrimitiveFile.h"
+
+using namespace vrender ;
+using namespace std ;
+
+//  Header: a magic number, the version of the format, the number of primitives,
+// then the bounding box, the viewport and the clear color. The number of
+// primitives is only written when the file is closed, so that an interrupted
+// save is detected.
+//
+//  Each primitive is then saved as its type and number of vertices, followed
+// by its vertices. Records are multiples of 8 bytes long, and so is the
+// header: records are aligned in the buffer.
+
+static const char PRIMITIVE_FILE_MAGIC[4] = { 'V','R','P','F' } ;
+static const quint32 PRIMITIVE_FILE_VERSION = 1 ;
+static const quint64 PRIMITIVE_FILE_INCOMPLETE = ~(quint64)0 ;
+
+static const qint64 NB_PRIMITIVES_OFFSET = sizeof(PRIMITIVE_FILE_MAGIC) + sizeof(quint32) ;
+static const size_t HEADER_SIZE = NB_PRIMITIVES_OFFSET + sizeof(quint64) + 12*sizeof(GLfloat) ;
+
+static const size_t BUFFER_SIZE = 256*1024 ;
+static const quint32 MAX_RECORD_VERTICES = 1024*1024 ;
+
+struct PrimitiveRecord
+{
+	quint32 type ;
+	quint32 nb_vertices ;
+} ;
+
+struct VertexRecord
+{
+	double pos[3] ;
+	GLfloat color[4] ;
+} ;
+
+static inline size_t recordSize(size_t nb_vertices)
+{
+	return sizeof(PrimitiveRecord) + nb_vertices*sizeof(VertexRecord) ;
+}
+
+static inline void appendBytes(vector<char>& buffer,const void *data,size_t size)
+{
+	buffer.insert(buffer.end(),(const char *)data,(const char *)data + size) ;
+}
+
+PrimitiveFile::PrimitiveFile()
+{
+	_file = NULL ;
+	_writing = false ;
+	_nb_primitives = 0 ;
+	_nb_read = 0 ;
+	_buffer_pos = 0 ;
+
+	for(int i=0;i<4;++i)
+		_bounding_box[i] = _viewport[i] = _clear_color[i] = 0.0 ;
+}
+
+PrimitiveFile::~PrimitiveFile()
+{
+	if(_file != NULL && _writing)
+		_file->remove() ;
+
+	delete _file ;
+}
+
+void PrimitiveFile::create(const QString& filename,const GLfloat bounding_box[4],const GLfloat viewport[4],const GLfloat clear_color[4])
+{
+	if(_file != NULL)
+		throw runtime_error("PrimitiveFile::create() called on an open file.") ;
+
+	_file = new QFile(filename) ;
+
+	if(!_file->open(QIODevice::WriteOnly | QIODevice::Truncate))
+	{
+		delete _file ;
+		_file = NULL ;
+		throw runtime_error("Could not create primitive file.") ;
+	}
+
+	_writing = true ;
+	_nb_primitives = 0 ;
+
+	for(int i=0;i<4;++i)
+	{
+		_bounding_box[i] = bounding_box[i] ;
+		_viewport[i] = viewport[i] ;
+		_clear_color[i] = clear_color[i] ;
+	}
+
+	_buffer.clear() ;
+	_buffer.reserve(BUFFER_SIZE) ;
+
+	appendBytes(_buffer,PRIMITIVE_FILE_MAGIC,sizeof(PRIMITIVE_FILE_MAGIC)) ;
+	appendBytes(_buffer,&PRIMITIVE_FILE_VERSION,sizeof(quint32)) ;
+	appendBytes(_buffer,&PRIMITIVE_FILE_INCOMPLETE,sizeof(quint64)) ;
+	appendBytes(_buffer,_bounding_box,sizeof(_bounding_box)) ;
+	appendBytes(_buffer,_viewport,sizeof(_viewport)) ;
+	appendBytes(_buffer,_clear_color,sizeof(_clear_color)) ;
+}
+
+void PrimitiveFile::flushBuffer()
+{
+	if(!_buffer.empty() && _file->write(&_buffer[0],_buffer.size()) != (qint64)_buffer.size())
+		throw runtime_error("Could not write primitive file. Disk full ?") ;
+
+	_buffer.clear() ;
+}
+
+void PrimitiveFile::append(const vector<PtrPrimitive>& primitive_tab)
+{
+	if(_file == NULL || !_writing)
+		throw runtime_error("PrimitiveFile::append() called on a file that is not being created.") ;
+
+	for(size_t i=0;i<primitive_tab.size();++i)
+	{
+		if(primitive_tab[i] == NULL)
+			continue ;
+
+		const Primitive *p = primitive_tab[i] ;
+		size_t n = p->nbVertices() ;
+
+		// read() rejects records without vertices.
+		if(n == 0)
+			continue ;
+
+		size_t size = recordSize(n) ;
+
+		if(_buffer.size() + size > _buffer.capacity())
+			flushBuffer() ;
+
+		size_t pos = _buffer.size() ;
+		_buffer.resize(pos + size) ;
+
+		PrimitiveRecord *record = (PrimitiveRecord *)&_buffer[pos] ;
+		VertexRecord *v = (VertexRecord *)(record + 1) ;
+
+		record->type = p->type() ;
+		record->nb_vertices = (quint32)n ;
+
+		for(size_t j=0;j<n;++j)
+		{
+			const Feedback3DColor& f = p->sommet3DColor(j) ;
+
+			v[j].pos[0] = f.x() ; v[j].pos[1] = f.y() ; v[j].pos[2] = f.z() ;
+			v[j].color[0] = f.red() ; v[j].color[1] = f.green() ; v[j].color[2] = f.blue() ; v[j].color[3] = f.alpha() ;
+		}
+
+		++_nb_primitives ;
+	}
+}
+
+void PrimitiveFile::close()
+{
+	if(_file == NULL)
+		return ;
+
+	if(_writing)
+	{
+		flushBuffer() ;
+
+		quint64 nb_primitives = _nb_primitives ;
+
+		if(!_file->seek(NB_PRIMITIVES_OFFSET) || _file->write((const char *)&nb_primitives,sizeof(quint64)) != (qint64)sizeof(quint64))
+			throw runtime_error("Could not write primitive file. Disk full ?") ;
+
+		_writing = false ;
+	}
+
+	_file->close() ;
+	delete _file ;
+	_file = NULL ;
+
+	_buffer.clear() ;
+	_buffer_pos = 0 ;
+}
+
+void PrimitiveFile::open(const QString& filename)
+{
+	if(_file != NULL)
+		throw runtime_error("PrimitiveFile::open() called on an open file.") ;
+
+	_file = new QFile(filename) ;
+
+	if(!_file->open(QIODevice::ReadOnly))
+	{
+		delete _file ;
+		_file = NULL ;
+		throw runtime_error("Could not open primitive file.") ;
+	}
+
+	_writing = false ;
+	_nb_read = 0 ;
+	_buffer.clear() ;
+	_buffer_pos = 0 ;
+
+	if(!fillBuffer(HEADER_SIZE) || memcmp(&_buffer[0],PRIMITIVE_FILE_MAGIC,sizeof(PRIMITIVE_FILE_MAGIC)) != 0)
+		throw runtime_error("Not a primitive file.") ;
+
+	const char *header = &_buffer[sizeof(PRIMITIVE_FILE_MAGIC)] ;
+	quint32 version ;
+	quint64 nb_primitives ;
+
+	memcpy(&version,header,sizeof(quint32)) ;
+	memcpy(&nb_primitives,header + sizeof(quint32),sizeof(quint64)) ;
+
+	if(version != PRIMITIVE_FILE_VERSION)
+		throw runtime_error("Primitive file saved by another version of VRender.") ;
+
+	if(nb_primitives == PRIMITIVE_FILE_INCOMPLETE)
+		throw runtime_error("Incomplete primitive file.") ;
+
+	header += sizeof(quint32) + sizeof(quint64) ;
+
+	memcpy(_bounding_box,header,sizeof(_bounding_box)) ;
+	memcpy(_viewport,header + sizeof(_bounding_box),sizeof(_viewport)) ;
+	memcpy(_clear_color,header + sizeof(_bounding_box) + sizeof(_viewport),sizeof(_clear_color)) ;
+
+	_nb_primitives = (size_t)nb_primitives ;
+	_buffer_pos = HEADER_SIZE ;
+}
+
+//  Makes sure that at least size bytes are available in the buffer from
+// _buffer_pos. Returns false at the end of the file.
+
+bool PrimitiveFile::fillBuffer(size_t size)
+{
+	size_t available = _buffer.size() - _buffer_pos ;
+
+	if(available >= size)
+		return true ;
+
+	_buffer.erase(_buffer.begin(),_buffer.begin() + _buffer_pos) ;
+	_buffer_pos = 0 ;
+
+	size_t wanted = max(size,BUFFER_SIZE) - available ;
+	_buffer.resize(available + wanted) ;
+
+	qint64 nb_read = _file->read(&_buffer[available],wanted) ;
+
+	_buffer.resize(available + (size_t)max((qint64)0,nb_read)) ;
+
+	return _buffer.size() >= size ;
+}
+
+size_t PrimitiveFile::read(vector<PtrPrimitive>& primitive_tab,size_t max_primitives)
+{
+	if(_file == NULL || _writing)
+		throw runtime_error("PrimitiveFile::read() called on a file that is not open for reading.") ;
+
+	vector<Feedback3DColor> verts ;
+	size_t nb = 0 ;
+
+	while(nb < max_primitives && _nb_read < _nb_primitives)
+	{
+		if(!fillBuffer(sizeof(PrimitiveRecord)))
+			throw runtime_error("Truncated primitive file.") ;
+
+		PrimitiveRecord record = *(const PrimitiveRecord *)&_buffer[_buffer_pos] ;
+
+		if(record.nb_vertices < 1 || record.nb_vertices > MAX_RECORD_VERTICES || (record.type == Primitive::SEGMENT && record.nb_vertices != 2))
+			throw runtime_error("Corrupted primitive file.") ;
+
+		size_t size = recordSize(record.nb_vertices) ;
+
+		if(!fillBuffer(size))
+			throw runtime_error("Truncated primitive file.") ;
+
+		const VertexRecord *v = (const VertexRecord *)&_buffer[_buffer_pos + sizeof(PrimitiveRecord)] ;
+
+		verts.clear() ;
+
+		for(size_t j=0;j<record.nb_vertices;++j)
+			verts.push_back(Feedback3DColor(v[j].pos[0],v[j].pos[1],v[j].pos[2],v[j].color[0],v[j].color[1],v[j].color[2],v[j].color[3])) ;
+
+		switch(record.type)
+		{
+			case Primitive::POINT:   primitive_tab.push_back(new Point(verts[0])) ;
+				break ;
+			case Primitive::SEGMENT: primitive_tab.push_back(new Segment(verts[0],verts[1])) ;
+				break ;
+			case Primitive::POLYGON: primitive_tab.push_back(new Polygone(verts)) ;
+				break ;
+			default:
+				throw runtime_error("Corrupted primitive file.") ;
+		}
+
+		_buffer_pos += size ;
+		++_nb_read ;
+		++nb ;
+	}
+
+	return nb ;
+}
@@ -0,0 +1,115 @@
+/*
+ This file is part of the VRender library.
+ Copyright (C) 2005 Cyril Soler (Cyril.Soler@imag.fr)
+ Version 1.0.0, released on June 27, 2005.
+
+ http://artis.imag.fr/Members/Cyril.Soler/VRender
+
+ VRender is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 2 of the License, or
+ (at your option) any later version.
+
+ VRender is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with VRender; if not, write to the Free Software Foundation, Inc.,
+ 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+/****************************************************************************
+
+ Copyright (C) 2002-2014 Gilles Debunne. All rights reserved.
+
+ This file is part of the QGLViewer library version 2.6.3.
+
+ http://www.libqglviewer.com - contact@libqglviewer.com
+
+ This file may be used under the terms of the GNU General Public License 
+ versions 2.0 or 3.0 as published by the Free Software Foundation and
+ appearing in the LICENSE file included in the packaging of this file.
+ In addition, as a special exception, Gilles Debunne gives you certain 
+ additional rights, described in the file GPL_EXCEPTION in this package.
+
+ libQGLViewer uses dual licensing. Commercial/proprietary software must
+ purchase a libQGLViewer Commercial License.
+
+ This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+ WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+
+*****************************************************************************/
+
+
+#ifndef _VRENDER_PRIMITIVEFILE_H
+#define _VRENDER_PRIMITIVEFILE_H
+
+//  This class saves a list of primitives, once culled and sorted, to a file,
+// and reads it back. The list can then be exported again, to other formats or
+// with other export options, without capturing, parsing and sorting the scene
+// again. The file starts with what the exporters need besides the primitives
+// (bounding box, viewport and clear color), followed by the primitives, in
+// rendering order. Positions are saved in double precision, so that exports
+// of the file are identical to the ones of the render that saved it.
+//
+//  Numbers are saved in the byte order of the machine: the file is meant as a
+// cache, not as an exchange format.
+
+#include <vector>
+#include "Types.h"
+
+class QFile ;
+class QString ;
+
+namespace vrender
+{
+	class PrimitiveFile
+	{
+		public:
+			PrimitiveFile() ;
+			~PrimitiveFile() ;		// Removes the file if it was created but not closed.
+
+			//  Writing. bounding_box is (xmin,ymin,xmax,ymax). Primitives are appended
+			// in rendering order, and are not deleted. NULL primitives and polygons
+			// without vertices, which draw nothing, are skipped.
+			void create(const QString& filename,const GLfloat bounding_box[4],const GLfloat viewport[4],const GLfloat clear_color[4]) ;
+			void append(const std::vector<PtrPrimitive>& primitive_tab) ;
+			void close() ;
+
+			//  Reading. read() appends at most max_primitives primitives, in
+			// rendering order, to primitive_tab, and returns how many were read. It
+			// returns 0 once all of them have been read.
+			void open(const QString& filename) ;
+			size_t read(std::vector<PtrPrimitive>& primitive_tab,size_t max_primitives) ;
+
+			size_t nbPrimitives() const { return _nb_primitives ; }
+
+			const GLfloat *boundingBox() const { return _bounding_box ; }
+			const GLfloat *viewport() const { return _viewport ; }
+			const GLfloat *clearColor() const { return _clear_color ; }
+
+		private:
+			PrimitiveFile(const PrimitiveFile&) ;
+			PrimitiveFile& operator=(const PrimitiveFile&) ;
+
+			void flushBuffer() ;
+			bool fillBuffer(size_t size) ;
+
+			QFile *_file ;
+			bool _writing ;
+
+			size_t _nb_primitives ;
+			size_t _nb_read ;
+
+			GLfloat _bounding_box[4] ;
+			GLfloat _viewport[4] ;
+			GLfloat _clear_color[4] ;
+
+			std::vector<char> _buffer ;
+			size_t _buffer_pos ;
+	};
+}
+
+#endif
@@ -46,7 +46,6 @@
 #include "AxisAlignedBox.h"
 #include "PrimitivePositioning.h"
 #include "math.h"
-#include <algorithm>
 #include "Vector2.h"
 
 #include <algorithm>
@@ -73,24 +72,24 @@ int PrimitivePositioning::computeRelativePosition(const Primitive *p1,const Prim
 
 	// 2 - call specific tests for each case.
 
-	if(p1->nbVertices() >= 3)
-		if(p2->nbVertices() >= 3)
-			return computeRelativePosition( dynamic_cast<const Polygone *>(p1),dynamic_cast<const Polygone *>(p2)) ;
-		else if(p2->nbVertices() == 2) // Case of a segment versus a polygon
-			return computeRelativePosition( dynamic_cast<const Polygone *>(p1),dynamic_cast<const Segment *>(p2)) ;
+	if(p1->type() == Primitive::POLYGON)
+		if(p2->type() == Primitive::POLYGON)
+			return computeRelativePosition( static_cast<const Polygone *>(p1),static_cast<const Polygone *>(p2)) ;
+		else if(p2->type() == Primitive::SEGMENT) // Case of a segment versus a polygon
+			return computeRelativePosition( static_cast<const Polygone *>(p1),static_cast<const Segment *>(p2)) ;
 		else
-			return computeRelativePosition( dynamic_cast<const Polygone *>(p1),dynamic_cast<const Point *>(p2)) ;
-	else if(p1->nbVertices() == 2)
-		if(p2->nbVertices() >= 3)
-			return inverseRP(computeRelativePosition( dynamic_cast<const Polygone *>(p2),dynamic_cast<const Segment *>(p1))) ;
-		else if(p2->nbVertices() == 2)
-			return computeRelativePosition( dynamic_cast<const Segment *>(p1),dynamic_cast<const Segment *>(p2)) ;
+			return computeRelativePosition( static_cast<const Polygone *>(p1),static_cast<const Point *>(p2)) ;
+	else if(p1->type() == Primitive::SEGMENT)
+		if(p2->type() == Primitive::POLYGON)
+			return inverseRP(computeRelativePosition( static_cast<const Polygone *>(p2),static_cast<const Segment *>(p1))) ;
+		else if(p2->type() == Primitive::SEGMENT)
+			return computeRelativePosition( static_cast<const Segment *>(p1),static_cast<const Segment *>(p2)) ;
 		else
 			return Independent ;	// segment vs point => independent
 	else
-		if(p2->nbVertices() >= 3)
-			return inverseRP(computeRelativePosition( dynamic_cast<const Polygone *>(p2),dynamic_cast<const Point *>(p1))) ;
-		else if(p2->nbVertices() == 2)
+		if(p2->type() == Primitive::POLYGON)
+			return inverseRP(computeRelativePosition( static_cast<const Polygone *>(p2),static_cast<const Point *>(p1))) ;
+		else if(p2->type() == Primitive::SEGMENT)
 			return Independent ;	// point vs segment => independent
 		else
 			return Independent ;	// point vs point => independent
@@ -170,9 +169,23 @@ int PrimitivePositioning::computeRelativePosition(const Polygone *P,const Segmen
 
 int PrimitivePositioning::computeRelativePosition(const Polygone *P1,const Polygone *P2)
 {
-	// 1 - use gpc to conservatively check for intersection. This works fine because
-	//    gpc produces a null intersection for polygons sharing an edge, which
-	//    is exactly what we need.
+	// 1 - compute the 2D intersection of both polygons. Polygons sharing an edge
+	//    produce a null intersection, which is exactly what we need.
+	//
+	//    Feedback polygons are almost always convex, in which case they are
+	//    directly clipped. gpc is only used for the other ones.
+
+	if(P1->nbVertices() <= MAX_CONVEX_VERTICES && P2->nbVertices() <= MAX_CONVEX_VERTICES
+			&& isConvex_XY(P1) && isConvex_XY(P2))
+	{
+		gpc_vertex inter[2*MAX_CONVEX_VERTICES] ;
+		long nb_inter = intersectConvexPolygons_XY(P1,P2,inter) ;
+
+		return computeRelativePosition(P1,P2,inter,nb_inter) ;
+	}
+
+	//    This works fine because gpc also produces a null intersection for polygons
+	//    sharing an edge.
 
 	gpc_polygon gpc_int ;
 
@@ -200,33 +213,216 @@ int PrimitivePositioning::computeRelativePosition(const Polygone *P1,const Polyg
 		// throw runtime_error("Intersection with more than 1 contour ! Non convex polygons ?") ;
 	  }
 
+	try
+	{
+		res = computeRelativePosition(P1,P2,gpc_int.contour[0].vertex,gpc_int.contour[0].num_vertices) ;
+	}
+	catch(exception&)
+	{
+		gpc_free_polygon(&gpc_int) ;
+		throw ;
+	}
+
+	gpc_free_polygon(&gpc_int) ;
+	return res ;
+}
+
+// Computes the relative position of two polygons, from the 2D intersection of their projections.
+
+int PrimitivePositioning::computeRelativePosition(const Polygone *P1,const Polygone *P2,const gpc_vertex *inter,long nb_inter)
+{
 	// 2 - polygons are not independent. Compute their relative position.
 	//    For this, we project the vertices of the 2D intersection onto the
 	//   support plane of each polygon. The epsilon-signs of each point toward
 	//   both planes give the relative position of the polygons.
 
-	for(long i=0;i<gpc_int.contour[0].num_vertices && (res < (Upper | Lower));++i)
+	int res = Independent ;
+
+	for(long i=0;i<nb_inter && (res < (Upper | Lower));++i)
 	{
 		if(P1->normal().z() == 0.0) throw runtime_error("could not project point. Unexpected case !") ;
 		if(P2->normal().z() == 0.0) throw runtime_error("could not project point. Unexpected case !") ;
 
 		// project point onto support planes
 
-		double f1 = P1->normal().x() * gpc_int.contour[0].vertex[i].x + P1->normal().y() * gpc_int.contour[0].vertex[i].y - P1->c() ;
-		double f2 = P2->normal().x() * gpc_int.contour[0].vertex[i].x + P2->normal().y() * gpc_int.contour[0].vertex[i].y - P2->c() ;
+		double f1 = P1->normal().x() * inter[i].x + P1->normal().y() * inter[i].y - P1->c() ;
+		double f2 = P2->normal().x() * inter[i].x + P2->normal().y() * inter[i].y - P2->c() ;
 
-		Vector3 v1(gpc_int.contour[0].vertex[i].x,gpc_int.contour[0].vertex[i].y, -f1/P1->normal().z()) ;
-		Vector3 v2(gpc_int.contour[0].vertex[i].x,gpc_int.contour[0].vertex[i].y, -f2/P2->normal().z()) ;
+		Vector3 v1(inter[i].x,inter[i].y, -f1/P1->normal().z()) ;
+		Vector3 v2(inter[i].x,inter[i].y, -f2/P2->normal().z()) ;
 
 		if(P1->equation(v2) < -_EPS) res |= Lower ;
 		if(P1->equation(v2) >  _EPS) res |= Upper ;
 		if(P2->equation(v1) < -_EPS) res |= Upper ;
 		if(P2->equation(v1) >  _EPS) res |= Lower ;
 	}
-	gpc_free_polygon(&gpc_int) ;
+
 	return res ;
 }
 
+//  Returns true if the projection of P is a convex polygon: all turns are in the same
+// direction, and the polygon winds only once (edge directions change sign at most twice
+// along each axis). Flat turns are accepted.
+
+bool PrimitivePositioning::isConvex_XY(const Polygone *P)
+{
+	size_t n = P->nbVertices() ;
+
+	int turn = 0 ;
+	int x_flips = 0 ;
+	int y_flips = 0 ;
+	int x_sign = 0 ;
+	int y_sign = 0 ;
+
+	for(size_t i=0;i<n;++i)
+	{
+		double dx1 = P->vertex(i+1).x() - P->vertex(i).x() ;
+		double dy1 = P->vertex(i+1).y() - P->vertex(i).y() ;
+		double dx2 = P->vertex(i+2).x() - P->vertex(i+1).x() ;
+		double dy2 = P->vertex(i+2).y() - P->vertex(i+1).y() ;
+
+		double cross = dx1*dy2 - dy1*dx2 ;
+
+		if(cross != 0.0)
+		{
+			int t = (cross > 0.0)?1:-1 ;
+
+			if(turn == 0)
+				turn = t ;
+			else if(t != turn)
+				return false ;
+		}
+
+		if(dx1 != 0.0)
+		{
+			int s = (dx1 > 0.0)?1:-1 ;
+			if(s != x_sign) { if(x_sign != 0) ++x_flips ; x_sign = s ; }
+		}
+
+		if(dy1 != 0.0)
+		{
+			int s = (dy1 > 0.0)?1:-1 ;
+			if(s != y_sign) { if(y_sign != 0) ++y_flips ; y_sign = s ; }
+		}
+	}
+
+	// The last flip back to the first direction is not counted above.
+
+	return x_flips <= 2 && y_flips <= 2 ;
+}
+
+//  Computes the intersection of the projections of two convex polygons into res, which
+// must be able to hold P1->nbVertices()+P2->nbVertices() vertices. Returns the number of
+// vertices of the intersection, which is 0 when the intersection has a null area.
+
+long PrimitivePositioning::intersectConvexPolygons_XY(const Polygone *P1,const Polygone *P2,gpc_vertex *res)
+{
+	const Polygone *P[2] = { P1,P2 } ;
+
+	// 1 - separating axis test. Polygons that only touch are separated.
+
+	for(int k=0;k<2;++k)
+		for(size_t i=0;i<P[k]->nbVertices();++i)
+		{
+			double ax = P[k]->vertex(i).y() - P[k]->vertex(i+1).y() ;
+			double ay = P[k]->vertex(i+1).x() - P[k]->vertex(i).x() ;
+
+			if(ax == 0.0 && ay == 0.0)
+				continue ;
+
+			double mini[2],maxi[2] ;
+
+			for(int l=0;l<2;++l)
+			{
+				mini[l] = maxi[l] = ax*P[l]->vertex(0).x() + ay*P[l]->vertex(0).y() ;
+
+				for(size_t j=1;j<P[l]->nbVertices();++j)
+				{
+					double d = ax*P[l]->vertex(j).x() + ay*P[l]->vertex(j).y() ;
+
+					if(d < mini[l]) mini[l] = d ;
+					if(d > maxi[l]) maxi[l] = d ;
+				}
+			}
+
+			if(maxi[0] <= mini[1] || maxi[1] <= mini[0])
+				return 0 ;
+		}
+
+	// 2 - Sutherland-Hodgman clipping of P1 by each edge of P2.
+
+	double area2 = 0.0 ;
+
+	for(size_t i=0;i<P2->nbVertices();++i)
+		area2 += P2->vertex(i).x()*P2->vertex(i+1).y() - P2->vertex(i+1).x()*P2->vertex(i).y() ;
+
+	if(area2 == 0.0)
+		return 0 ;
+
+	double orientation = (area2 > 0.0)?1.0:-1.0 ;
+
+	gpc_vertex buffer[2*MAX_CONVEX_VERTICES] ;
+	gpc_vertex *src = res ;
+	gpc_vertex *dst = buffer ;
+	long n = (long)P1->nbVertices() ;
+
+	for(long i=0;i<n;++i)
+	{
+		src[i].x = P1->vertex(i).x() ;
+		src[i].y = P1->vertex(i).y() ;
+	}
+
+	for(size_t j=0;j<P2->nbVertices() && n > 0;++j)
+	{
+		double ax = P2->vertex(j).x() ;
+		double ay = P2->vertex(j).y() ;
+		double ex = P2->vertex(j+1).x() - ax ;
+		double ey = P2->vertex(j+1).y() - ay ;
+
+		long m = 0 ;
+
+		for(long i=0;i<n;++i)
+		{
+			const gpc_vertex& p = src[i] ;
+			const gpc_vertex& q = src[(i+1)%n] ;
+
+			double dp = orientation*(ex*(p.y-ay) - ey*(p.x-ax)) ;
+			double dq = orientation*(ex*(q.y-ay) - ey*(q.x-ax)) ;
+
+			if(dp >= 0.0)
+				dst[m++] = p ;
+
+			if((dp > 0.0 && dq < 0.0) || (dp < 0.0 && dq > 0.0))
+			{
+				double t = dp/(dp-dq) ;
+
+				dst[m].x = p.x + t*(q.x-p.x) ;
+				dst[m].y = p.y + t*(q.y-p.y) ;
+				++m ;
+			}
+		}
+
+		std::swap(src,dst) ;
+		n = m ;
+	}
+
+	// 3 - null area intersections are discarded, as gpc does.
+
+	double area = 0.0 ;
+
+	for(long i=0;i<n;++i)
+		area += src[i].x*src[(i+1)%n].y - src[(i+1)%n].x*src[i].y ;
+
+	if(n < 3 || area == 0.0)
+		return 0 ;
+
+	if(src != res)
+		for(long i=0;i<n;++i)
+			res[i] = src[i] ;
+
+	return n ;
+}
+
 // Computes the relative position of a segment toward another segment.
 
 int PrimitivePositioning::computeRelativePosition(const Segment *S1,const Segment *S2)
@@ -664,8 +860,14 @@ void PrimitivePositioning::split(Segment *S,const NVector3& v,double C,Primitive
 
 void PrimitivePositioning::splitPrimitive(Primitive *P,const NVector3& v,double c, Primitive *& prim_up,Primitive *& prim_lo)
 {
-	Polygone *p1 = dynamic_cast<Polygone *>(P) ; if(p1 != NULL) PrimitivePositioning::split(p1,v,c,prim_up,prim_lo) ;
-	Segment  *p2 = dynamic_cast<Segment  *>(P) ; if(p2 != NULL) PrimitivePositioning::split(p2,v,c,prim_up,prim_lo) ;
-	Point    *p3 = dynamic_cast<Point    *>(P) ; if(p3 != NULL) PrimitivePositioning::split(p3,v,c,prim_up,prim_lo) ;
+	switch(P->type())
+	{
+		case Primitive::POLYGON: PrimitivePositioning::split(static_cast<Polygone *>(P),v,c,prim_up,prim_lo) ;
+			break ;
+		case Primitive::SEGMENT: PrimitivePositioning::split(static_cast<Segment  *>(P),v,c,prim_up,prim_lo) ;
+			break ;
+		case Primitive::POINT:   PrimitivePositioning::split(static_cast<Point    *>(P),v,c,prim_up,prim_lo) ;
+			break ;
+	}
 }
 
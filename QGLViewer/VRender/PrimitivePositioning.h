@@ -88,6 +88,15 @@ namespace vrender
 														double I_EPS,double & t1,double & t2) ;
 			static gpc_polygon createGPCPolygon_XY(const Polygone *P) ;
 
+			//  Convex polygons are intersected without gpc: a separating axis test first,
+			// then a Sutherland-Hodgman clipping into a buffer of 2*MAX_CONVEX_VERTICES vertices.
+
+			static const size_t MAX_CONVEX_VERTICES = 16 ;
+
+			static bool isConvex_XY(const Polygone *P) ;
+			static long intersectConvexPolygons_XY(const Polygone *P1,const Polygone *P2,gpc_vertex *res) ;
+			static int computeRelativePosition(const Polygone *P1,const Polygone *P2,const gpc_vertex *inter,long nb_inter) ;
+
 
 			static int inverseRP(int) ;
 
@@ -0,0 +1,388 @@
+/*
+ This file is part of the VRender library.
+ Copyright (C) 2005 Cyril Soler (Cyril.Soler@imag.fr)
+ Version 1.0.0, released on June 27, 2005.
+
+ http://artis.imag.fr/Members/Cyril.Soler/VRender
+
+ VRender is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 2 of the License, or
+ (at your option) any later version.
+
+ VRender is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with VRender; if not, write to the Free Software Foundation, Inc.,
+ 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+/****************************************************************************
+
+ Copyright (C) 2002-2014 Gilles Debunne. All rights reserved.
+
+ This file is part of the QGLViewer library version 2.6.3.
+
+ http://www.libqglviewer.com - contact@libqglviewer.com
+
+ This file may be used under the terms of the GNU General Public License 
+ versions 2.0 or 3.0 as published by the Free Software Foundation and
+ appearing in the LICENSE file included in the packaging of this file.
+ In addition, as a special exception, Gilles Debunne gives you certain 
+ additional rights, described in the file GPL_EXCEPTION in this package.
+
+ libQGLViewer uses dual licensing. Commercial/proprietary software must
+ purchase a libQGLViewer Commercial License.
+
+ This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+ WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+
+*****************************************************************************/
+
+
+#include <vector>
+#include <string.h>
+#include <math.h>
+#include <QHash>
+#include "VRender.h"
+#include "Optimizer.h"
+#include "Primitive.h"
+#include "AxisAlignedBox.h"
+#include "Vector2.h"
+
+using namespace std ;
+using namespace vrender ;
+
+//  Two polygons are only merged when they are at most that far from each other
+// in the rendering order, since everything in between has to be checked.
+
+static const size_t MAX_MERGE_DISTANCE = 256 ;
+
+// Merged polygons are not allowed to grow beyond this number of vertices.
+
+static const size_t MAX_MERGED_VERTICES = 64 ;
+
+static const double PI = 3.14159265358979323846 ;
+
+// Relative tolerance for coplanarity and convexity tests.
+
+static const double MERGE_EPS = 1e-6 ;
+
+static inline bool sameVertex(const Feedback3DColor& v1,const Feedback3DColor& v2)
+{
+	return v1.x() == v2.x() && v1.y() == v2.y() && v1.z() == v2.z() ;
+}
+
+static inline bool sameColor(const Feedback3DColor& v1,const Feedback3DColor& v2)
+{
+	return v1.red() == v2.red() && v1.green() == v2.green() && v1.blue() == v2.blue() && v1.alpha() == v2.alpha() ;
+}
+
+//  Key of the directed edge from v1 to v2. Different edges may share a key, so
+// polygons found through it are always checked.
+
+static quint64 edgeKey(const Feedback3DColor& v1,const Feedback3DColor& v2)
+{
+	double c[6] = { v1.x(),v1.y(),v1.z(),v2.x(),v2.y(),v2.z() } ;
+	quint64 h = 14695981039346656037ULL ;
+
+	for(int i=0;i<6;++i)
+	{
+		quint64 b ;
+		memcpy(&b,&c[i],sizeof(b)) ;
+
+		h = (h ^ b) * 1099511628211ULL ;
+		h ^= h >> 29 ;
+	}
+
+	return h ;
+}
+
+static AxisAlignedBox_xy bbox2D(const Primitive *P)
+{
+	AxisAlignedBox_xy b ;
+
+	for(size_t i=0;i<P->nbVertices();++i)
+		b.include(Vector2(P->vertex(i).x(),P->vertex(i).y())) ;
+
+	return b ;
+}
+
+static bool boxesOverlap(const AxisAlignedBox_xy& b1,const AxisAlignedBox_xy& b2,double margin)
+{
+	return b1.mini().x() < b2.maxi().x() + margin && b2.mini().x() < b1.maxi().x() + margin
+		&& b1.mini().y() < b2.maxi().y() + margin && b2.mini().y() < b1.maxi().y() + margin ;
+}
+
+//  Returns true if one of the edges of P1 separates it from P2 (both convex).
+// Polygons that only touch are separated.
+
+static bool hasSeparatingEdge(const Polygone *P1,const Polygone *P2)
+{
+	size_t n1 = P1->nbVertices() ;
+	double area = 0.0 ;
+
+	for(size_t i=0;i<n1;++i)
+		area += P1->vertex(i).x()*P1->vertex(i+1).y() - P1->vertex(i+1).x()*P1->vertex(i).y() ;
+
+	double s = (area > 0.0)?1.0:-1.0 ;
+
+	for(size_t i=0;i<n1;++i)
+	{
+		double ex = P1->vertex(i+1).x() - P1->vertex(i).x() ;
+		double ey = P1->vertex(i+1).y() - P1->vertex(i).y() ;
+		bool separates = true ;
+
+		// P1 lies on the left of its edges when s > 0.
+
+		for(size_t j=0;j<P2->nbVertices() && separates;++j)
+			if(s*(ex*(P2->vertex(j).y() - P1->vertex(i).y()) - ey*(P2->vertex(j).x() - P1->vertex(i).x())) > 0.0)
+				separates = false ;
+
+		if(separates)
+			return true ;
+	}
+
+	return false ;
+}
+
+//  Conservative test of whether P1 and P2 cover common pixels. Only polygons
+// are tested exactly; points and segments are approximated by their bounding box.
+
+static bool overlap(const Polygone *P1,const AxisAlignedBox_xy& b1,const Primitive *P2,const AxisAlignedBox_xy& b2)
+{
+	if(P2->type() != Primitive::POLYGON)
+		return boxesOverlap(b1,b2,1.0) ;
+
+	if(!boxesOverlap(b1,b2,0.0))
+		return false ;
+
+	const Polygone *Q = static_cast<const Polygone *>(P2) ;
+
+	return !hasSeparatingEdge(P1,Q) && !hasSeparatingEdge(Q,P1) ;
+}
+
+static bool isFlat(const Polygone *P)
+{
+	for(size_t i=1;i<P->nbVertices();++i)
+		if(!sameColor(P->sommet3DColor(0),P->sommet3DColor(i)))
+			return false ;
+
+	return P->nbVertices() >= 3 && P->FlatFactor() > FLAT_POLYGON_EPS ;
+}
+
+static bool coplanar(const Polygone *P1,const Polygone *P2,double scale)
+{
+	// Normals are not necessarily unit vectors.
+
+	Vector3 n1(P1->normal()) ;
+	Vector3 n2(P2->normal()) ;
+	double l1 = n1.norm() ;
+	double l2 = n2.norm() ;
+
+	if(l1 == 0.0 || l2 == 0.0 || n1*n2 < (1.0 - MERGE_EPS)*l1*l2)
+		return false ;
+
+	for(size_t i=0;i<P2->nbVertices();++i)
+		if(fabs(P1->equation(P2->vertex(i))) > MERGE_EPS*scale*l1)
+			return false ;
+
+	return true ;
+}
+
+//  Computes the outline of the union of P1 and P2, which have the same
+// orientation, by removing the edges they share in opposite directions. Fails
+// if the remaining edges do not form a single convex loop.
+
+static bool mergeOutlines(const Polygone *P1,const Polygone *P2,vector<Feedback3DColor>& result)
+{
+	size_t n1 = P1->nbVertices() ;
+	size_t n2 = P2->nbVertices() ;
+
+	vector<bool> shared1(n1,false) ;
+	vector<bool> shared2(n2,false) ;
+	size_t nb_shared = 0 ;
+
+	for(size_t i=0;i<n1;++i)
+		for(size_t j=0;j<n2;++j)
+			if(!shared2[j] && sameVertex(P1->sommet3DColor(i),P2->sommet3DColor((j+1)%n2)) && sameVertex(P1->sommet3DColor((i+1)%n1),P2->sommet3DColor(j)))
+			{
+				shared1[i] = shared2[j] = true ;
+				++nb_shared ;
+				break ;
+			}
+
+	if(nb_shared == 0 || n1 + n2 - 2*nb_shared > MAX_MERGED_VERTICES)
+		return false ;
+
+	// Remaining edges, designated by their start vertex.
+
+	vector<const Feedback3DColor *> from, to ;
+
+	for(size_t i=0;i<n1;++i)
+		if(!shared1[i])
+		{
+			from.push_back(&P1->sommet3DColor(i)) ;
+			to.push_back(&P1->sommet3DColor((i+1)%n1)) ;
+		}
+
+	for(size_t j=0;j<n2;++j)
+		if(!shared2[j])
+		{
+			from.push_back(&P2->sommet3DColor(j)) ;
+			to.push_back(&P2->sommet3DColor((j+1)%n2)) ;
+		}
+
+	size_t n = from.size() ;
+
+	if(n < 3)
+		return false ;
+
+	result.clear() ;
+
+	for(size_t e=0;result.size() < n;)
+	{
+		result.push_back(*from[e]) ;
+
+		size_t next = n ;
+
+		for(size_t k=0;k<n;++k)
+			if(sameVertex(*from[k],*to[e]))
+			{
+				if(next != n)		// vertex visited twice by the outline
+					return false ;
+				next = k ;
+			}
+
+		if(next == n || (next == 0) != (result.size() == n))
+			return false ;
+
+		e = next ;
+	}
+
+	//  Convexity, with the orientation of the outline. Aligned vertices are kept,
+	// since other polygons may share edges ending there. Vertices which are almost
+	// but not exactly shared can leave a spike going back and forth, which is
+	// rejected as well: the outline must turn exactly once.
+
+	double area = 0.0 ;
+
+	for(size_t i=0;i<n;++i)
+		area += result[i].x()*result[(i+1)%n].y() - result[(i+1)%n].x()*result[i].y() ;
+
+	double turn = 0.0 ;
+
+	for(size_t i=0;i<n;++i)
+	{
+		const Feedback3DColor& v0 = result[i] ;
+		const Feedback3DColor& v1 = result[(i+1)%n] ;
+		const Feedback3DColor& v2 = result[(i+2)%n] ;
+
+		double ax = v1.x() - v0.x(), ay = v1.y() - v0.y() ;
+		double bx = v2.x() - v1.x(), by = v2.y() - v1.y() ;
+		double cross = ((area > 0.0)?1.0:-1.0)*(ax*by - ay*bx) ;
+		double dot = ax*bx + ay*by ;
+		double tol = MERGE_EPS*sqrt((ax*ax+ay*ay)*(bx*bx+by*by)) ;
+
+		if(cross < -tol || (cross <= tol && dot <= 0.0))
+			return false ;
+
+		turn += atan2(cross,dot) ;
+	}
+
+	return fabs(turn - 2.0*PI) < 1e-3 ;
+}
+
+//  Primitives are scanned in rendering order. Each polygon absorbs the earlier
+// polygons it shares an edge with, found through a hash on edges, when they are
+// coplanar, have the same flat color, and their union is convex. The merged
+// polygon takes the place of the later one, so the earlier one is drawn later
+// than before: this is only allowed if it does not overlap any primitive drawn
+// in between.
+
+void PrimitiveSplitOptimizer::optimize(vector<PtrPrimitive>& primitives_tab,VRenderParams& vparams)
+{
+	size_t N = primitives_tab.size() ;
+	size_t nb_merged = 0 ;
+
+	vector<AxisAlignedBox_xy> boxes(N) ;
+	QHash<quint64,int> edges ;		// directed edge -> index of the polygon that has it
+	vector<Feedback3DColor> outline ;
+
+	edges.reserve(int(3*N)) ;
+
+	for(size_t i=0;i<N;++i)
+		if(primitives_tab[i] != NULL)
+			boxes[i] = bbox2D(primitives_tab[i]) ;
+
+	for(size_t j=0;j<N;++j)
+	{
+		if(j%(N/100+1) == 0)
+			vparams.progress(j/(float)N, QGLViewer::tr("Merging polygons")) ;
+
+		if(primitives_tab[j] == NULL || primitives_tab[j]->type() != Primitive::POLYGON || !isFlat(static_cast<Polygone *>(primitives_tab[j])))
+			continue ;
+
+		Polygone *P2 = static_cast<Polygone *>(primitives_tab[j]) ;
+
+		for(size_t k=0;k<P2->nbVertices();)
+		{
+			// An earlier polygon P1 having the reverse of edge k.
+
+			int i = edges.value(edgeKey(P2->sommet3DColor(k+1),P2->sommet3DColor(k)),-1) ;
+			bool merged = false ;
+
+			if(i >= 0 && primitives_tab[i] != NULL && j - size_t(i) <= MAX_MERGE_DISTANCE)
+			{
+				Polygone *P1 = static_cast<Polygone *>(primitives_tab[i]) ;
+
+				AxisAlignedBox_xy b(boxes[i]) ;
+				b.include(boxes[j]) ;
+				double scale = max(max(b.maxi().x() - b.mini().x(),b.maxi().y() - b.mini().y()),1.0) ;
+
+				if(sameColor(P1->sommet3DColor(0),P2->sommet3DColor(0)) && coplanar(P1,P2,scale) && mergeOutlines(P1,P2,outline))
+				{
+					bool allowed = true ;
+
+					for(size_t l=size_t(i)+1;l<j && allowed;++l)
+						if(primitives_tab[l] != NULL && overlap(P1,boxes[i],primitives_tab[l],boxes[l]))
+							allowed = false ;
+
+					if(allowed)
+					{
+						delete P1 ;
+						delete P2 ;
+						primitives_tab[i] = NULL ;
+						primitives_tab[j] = P2 = new Polygone(outline) ;
+						boxes[j] = b ;
+
+						++nb_merged ;
+						merged = true ;
+					}
+				}
+			}
+
+			// Edges of the new polygon are all examined again.
+
+			k = merged?0:(k+1) ;
+		}
+
+		for(size_t k=0;k<P2->nbVertices();++k)
+			edges.insert(edgeKey(P2->sommet3DColor(k),P2->sommet3DColor(k+1)),int(j)) ;
+	}
+
+	// Rule out gaps.
+
+	size_t j=0 ;
+	for(size_t k=0;k<N;++k)
+		if(primitives_tab[k] != NULL)
+			primitives_tab[j++] = primitives_tab[k] ;
+
+	primitives_tab.resize(j) ;
+#ifdef _VRENDER_DEBUG
+	cout << "Primitive split optimizer: " << nb_merged << " polygons merged." << endl ;
+#endif
+}
@@ -0,0 +1,328 @@
+/*
+ This file is part of the VRender library.
+ Copyright (C) 2005 Cyril Soler (Cyril.Soler@imag.fr)
+ Version 1.0.0, released on June 27, 2005.
+
+ http://artis.imag.fr/Members/Cyril.Soler/VRender
+
+ VRender is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 2 of the License, or
+ (at your option) any later version.
+
+ VRender is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with VRender; if not, write to the Free Software Foundation, Inc.,
+ 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+/****************************************************************************
+
+ Copyright (C) 2002-2014 Gilles Debunne. All rights reserved.
+
+ This file is part of the QGLViewer library version 2.6.3.
+
+ http://www.libqglviewer.com - contact@libqglviewer.com
+
+ This file may be used under the terms of the GNU General Public License 
+ versions 2.0 or 3.0 as published by the Free Software Foundation and
+ appearing in the LICENSE file included in the packaging of this file.
+ In addition, as a special exception, Gilles Debunne gives you certain 
+ additional rights, described in the file GPL_EXCEPTION in this package.
+
+ libQGLViewer uses dual licensing. Commercial/proprietary software must
+ purchase a libQGLViewer Commercial License.
+
+ This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+ WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+
+*****************************************************************************/
+
+
+#include <string.h>
+#include <stdexcept>
+#include <algorithm>
+
+#include <QTemporaryFile>
+
+#include "Primitive.h"
+#include "PrimitiveStream.h"
+
+using namespace vrender ;
+using namespace std ;
+
+//  Primitives are written as records laid out like the feedback buffer: the
+// number of vertices, followed by the 7 floats (position and color) of each
+// vertex. Their depth is sampled in DEPTH_SLOTS slots, which are then grouped
+// into buckets.
+//
+//  The in-memory primitives, and the sorting of a bucket, take several times
+// the size of its records. Buckets are therefore limited to a fraction of the
+// memory budget.
+
+static const size_t DEPTH_SLOTS = 4096 ;
+static const size_t BUDGET_TO_BUCKET_RATIO = 8 ;
+static const size_t MIN_BUCKET_SIZE = 64*1024 ;
+static const size_t WRITE_BUFFER_SIZE = 256*1024 ;
+static const size_t MAX_MAP_WINDOW = 16*1024*1024 ;
+
+static inline size_t recordSize(size_t nb_vertices)
+{
+	return (1 + nb_vertices*Feedback3DColor::sizeInBuffer())*sizeof(GLfloat) ;
+}
+
+PrimitiveStream::PrimitiveStream(size_t memory_budget)
+{
+	_memory_budget = memory_budget ;
+	_nb_primitives = 0 ;
+	_max_record_size = 0 ;
+	_zmin = 0.0 ;
+	_zmax = 0.0 ;
+	_slot_sizes.resize(DEPTH_SLOTS,0) ;
+
+	_spill = new QTemporaryFile ;
+
+	if(!_spill->open())
+	{
+		delete _spill ;
+		throw runtime_error("Could not create temporary file for primitive streaming.") ;
+	}
+
+	_write_buffer.reserve(min(WRITE_BUFFER_SIZE,max((size_t)4096,_memory_budget/16))) ;
+}
+
+PrimitiveStream::~PrimitiveStream()
+{
+	delete _spill ;
+
+	for(size_t i=0;i<_buckets.size();++i)
+		delete _buckets[i] ;
+}
+
+void PrimitiveStream::setDepthRange(GLfloat zmin,GLfloat zmax)
+{
+	_zmin = zmin ;
+	_zmax = zmax ;
+}
+
+size_t PrimitiveStream::depthSlot(const GLfloat *record) const
+{
+	size_t n = (size_t)record[0] ;
+	double z = 0.0 ;
+
+	for(size_t i=0;i<n;++i)
+		z += record[1 + i*Feedback3DColor::sizeInBuffer() + 2] ;
+
+	if(_zmax <= _zmin)
+		return 0 ;
+
+	double t = (z/n - _zmin)/(_zmax - _zmin) ;
+
+	return min(DEPTH_SLOTS-1,(size_t)max(0.0,t*DEPTH_SLOTS)) ;
+}
+
+void PrimitiveStream::flushWriteBuffer()
+{
+	if(_write_buffer.empty())
+		return ;
+
+	if(_spill->write(&_write_buffer[0],_write_buffer.size()) != (qint64)_write_buffer.size())
+		throw runtime_error("Could not write temporary file for primitive streaming. Disk full ?") ;
+
+	_write_buffer.clear() ;
+}
+
+void PrimitiveStream::append(vector<PtrPrimitive>& primitive_tab)
+{
+	if(_spill == NULL)
+		throw runtime_error("PrimitiveStream::append() called after makeBuckets().") ;
+
+	GLfloat record[1 + 3*7] ;
+	vector<GLfloat> large_record ;
+
+	for(size_t i=0;i<primitive_tab.size();++i)
+	{
+		if(primitive_tab[i] == NULL)
+			continue ;
+
+		size_t n = primitive_tab[i]->nbVertices() ;
+		size_t size = recordSize(n) ;
+		GLfloat *r = record ;
+
+		if(size > sizeof(record))
+		{
+			large_record.resize(size/sizeof(GLfloat)) ;
+			r = &large_record[0] ;
+		}
+
+		r[0] = (GLfloat)n ;
+
+		for(size_t j=0;j<n;++j)
+		{
+			const Feedback3DColor& f = primitive_tab[i]->sommet3DColor(j) ;
+			GLfloat *v = r + 1 + j*Feedback3DColor::sizeInBuffer() ;
+
+			v[0] = f.x() ; v[1] = f.y() ; v[2] = f.z() ;
+			v[3] = f.red() ; v[4] = f.green() ; v[5] = f.blue() ; v[6] = f.alpha() ;
+		}
+
+		if(_write_buffer.size() + size > _write_buffer.capacity())
+			flushWriteBuffer() ;
+
+		_write_buffer.insert(_write_buffer.end(),(const char *)r,(const char *)r + size) ;
+
+		_slot_sizes[depthSlot(r)] += size ;
+		_max_record_size = max(_max_record_size,size) ;
+		++_nb_primitives ;
+
+		delete primitive_tab[i] ;
+	}
+
+	primitive_tab.clear() ;
+}
+
+void PrimitiveStream::makeBuckets()
+{
+	flushWriteBuffer() ;
+	_spill->flush() ;
+
+	// Groups depth slots into buckets, from the farthest one (largest z) to
+	// the closest one. A single slot larger than a bucket can not be split.
+
+	size_t bucket_size = max(MIN_BUCKET_SIZE,_memory_budget/BUDGET_TO_BUCKET_RATIO) ;
+	size_t current_size = 0 ;
+	size_t nb_buckets = 0 ;
+
+	_slot_bucket.resize(DEPTH_SLOTS,0) ;
+
+	for(size_t s=DEPTH_SLOTS;s-- > 0;)
+	{
+		if(current_size > 0 && current_size + _slot_sizes[s] > bucket_size)
+			current_size = 0 ;
+
+		if(current_size == 0 && _slot_sizes[s] > 0)
+			++nb_buckets ;
+
+		_slot_bucket[s] = (nb_buckets > 0)?(nb_buckets-1):0 ;
+		current_size += _slot_sizes[s] ;
+	}
+
+	for(size_t k=0;k<nb_buckets;++k)
+	{
+		_buckets.push_back(new QTemporaryFile) ;
+
+		if(!_buckets.back()->open())
+			throw runtime_error("Could not create temporary file for primitive streaming.") ;
+	}
+
+	// Distributes the records, reading the spill file through a sliding
+	// memory mapped window. Writes are buffered per bucket, within the budget.
+
+	vector<vector<char> > buffers(nb_buckets) ;
+	size_t buffer_size = max((size_t)4096,min(WRITE_BUFFER_SIZE,_memory_budget/(4*max((size_t)1,nb_buckets)))) ;
+
+	size_t window = max(_max_record_size,min(MAX_MAP_WINDOW,max((size_t)4096,_memory_budget/4))) ;
+	qint64 file_size = _spill->size() ;
+	qint64 offset = 0 ;
+
+	while(offset < file_size)
+	{
+		qint64 length = min((qint64)window,file_size - offset) ;
+		uchar *data = _spill->map(offset,length) ;
+
+		if(data == NULL)
+			throw runtime_error("Could not map temporary file for primitive streaming.") ;
+
+		qint64 pos = 0 ;
+
+		while(pos + (qint64)sizeof(GLfloat) <= length)
+		{
+			const GLfloat *record = (const GLfloat *)(data + pos) ;
+			size_t size = recordSize((size_t)record[0]) ;
+
+			if(pos + (qint64)size > length)
+				break ;
+
+			size_t k = _slot_bucket[depthSlot(record)] ;
+
+			if(buffers[k].size() + size > buffer_size)
+			{
+				if(_buckets[k]->write(&buffers[k][0],buffers[k].size()) != (qint64)buffers[k].size())
+					throw runtime_error("Could not write temporary file for primitive streaming. Disk full ?") ;
+
+				buffers[k].clear() ;
+			}
+
+			buffers[k].insert(buffers[k].end(),(const char *)record,(const char *)record + size) ;
+			pos += size ;
+		}
+
+		_spill->unmap(data) ;
+		offset += pos ;
+	}
+
+	for(size_t k=0;k<nb_buckets;++k)
+	{
+		if(!buffers[k].empty() && _buckets[k]->write(&buffers[k][0],buffers[k].size()) != (qint64)buffers[k].size())
+			throw runtime_error("Could not write temporary file for primitive streaming. Disk full ?") ;
+
+		_buckets[k]->flush() ;
+	}
+
+	// The spill file is not needed anymore.
+
+	delete _spill ;
+	_spill = NULL ;
+}
+
+void PrimitiveStream::readBucket(size_t k,vector<PtrPrimitive>& primitive_tab)
+{
+	if(k >= _buckets.size() || _buckets[k] == NULL)
+		throw runtime_error("PrimitiveStream::readBucket(): no such bucket.") ;
+
+	qint64 length = _buckets[k]->size() ;
+
+	if(length > 0)
+	{
+		uchar *data = _buckets[k]->map(0,length) ;
+
+		if(data == NULL)
+			throw runtime_error("Could not map temporary file for primitive streaming.") ;
+
+		vector<Feedback3DColor> verts ;
+		qint64 pos = 0 ;
+
+		while(pos < length)
+		{
+			const GLfloat *record = (const GLfloat *)(data + pos) ;
+			size_t n = (size_t)record[0] ;
+			const GLfloat *v = record + 1 ;
+
+			switch(n)
+			{
+				case 1: primitive_tab.push_back(new Point(Feedback3DColor(v))) ;
+					break ;
+				case 2: primitive_tab.push_back(new Segment(Feedback3DColor(v),Feedback3DColor(v+Feedback3DColor::sizeInBuffer()))) ;
+					break ;
+				default:
+					verts.clear() ;
+
+					for(size_t j=0;j<n;++j)
+						verts.push_back(Feedback3DColor(v + j*Feedback3DColor::sizeInBuffer())) ;
+
+					primitive_tab.push_back(new Polygone(verts)) ;
+			}
+
+			pos += recordSize(n) ;
+		}
+
+		_buckets[k]->unmap(data) ;
+	}
+
+	delete _buckets[k] ;
+	_buckets[k] = NULL ;
+}
@@ -0,0 +1,107 @@
+/*
+ This file is part of the VRender library.
+ Copyright (C) 2005 Cyril Soler (Cyril.Soler@imag.fr)
+ Version 1.0.0, released on June 27, 2005.
+
+ http://artis.imag.fr/Members/Cyril.Soler/VRender
+
+ VRender is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 2 of the License, or
+ (at your option) any later version.
+
+ VRender is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with VRender; if not, write to the Free Software Foundation, Inc.,
+ 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+/****************************************************************************
+
+ Copyright (C) 2002-2014 Gilles Debunne. All rights reserved.
+
+ This file is part of the QGLViewer library version 2.6.3.
+
+ http://www.libqglviewer.com - contact@libqglviewer.com
+
+ This file may be used under the terms of the GNU General Public License 
+ versions 2.0 or 3.0 as published by the Free Software Foundation and
+ appearing in the LICENSE file included in the packaging of this file.
+ In addition, as a special exception, Gilles Debunne gives you certain 
+ additional rights, described in the file GPL_EXCEPTION in this package.
+
+ libQGLViewer uses dual licensing. Commercial/proprietary software must
+ purchase a libQGLViewer Commercial License.
+
+ This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+ WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+
+*****************************************************************************/
+
+
+#ifndef _VRENDER_PRIMITIVESTREAM_H
+#define _VRENDER_PRIMITIVESTREAM_H
+
+//  This class stores primitives in temporary files instead of memory, so that
+// scenes larger than the available memory can be exported. Primitives are
+// appended in any order, then given back by slices of depth (buckets), from
+// the farthest to the closest, each of them small enough to be sorted and
+// exported within a given memory budget.
+
+#include <vector>
+#include "Types.h"
+
+class QTemporaryFile ;
+
+namespace vrender
+{
+	class PrimitiveStream
+	{
+		public:
+			PrimitiveStream(size_t memory_budget) ;
+			~PrimitiveStream() ;
+
+			//  Range of the z coordinate of the primitives to come. Must be called
+			// before the first append().
+			void setDepthRange(GLfloat zmin,GLfloat zmax) ;
+
+			//  Writes the primitives to the temporary file, deletes them and clears
+			// the array. NULL primitives are skipped.
+			void append(std::vector<PtrPrimitive>& primitive_tab) ;
+
+			//  Distributes the primitives into depth buckets. Nothing can be appended
+			// afterwards.
+			void makeBuckets() ;
+
+			size_t nbPrimitives() const { return _nb_primitives ; }
+			size_t nbBuckets() const { return _buckets.size() ; }
+
+			//  Appends the primitives of bucket k to primitive_tab. Bucket 0 is the
+			// farthest one. Each bucket can only be read once.
+			void readBucket(size_t k,std::vector<PtrPrimitive>& primitive_tab) ;
+
+		private:
+			size_t depthSlot(const GLfloat *record) const ;
+			void flushWriteBuffer() ;
+
+			size_t _memory_budget ;
+			size_t _nb_primitives ;
+			size_t _max_record_size ;
+
+			GLfloat _zmin ;
+			GLfloat _zmax ;
+
+			QTemporaryFile *_spill ;
+			std::vector<char> _write_buffer ;
+
+			std::vector<size_t> _slot_sizes ;
+			std::vector<size_t> _slot_bucket ;
+			std::vector<QTemporaryFile *> _buckets ;
+	};
+}
+
+#endif
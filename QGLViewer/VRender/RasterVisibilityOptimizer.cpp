@@ -0,0 +1,305 @@
+/*
+ This file is part of the VRender library.
+ Copyright (C) 2005 Cyril Soler (Cyril.Soler@imag.fr)
+ Version 1.0.0, released on June 27, 2005.
+
+ http://artis.imag.fr/Members/Cyril.Soler/VRender
+
+ VRender is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 2 of the License, or
+ (at your option) any later version.
+
+ VRender is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with VRender; if not, write to the Free Software Foundation, Inc.,
+ 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+/****************************************************************************
+
+ Copyright (C) 2002-2014 Gilles Debunne. All rights reserved.
+
+ This file is part of the QGLViewer library version 2.6.3.
+
+ http://www.libqglviewer.com - contact@libqglviewer.com
+
+ This file may be used under the terms of the GNU General Public License 
+ versions 2.0 or 3.0 as published by the Free Software Foundation and
+ appearing in the LICENSE file included in the packaging of this file.
+ In addition, as a special exception, Gilles Debunne gives you certain 
+ additional rights, described in the file GPL_EXCEPTION in this package.
+
+ libQGLViewer uses dual licensing. Commercial/proprietary software must
+ purchase a libQGLViewer Commercial License.
+
+ This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+ WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+
+*****************************************************************************/
+
+
+#include <vector>
+#include <algorithm>
+#include <float.h>
+#include <math.h>
+#include <QRunnable>
+#include <QSemaphore>
+#include <QThread>
+#include <QThreadPool>
+#include "VRender.h"
+#include "Optimizer.h"
+#include "Primitive.h"
+
+using namespace vrender ;
+using namespace std ;
+
+//  The item buffer is split in horizontal bands, rasterized in parallel. Each band
+// goes through all primitives in reverse rendering order, and records which primitives
+// touch at least one of its pixels, and which ones touch a pixel that no later polygon
+// covers. A pixel owned by a polygon at the end of a rendering order pass is exactly a
+// pixel it touches that no later polygon covers, so polygons get the same result.
+// Only polygons cover pixels: as in VisibilityOptimizer, segments and points can be
+// culled, but never hide anything.
+
+namespace vrender
+{
+	class RasterBand: public QRunnable
+	{
+		public:
+			enum { Written = 0x1, Visible = 0x2 } ;
+
+			RasterBand(	const vector<PtrPrimitive>& primitives,
+							const vector<float>& yranges,
+							double xmin,double ymin,double scale,
+							int width,int ymin_pixel,int ymax_pixel,
+							vector<unsigned char>& flags,QSemaphore *done)
+				: _primitives(primitives),_yranges(yranges),_xmin(xmin),_ymin(ymin),_scale(scale),
+				  _width(width),_y0(ymin_pixel),_y1(ymax_pixel),_flags(flags),_done(done)
+			{
+				setAutoDelete(true) ;
+			}
+
+			virtual void run() ;
+
+		private:
+			inline double px(const Vector3& v) const { return (v.x() - _xmin)*_scale ; }
+			inline double py(const Vector3& v) const { return (v.y() - _ymin)*_scale ; }
+
+			//  Records that the current primitive touches pixel k, which it covers
+			// if it is a polygon.
+
+			inline void touchPixel(size_t k,bool cover)
+			{
+				_current |= Written ;
+
+				if(!_covered[k])
+				{
+					_current |= Visible ;
+
+					if(cover)
+						_covered[k] = 1 ;
+				}
+			}
+
+			inline void setPixel(int x,int y)
+			{
+				if(x >= 0 && x < _width && y >= _y0 && y < _y1)
+					touchPixel((size_t)(y-_y0)*_width+x,false) ;
+			}
+
+			void rasterTriangle(double x0,double y0,double x1,double y1,double x2,double y2) ;
+			void rasterSegment(double x0,double y0,double x1,double y1) ;
+
+			const vector<PtrPrimitive>& _primitives ;
+			const vector<float>& _yranges ;	// min and max pixel rows of each primitive
+			double _xmin,_ymin,_scale ;
+			int _width,_y0,_y1 ;
+			vector<unsigned char> _covered ;	// pixels covered by a later polygon
+			unsigned char _current ;	// flags of the primitive being rasterized
+			vector<unsigned char>& _flags ;
+			QSemaphore *_done ;
+	};
+}
+
+void RasterBand::run()
+{
+	_covered.assign((size_t)_width*(_y1-_y0),0) ;
+
+	for(size_t i=_primitives.size();i-- > 0;)
+	{
+		const Primitive *p = _primitives[i] ;
+
+		if(p == NULL)
+			continue ;
+
+		// Quickly skip primitives outside of the band.
+
+		if(_yranges[2*i+1] < _y0 || _yranges[2*i] >= _y1)
+			continue ;
+
+		_current = 0 ;
+
+		switch(p->type())
+		{
+			case Primitive::POINT:
+				setPixel((int)floor(px(p->vertex(0))),(int)floor(py(p->vertex(0)))) ;
+				break ;
+
+			case Primitive::SEGMENT:
+				rasterSegment(px(p->vertex(0)),py(p->vertex(0)),px(p->vertex(1)),py(p->vertex(1))) ;
+				break ;
+
+			case Primitive::POLYGON:
+				// Feedback polygons are convex: a fan is fine.
+
+				for(size_t j=1;j+1<p->nbVertices();++j)
+					rasterTriangle(	px(p->vertex(0)),py(p->vertex(0)),
+											px(p->vertex(j)),py(p->vertex(j)),
+											px(p->vertex(j+1)),py(p->vertex(j+1))) ;
+				break ;
+		}
+
+		_flags[i] |= _current ;
+	}
+
+	_done->release() ;
+}
+
+//  Fills pixels whose center is inside the triangle.
+
+void RasterBand::rasterTriangle(double x0,double y0,double x1,double y1,double x2,double y2)
+{
+	double area = (x1-x0)*(y2-y0) - (x2-x0)*(y1-y0) ;
+
+	if(area == 0.0)
+		return ;
+
+	if(area < 0.0)
+	{
+		swap(x1,x2) ;
+		swap(y1,y2) ;
+	}
+
+	int xmin = max(0,(int)floor(min(x0,min(x1,x2)))) ;
+	int xmax = min(_width-1,(int)ceil(max(x0,max(x1,x2)))) ;
+	int ymin = max(_y0,(int)floor(min(y0,min(y1,y2)))) ;
+	int ymax = min(_y1-1,(int)ceil(max(y0,max(y1,y2)))) ;
+
+	for(int y=ymin;y<=ymax;++y)
+	{
+		double cy = y+0.5 ;
+
+		for(int x=xmin;x<=xmax;++x)
+		{
+			double cx = x+0.5 ;
+
+			if((x1-x0)*(cy-y0) - (y1-y0)*(cx-x0) >= 0.0 &&
+				(x2-x1)*(cy-y1) - (y2-y1)*(cx-x1) >= 0.0 &&
+				(x0-x2)*(cy-y2) - (y0-y2)*(cx-x2) >= 0.0)
+				touchPixel((size_t)(y-_y0)*_width+x,true) ;
+		}
+	}
+}
+
+void RasterBand::rasterSegment(double x0,double y0,double x1,double y1)
+{
+	int nb_steps = (int)ceil(max(fabs(x1-x0),fabs(y1-y0))) ;
+
+	if(nb_steps == 0)
+	{
+		setPixel((int)floor(x0),(int)floor(y0)) ;
+		return ;
+	}
+
+	double dx = (x1-x0)/nb_steps ;
+	double dy = (y1-y0)/nb_steps ;
+
+	for(int k=0;k<=nb_steps;++k)
+		setPixel((int)floor(x0+k*dx),(int)floor(y0+k*dy)) ;
+}
+
+void RasterVisibilityOptimizer::optimize(vector<PtrPrimitive>& primitives,VRenderParams& vparams)
+{
+	// 1 - computes the item buffer size from the bounding box of the primitives.
+
+	double minx =  FLT_MAX ;
+	double miny =  FLT_MAX ;
+	double maxx = -FLT_MAX ;
+	double maxy = -FLT_MAX ;
+
+	for(size_t i=0;i<primitives.size();++i)
+		if(primitives[i] != NULL)
+			for(size_t j=0;j<primitives[i]->nbVertices();++j)
+			{
+				if(maxx < primitives[i]->vertex(j).x()) maxx = primitives[i]->vertex(j).x() ;
+				if(maxy < primitives[i]->vertex(j).y()) maxy = primitives[i]->vertex(j).y() ;
+				if(minx > primitives[i]->vertex(j).x()) minx = primitives[i]->vertex(j).x() ;
+				if(miny > primitives[i]->vertex(j).y()) miny = primitives[i]->vertex(j).y() ;
+			}
+
+	if(minx > maxx)
+		return ;
+
+	int resolution = max(1,vparams.rasterResolution()) ;
+	double span = max(maxx-minx,maxy-miny) ;
+	double scale = (span > 0.0)?(resolution/span):1.0 ;
+
+	int width  = min(resolution,(int)ceil((maxx-minx)*scale)+1) ;
+	int height = min(resolution,(int)ceil((maxy-miny)*scale)+1) ;
+
+	vector<float> yranges(2*primitives.size(),0.0f) ;
+
+	for(size_t i=0;i<primitives.size();++i)
+		if(primitives[i] != NULL)
+		{
+			AxisAlignedBox_xyz B(primitives[i]->bbox()) ;
+
+			yranges[2*i]   = (float)floor((B.mini().y()-miny)*scale) ;
+			yranges[2*i+1] = (float)ceil((B.maxi().y()-miny)*scale) ;
+		}
+
+	// 2 - rasterizes bands in parallel.
+
+	int nb_bands = max(1,min(height,QThread::idealThreadCount())) ;
+	vector< vector<unsigned char> > flags(nb_bands,vector<unsigned char>(primitives.size(),0)) ;
+	QSemaphore done ;
+
+	vparams.progress(0.0, QGLViewer::tr("Visibility optimization")) ;
+
+	for(int b=0;b<nb_bands;++b)
+		QThreadPool::globalInstance()->start(new RasterBand(primitives,yranges,minx,miny,scale,width,
+																			(b*height)/nb_bands,((b+1)*height)/nb_bands,
+																			flags[b],&done)) ;
+	done.acquire(nb_bands) ;
+
+	// 3 - culls primitives which were drawn, but were entirely covered by later polygons.
+
+	int nb_culled = 0 ;
+
+	for(size_t i=0;i<primitives.size();++i)
+		if(primitives[i] != NULL)
+		{
+			unsigned char f = 0 ;
+
+			for(int b=0;b<nb_bands;++b)
+				f |= flags[b][i] ;
+
+			if(f == RasterBand::Written)
+			{
+				delete primitives[i] ;
+				primitives[i] = NULL ;
+				++nb_culled ;
+			}
+		}
+
+	vparams.progress(1.0, QGLViewer::tr("Visibility optimization")) ;
+
+#ifdef DEBUG_VO
+	cout << nb_culled << " primitives culled over " << primitives.size() << "." << endl ;
+#endif
+}
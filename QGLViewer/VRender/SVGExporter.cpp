@@ -0,0 +1,217 @@
+/*
+ This file is part of the VRender library.
+ Copyright (C) 2005 Cyril Soler (Cyril.Soler@imag.fr)
+ Version 1.0.0, released on June 27, 2005.
+
+ http://artis.imag.fr/Members/Cyril.Soler/VRender
+
+ VRender is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 2 of the License, or
+ (at your option) any later version.
+
+ VRender is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with VRender; if not, write to the Free Software Foundation, Inc.,
+ 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+/****************************************************************************
+
+ Copyright (C) 2002-2014 Gilles Debunne. All rights reserved.
+
+ This file is part of the QGLViewer library version 2.6.3.
+
+ http://www.libqglviewer.com - contact@libqglviewer.com
+
+ This file may be used under the terms of the GNU General Public License 
+ versions 2.0 or 3.0 as published by the Free Software Foundation and
+ appearing in the LICENSE file included in the packaging of this file.
+ In addition, as a special exception, Gilles Debunne gives you certain 
+ additional rights, described in the file GPL_EXCEPTION in this package.
+
+ libQGLViewer uses dual licensing. Commercial/proprietary software must
+ purchase a libQGLViewer Commercial License.
+
+ This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+ WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+
+*****************************************************************************/
+
+
+#include "Primitive.h"
+#include "Exporter.h"
+#include "math.h"
+
+using namespace vrender ;
+using namespace std ;
+
+// Number of decimals of the coordinates (1/100 of a pixel).
+
+const int SVGExporter::SVG_DECIMALS = 2 ;
+
+SVGExporter::SVGExporter()
+{
+	_pathKind = NO_PATH ;
+	_pathColor = 0 ;
+}
+
+Exporter *SVGExporter::clone() const { return new SVGExporter(*this) ; }
+
+void SVGExporter::skipPrimitives(const vector<PtrPrimitive>& primitive_tab,size_t begin,size_t end)
+{
+	//  The current path only depends on the last primitive that was drawn.
+
+	for(size_t i=end;i>begin;--i)
+		if(primitive_tab[i-1] != NULL && primitive_tab[i-1]->nbVertices() > 0)
+		{
+			ExportBuffer scratch(_referenceFormatting) ;
+			spewPrimitive(primitive_tab[i-1],scratch) ;
+			return ;
+		}
+}
+
+void SVGExporter::writeHeader(QTextStream& out) const
+{
+	// The y axis points downwards in SVG.
+
+	out << "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"no\"?>\n";
+	out << "<svg xmlns=\"http://www.w3.org/2000/svg\" version=\"1.1\" width=\"" << (_xmax - _xmin) << "\" height=\"" << (_ymax - _ymin)
+		 << "\" viewBox=\"0 0 " << (_xmax - _xmin) << " " << (_ymax - _ymin) << "\">\n";
+	out << "<!-- Created by the VRender library - (c) Cyril Soler 2005 (using OpenGL feedback) -->\n";
+
+	if(_clearBG)
+		out << "<rect width=\"100%\" height=\"100%\" fill=\"rgb(" << int(0.5f + 255*_clearR) << "," << int(0.5f + 255*_clearG) << "," << int(0.5f + 255*_clearB) << ")\"/>\n";
+}
+
+void SVGExporter::writeFooter(QTextStream& out) const
+{
+	if(_pathKind != NO_PATH)
+		out << "\"/>\n";
+
+	out << "</svg>\n";
+}
+
+//  Continues the current path if it has the same kind and color, otherwise
+// closes it and starts a new one.
+
+void SVGExporter::setPath(ExportBuffer& out,PathKind kind,float red,float green,float blue)
+{
+	static const char HEX[] = "0123456789abcdef" ;
+
+	unsigned int r = (unsigned int)(0.5f + 255*max(0.0f,min(1.0f,red))) ;
+	unsigned int g = (unsigned int)(0.5f + 255*max(0.0f,min(1.0f,green))) ;
+	unsigned int b = (unsigned int)(0.5f + 255*max(0.0f,min(1.0f,blue))) ;
+	unsigned int color = (r << 16) | (g << 8) | b ;
+
+	if(kind == _pathKind && color == _pathColor)
+		return ;
+
+	if(_pathKind != NO_PATH)
+		out << "\"/>\n" ;
+
+	char hex[8] = { '#', HEX[r >> 4], HEX[r & 15], HEX[g >> 4], HEX[g & 15], HEX[b >> 4], HEX[b & 15], 0 } ;
+
+	switch(kind)
+	{
+		case POLYGON_PATH: out << "<path fill=\"" << hex << "\" d=\"" ;
+			break ;
+		case SEGMENT_PATH: out << "<path fill=\"none\" stroke=\"" << hex << "\" d=\"" ;
+			break ;
+		case POINT_PATH:   out << "<path fill=\"none\" stroke=\"" << hex << "\" stroke-width=\"" << _pointSize << "\" stroke-linecap=\"round\" d=\"" ;
+			break ;
+		case NO_PATH:
+			break ;
+	}
+
+	_pathKind = kind ;
+	_pathColor = color ;
+}
+
+void SVGExporter::spewVertex(ExportBuffer& out,char command,const Feedback3DColor& v)
+{
+	if(command != 0)
+		out << command ;
+	else
+		out << ' ' ;
+
+	out.appendFixed(v.x() - _xmin,SVG_DECIMALS) << ' ' ;
+	out.appendFixed(_ymax - v.y(),SVG_DECIMALS) ;
+}
+
+void SVGExporter::spewPoint(const Point *P, ExportBuffer& out)
+{
+	const Feedback3DColor& p = P->sommet3DColor(0) ;
+
+	if(_blackAndWhite)
+		setPath(out,POINT_PATH,0.0,0.0,0.0) ;
+	else
+		setPath(out,POINT_PATH,p.red(),p.green(),p.blue()) ;
+
+	// A zero length line with round caps is drawn as a disc.
+
+	spewVertex(out,'M',p) ;
+	out << "h0" ;
+}
+
+void SVGExporter::spewSegment(const Segment *S, ExportBuffer& out)
+{
+	const Feedback3DColor& P1 = S->sommet3DColor(0) ;
+	const Feedback3DColor& P2 = S->sommet3DColor(1) ;
+
+	// SVG has no color interpolation along lines: smooth segments get their mean color.
+
+	if(_blackAndWhite)
+		setPath(out,SEGMENT_PATH,0.0,0.0,0.0) ;
+	else
+		setPath(out,SEGMENT_PATH,0.5f*(P1.red()+P2.red()),0.5f*(P1.green()+P2.green()),0.5f*(P1.blue()+P2.blue())) ;
+
+	spewVertex(out,'M',P1) ;
+	spewVertex(out,'L',P2) ;
+}
+
+void SVGExporter::spewPolygone(const Polygone *P, ExportBuffer& out)
+{
+	int nvertices = P->nbVertices() ;
+
+	if(nvertices == 0)
+		return ;
+
+	// Smooth shaded polygons are drawn with their mean color, like in XFig.
+
+	GLfloat red = 0, green = 0, blue = 0 ;
+	double area = 0.0 ;
+
+	for(int i=0;i<nvertices;++i)
+	{
+		const Feedback3DColor& v1 = P->sommet3DColor(i) ;
+		const Feedback3DColor& v2 = P->sommet3DColor((i+1)%nvertices) ;
+
+		red   += v1.red() ;
+		green += v1.green() ;
+		blue  += v1.blue() ;
+
+		area += v1.x()*v2.y() - v2.x()*v1.y() ;
+	}
+
+	if(_blackAndWhite)
+		setPath(out,POLYGON_PATH,1.0,1.0,1.0) ;
+	else
+		setPath(out,POLYGON_PATH,red/nvertices,green/nvertices,blue/nvertices) ;
+
+	//  All polygons of a path are given the same orientation, so that overlapping
+	// ones do not cancel each other with the nonzero fill rule.
+
+	if(area >= 0.0)
+		for(int j=0;j<nvertices;++j)
+			spewVertex(out,(j == 0)?'M':((j == 1)?'L':0),P->sommet3DColor(j)) ;
+	else
+		for(int j=nvertices-1;j>=0;--j)
+			spewVertex(out,(j == nvertices-1)?'M':((j == nvertices-2)?'L':0),P->sommet3DColor(j)) ;
+
+	out << 'Z' ;
+}
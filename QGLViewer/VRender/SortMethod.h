@@ -46,6 +46,7 @@
 #define _SORTMETHOD_H
 
 #include <vector>
+#include <QtGlobal>
 #include "Types.h"
 
 namespace vrender
@@ -79,10 +80,46 @@ namespace vrender
 	class BSPSortMethod: public SortMethod
 	{
 		public:
-			BSPSortMethod() {} ;
+			BSPSortMethod() : _nb_splits(0), _nb_nodes(0), _depth(0) {} ;
 			virtual ~BSPSortMethod() {}
 
 			virtual void sortPrimitives(std::vector<PtrPrimitive>&,VRenderParams&) ;
+
+			// Statistics of the BSP built by the last call to sortPrimitives().
+			size_t nbSplits() const { return _nb_splits ; }
+			size_t nbNodes() const { return _nb_nodes ; }
+			size_t depth() const { return _depth ; }
+		private:
+			size_t _nb_splits ;
+			size_t _nb_nodes ;
+			size_t _depth ;
+	};
+
+	//  What a topological sort keeps from one render to the next one (see
+	// VRenderSortCache): the relative positions of the candidate pairs of
+	// primitives, each with the relative position of the screen bounding boxes
+	// of the pair when it was computed, and the rendering order. Primitives are
+	// identified by their index, so the state only applies to the next sort if
+	// it is given the same number of primitives, with the same number of
+	// vertices each.
+
+	class TopologicalSortState
+	{
+		public:
+			TopologicalSortState() : tolerance(1.0f) {}
+
+			void clear() ;
+
+			bool matches(const std::vector<PtrPrimitive>&) const ;
+			void setPrimitives(const std::vector<PtrPrimitive>&) ;
+
+			float tolerance ;		// in pixels
+
+			std::vector<size_t> nb_vertices ;
+			std::vector<quint64> pairs ;		// sorted, see TopologicalSortUtils::PositionCache
+			std::vector<int> positions ;
+			std::vector<float> offsets ;		// 4 per pair: bbox(j) - bbox(i), min and max corners
+			std::vector<size_t> order ;
 	};
 
 	class TopologicalSortMethod: public SortMethod
@@ -94,8 +131,16 @@ namespace vrender
 			virtual void sortPrimitives(std::vector<PtrPrimitive>&,VRenderParams&) ;
 
 			void setBreakCycles(bool b) { _break_cycles = b ; }
+
+			// Statistics of the relative position cache, for the last call to sortPrimitives().
+			size_t nbCacheHits() const { return _nb_cache_hits ; }
+			size_t nbCacheMisses() const { return _nb_cache_misses ; }
+			size_t nbReusedPositions() const { return _nb_reused_positions ; }
 		private:
 			bool _break_cycles ;
+			size_t _nb_cache_hits ;
+			size_t _nb_cache_misses ;
+			size_t _nb_reused_positions ;
 	};
 }
 
@@ -44,6 +44,12 @@
 
 #include <assert.h>
 #include <climits>
+#include <math.h>
+#include <algorithm>
+#include <QRunnable>
+#include <QSemaphore>
+#include <QThread>
+#include <QThreadPool>
 
 #include "VRender.h"
 #include "Primitive.h"
@@ -62,13 +68,46 @@ namespace vrender
 class TopologicalSortUtils
 {
 	public:
-		static void buildPrecedenceGraph(vector<PtrPrimitive>& primitive_tab, vector< vector<size_t> >& precedence_graph) ;
+		//  Relative positions of all candidate pairs, as sorted ordered pairs of
+		// primitive indices. The quadtree puts primitives that overlap several
+		// cells in each of them, so that the same pair can be met in several leaves:
+		// duplicates are removed before any position is computed.
+
+		struct PositionCache
+		{
+			PositionCache() : nb_hits(0), nb_misses(0), nb_reused(0) {}
+
+			static quint64 key(size_t a,size_t b) { return (quint64(a) << 32) | quint64(b) ; }
+
+			vector<quint64> pairs ;
+			vector<int> positions ;
+			size_t nb_hits ;
+			size_t nb_misses ;
+			size_t nb_reused ;		// positions taken from a TopologicalSortState
+		} ;
+
+		//  A quadtree cell that still has to be refined. The first levels of the
+		// quadtree are built in the calling thread, and the resulting cells are then
+		// refined in parallel.
+
+		struct QuadtreeCell
+		{
+			vector<size_t> pindices ;
+			AxisAlignedBox_xy bbox ;
+		} ;
+
+		static void buildPrecedenceGraph(vector<PtrPrimitive>& primitive_tab, vector< vector<size_t> >& precedence_graph, PositionCache& cache, TopologicalSortState *state) ;
 
 		static void recursFindNeighbors(	const vector<PtrPrimitive>& primitive_tab,
 													const vector<size_t>& pindices,
-													vector< vector<size_t> >& precedence_graph,
+													vector<quint64>& pairs,
+													vector<QuadtreeCell> *cells,
 													const AxisAlignedBox_xy&,int) ;
 
+		static void computeRelativePositions(const vector<PtrPrimitive>& primitive_tab,PositionCache& cache,size_t first,size_t nb) ;
+		static void computeAllRelativePositions(const vector<PtrPrimitive>& primitive_tab,PositionCache& cache) ;
+		static void updateRelativePositions(const vector<PtrPrimitive>& primitive_tab,PositionCache& cache,TopologicalSortState& state) ;
+
 		static void checkAndAddEdgeToGraph(size_t a,size_t b,vector< vector<size_t> >& precedence_graph) ;
 		static void suppressPrecedence(size_t a,size_t b,vector< vector<size_t> >& precedence_graph) ;
 
@@ -76,7 +115,7 @@ class TopologicalSortUtils
 													 vector<PtrPrimitive>& primitive_tab,
 													 vector<bool>& alread_rendered,
 													 vector<bool>& alread_visited,
-													 vector<PtrPrimitive>&,size_t,size_t&,
+													 vector<size_t>&,size_t,size_t&,
 													 VRenderParams& vparams,
 													 size_t info_cnt,size_t& nbrendered) ;
 
@@ -84,18 +123,26 @@ class TopologicalSortUtils
 													 vector<PtrPrimitive>& primitive_tab,
 													 vector<bool>& alread_rendered,
 													 vector<bool>& alread_visited,
-													 vector<PtrPrimitive>&,size_t,
+													 vector<size_t>&,size_t,
 													 vector<size_t>& ancestors,
 													 size_t&, size_t&,
 													 VRenderParams& vparams,
 													 size_t info_cnt,size_t& nbrendered) ;
 
+		//  Both sorts start from the primitives of first_order, in this order,
+		// so that an order that is still valid is kept. The indices of the
+		// sorted primitives are returned in order.
+
 		static void topologicalSort(	vector< vector<size_t> >& precedence_graph,
 												vector<PtrPrimitive>& primitive_tab,
+												const vector<size_t>& first_order,
+												vector<size_t>& order,
 												VRenderParams&) ;
 
 		static void topologicalSortBreakCycles(vector< vector<size_t> >& precedence_graph,
 															vector<PtrPrimitive>& primitive_tab,
+															const vector<size_t>& first_order,
+															vector<size_t>& order,
 															VRenderParams&) ;
 
 #ifdef DEBUG_TS
@@ -107,10 +154,55 @@ class TopologicalSortUtils
 TopologicalSortMethod::TopologicalSortMethod()
 {
 	_break_cycles = false ;
+	_nb_cache_hits = 0 ;
+	_nb_cache_misses = 0 ;
+	_nb_reused_positions = 0 ;
+}
+
+void TopologicalSortState::clear()
+{
+	nb_vertices.clear() ;
+	pairs.clear() ;
+	positions.clear() ;
+	offsets.clear() ;
+	order.clear() ;
+}
+
+bool TopologicalSortState::matches(const vector<PtrPrimitive>& primitive_tab) const
+{
+	if(primitive_tab.size() != nb_vertices.size())
+		return false ;
+
+	for(size_t i=0;i<primitive_tab.size();++i)
+		if(primitive_tab[i]->nbVertices() != nb_vertices[i])
+			return false ;
+
+	return true ;
+}
+
+void TopologicalSortState::setPrimitives(const vector<PtrPrimitive>& primitive_tab)
+{
+	nb_vertices.resize(primitive_tab.size()) ;
+
+	for(size_t i=0;i<primitive_tab.size();++i)
+		nb_vertices[i] = primitive_tab[i]->nbVertices() ;
 }
 
 void TopologicalSortMethod::sortPrimitives(vector<PtrPrimitive>& primitive_tab,VRenderParams& vparams)
 {
+	// 0 - the state of the previous sort (see VRenderSortCache) only applies to
+	//     the same primitives.
+
+	TopologicalSortState *state = vparams.sortState() ;
+
+	if(state != NULL && !state->matches(primitive_tab))
+	{
+		state->clear() ;
+		state->setPrimitives(primitive_tab) ;
+	}
+
+	size_t nb_primitives = primitive_tab.size() ;
+
 	// 1 - build a precedence graph
 
 #ifdef DEBUG_TS
@@ -120,9 +212,15 @@ void TopologicalSortMethod::sortPrimitives(vector<PtrPrimitive>& primitive_tab,V
 	cout << endl ;
 #endif
 	vector< vector<size_t> > precedence_graph(primitive_tab.size());
-	TopologicalSortUtils::buildPrecedenceGraph(primitive_tab,precedence_graph) ;
+	TopologicalSortUtils::PositionCache cache ;
+	TopologicalSortUtils::buildPrecedenceGraph(primitive_tab,precedence_graph,cache,state) ;
+
+	_nb_cache_hits = cache.nb_hits ;
+	_nb_cache_misses = cache.nb_misses ;
+	_nb_reused_positions = cache.nb_reused ;
 
 #ifdef DEBUG_TS
+	cout << "Relative positions: " << _nb_cache_misses << " computed, " << _nb_cache_hits << " found in cache." << endl ;
 	TopologicalSortUtils::printPrecedenceGraph(precedence_graph,primitive_tab) ;
 #endif
 	// 2 - perform a topological sorting of the graph
@@ -131,10 +229,23 @@ void TopologicalSortMethod::sortPrimitives(vector<PtrPrimitive>& primitive_tab,V
 	cout << "Sorting." << endl ;
 #endif
 
+	vector<size_t> first_order ;
+	vector<size_t> order ;
+
+	if(state != NULL)
+		first_order.swap(state->order) ;
+
 	if(_break_cycles)
-		TopologicalSortUtils::topologicalSortBreakCycles(precedence_graph, primitive_tab,vparams) ;
+		TopologicalSortUtils::topologicalSortBreakCycles(precedence_graph, primitive_tab,first_order,order,vparams) ;
 	else
-		TopologicalSortUtils::topologicalSort(precedence_graph, primitive_tab,vparams) ;
+		TopologicalSortUtils::topologicalSort(precedence_graph, primitive_tab,first_order,order,vparams) ;
+
+	//  Primitives added by splits are not in the next render.
+
+	if(state != NULL)
+		for(size_t i=0;i<order.size();++i)
+			if(order[i] < nb_primitives)
+				state->order.push_back(order[i]) ;
 
 #ifdef DEBUG_TS
 	cout << "New order: " ;
@@ -158,16 +269,102 @@ void TopologicalSortUtils::printPrecedenceGraph(const vector< vector<size_t> >&
 }
 #endif
 
+//  Finds the candidate pairs of one or more quadtree cells.
+
+class FindNeighborsTask: public QRunnable
+{
+	public:
+		FindNeighborsTask(const vector<PtrPrimitive>& primitive_tab,
+								const vector<TopologicalSortUtils::QuadtreeCell>& cells,
+								size_t first,size_t nb,
+								vector<quint64>& pairs,string& error,QSemaphore *done)
+			: _primitive_tab(primitive_tab),_cells(cells),_first(first),_nb(nb),_pairs(pairs),_error(error),_done(done)
+		{
+			setAutoDelete(true) ;
+		}
+
+		virtual void run()
+		{
+			try
+			{
+				for(size_t i=_first;i<_first+_nb;++i)
+					TopologicalSortUtils::recursFindNeighbors(_primitive_tab,_cells[i].pindices,_pairs,NULL,_cells[i].bbox,0) ;
+
+				sort(_pairs.begin(),_pairs.end()) ;
+				_pairs.erase(unique(_pairs.begin(),_pairs.end()),_pairs.end()) ;
+			}
+			catch(exception& e)
+			{
+				_error = e.what() ;
+			}
+			_done->release() ;
+		}
+
+	private:
+		const vector<PtrPrimitive>& _primitive_tab ;
+		const vector<TopologicalSortUtils::QuadtreeCell>& _cells ;
+		size_t _first ;
+		size_t _nb ;
+		vector<quint64>& _pairs ;
+		string& _error ;
+		QSemaphore *_done ;
+} ;
+
+//  Computes the relative positions of a range of candidate pairs.
+
+class RelativePositionTask: public QRunnable
+{
+	public:
+		RelativePositionTask(const vector<PtrPrimitive>& primitive_tab,
+									TopologicalSortUtils::PositionCache& cache,
+									size_t first,size_t nb,string& error,QSemaphore *done)
+			: _primitive_tab(primitive_tab),_cache(cache),_first(first),_nb(nb),_error(error),_done(done)
+		{
+			setAutoDelete(true) ;
+		}
+
+		virtual void run()
+		{
+			try
+			{
+				TopologicalSortUtils::computeRelativePositions(_primitive_tab,_cache,_first,_nb) ;
+			}
+			catch(exception& e)
+			{
+				_error = e.what() ;
+			}
+			_done->release() ;
+		}
+
+	private:
+		const vector<PtrPrimitive>& _primitive_tab ;
+		TopologicalSortUtils::PositionCache& _cache ;
+		size_t _first ;
+		size_t _nb ;
+		string& _error ;
+		QSemaphore *_done ;
+} ;
+
 void TopologicalSortUtils::buildPrecedenceGraph(vector<PtrPrimitive>& primitive_tab,
-																vector< vector<size_t> >& precedence_graph)
+																vector< vector<size_t> >& precedence_graph,
+																PositionCache& cache,
+																TopologicalSortState *state)
 {
 	// The precedence graph is constructed by first conservatively determining which
 	// primitives can possibly intersect using a quadtree. Candidate pairs of
 	// primitives are then carefully checked to compute their exact relative positionning.
 	//
-	// Because of the conservativeness of the quadtree, some pairs of primitives may be checked
-	// multiple times for intersection. Using a buffer of already computed results may proove
-	// very efficient.
+	// Because of the conservativeness of the quadtree, some pairs of primitives may be found
+	// in multiple cells. Candidate pairs are collected and made unique first, so that each
+	// pair is only checked once.
+	//
+	// Both the refinement of the quadtree and the checks are distributed over the global
+	// thread pool. Each task works on its own data, and results are merged in this thread.
+	//
+	// With a state, the checks of the previous sort are reused for the pairs that
+	// did not move relative to each other (see updateRelativePositions()).
+
+	const size_t nb_threads = (size_t)max(QThread::idealThreadCount(),1) ;
 
 	// 0 - compute bounding box of the set of primitives.
 
@@ -179,28 +376,223 @@ void TopologicalSortUtils::buildPrecedenceGraph(vector<PtrPrimitive>& primitive_
 		BBox.include(Vector2(primitive_tab[i]->bbox().maxi().x(),primitive_tab[i]->bbox().maxi().y())) ;
 	}
 
-	// 1 - recursively find pairs.
+	// 1 - recursively find pairs. The first levels of the quadtree are refined here,
+	//     until there are enough cells to keep all threads busy.
 
 	vector<size_t> pindices(primitive_tab.size()) ;
 	for(size_t j=0;j<pindices.size();++j)
 		pindices[j] = j ;
 
-	recursFindNeighbors(primitive_tab, pindices, precedence_graph, BBox,0) ;
+	vector<QuadtreeCell> cells ;
+	recursFindNeighbors(primitive_tab, pindices, cache.pairs, &cells, BBox,0) ;
+
+	size_t nb_tasks = min(nb_threads,cells.size()) ;
+	vector< vector<quint64> > task_pairs(nb_tasks) ;
+	vector<string> errors(nb_tasks) ;
+	QSemaphore done ;
+
+	for(size_t i=0;i<nb_tasks;++i)
+	{
+		size_t first = (i*cells.size())/nb_tasks ;
+		size_t last = ((i+1)*cells.size())/nb_tasks ;
+
+		QThreadPool::globalInstance()->start(new FindNeighborsTask(primitive_tab,cells,first,last-first,task_pairs[i],errors[i],&done)) ;
+	}
+
+	done.acquire((int)nb_tasks) ;
+
+	for(size_t i=0;i<nb_tasks;++i)
+	{
+		if(!errors[i].empty())
+			throw runtime_error(errors[i]) ;
+
+		cache.pairs.insert(cache.pairs.end(),task_pairs[i].begin(),task_pairs[i].end()) ;
+		vector<quint64>().swap(task_pairs[i]) ;
+	}
+
+	// 2 - merge and make pairs unique. Pairs may still appear several times when they
+	//     were found by different tasks.
+
+	size_t nb_found = cache.pairs.size() ;
+
+	sort(cache.pairs.begin(),cache.pairs.end()) ;
+	cache.pairs.erase(unique(cache.pairs.begin(),cache.pairs.end()),cache.pairs.end()) ;
+
+	cache.nb_misses = cache.pairs.size() ;
+	cache.nb_hits = nb_found - cache.pairs.size() ;
+
+	// 3 - compute relative positions of all pairs.
+
+	cache.positions.resize(cache.pairs.size()) ;
+
+	if(state != NULL)
+		updateRelativePositions(primitive_tab,cache,*state) ;
+	else
+		computeAllRelativePositions(primitive_tab,cache) ;
+
+	// 4 - add edges.
+
+	for(size_t k=0;k<cache.pairs.size();++k)
+	{
+		size_t i = (size_t)(cache.pairs[k] >> 32) ;
+		size_t j = (size_t)(cache.pairs[k] & 0xffffffff) ;
+		int prp = cache.positions[k] ;
+
+		if(prp & PrimitivePositioning::Upper) checkAndAddEdgeToGraph(j,i,precedence_graph) ;
+		if(prp & PrimitivePositioning::Lower) checkAndAddEdgeToGraph(i,j,precedence_graph) ;
+	}
+}
+
+void TopologicalSortUtils::computeRelativePositions(const vector<PtrPrimitive>& primitive_tab,PositionCache& cache,size_t first,size_t nb)
+{
+	// Compute the position of j as regard to i
+
+	for(size_t k=first;k<first+nb;++k)
+		cache.positions[k] = PrimitivePositioning::computeRelativePosition(	primitive_tab[(size_t)(cache.pairs[k] >> 32)],
+																								primitive_tab[(size_t)(cache.pairs[k] & 0xffffffff)]) ;
+}
+
+//  Computes the positions of all the pairs of the cache, in parallel.
+
+void TopologicalSortUtils::computeAllRelativePositions(const vector<PtrPrimitive>& primitive_tab,PositionCache& cache)
+{
+	static const size_t MIN_PAIRS_PER_TASK = 256 ;
+
+	const size_t nb_threads = (size_t)max(QThread::idealThreadCount(),1) ;
+
+	size_t nb_tasks = min(nb_threads,cache.pairs.size()/MIN_PAIRS_PER_TASK + 1) ;
+	vector<string> errors(nb_tasks) ;
+	QSemaphore done ;
+
+	for(size_t i=1;i<nb_tasks;++i)
+	{
+		size_t first = (i*cache.pairs.size())/nb_tasks ;
+		size_t last = ((i+1)*cache.pairs.size())/nb_tasks ;
+
+		QThreadPool::globalInstance()->start(new RelativePositionTask(primitive_tab,cache,first,last-first,errors[i],&done)) ;
+	}
+
+	// The first range is processed by the calling thread.
+
+	try
+	{
+		computeRelativePositions(primitive_tab,cache,0,cache.pairs.size()/nb_tasks) ;
+	}
+	catch(exception& e)
+	{
+		errors[0] = e.what() ;
+	}
+
+	done.acquire((int)nb_tasks-1) ;
+
+	for(size_t i=0;i<nb_tasks;++i)
+		if(!errors[i].empty())
+			throw runtime_error(errors[i]) ;
+}
+
+//  Same as computeAllRelativePositions(), reusing the positions of the state for
+// the pairs that overlapped, and whose screen bounding boxes did not move,
+// relative to each other, by more than the tolerance of the state since their
+// position was computed. The state is then updated.
+//
+//  Two primitives can only swap in depth when their projections stop
+// overlapping, which small relative motions can hardly make them do. Pairs that
+// did not overlap are always computed again, since they may start to. Offsets of
+// reused pairs are kept unchanged, so that slow drifts are still caught.
+
+void TopologicalSortUtils::updateRelativePositions(const vector<PtrPrimitive>& primitive_tab,PositionCache& cache,TopologicalSortState& state)
+{
+	vector<float> bboxes(4*primitive_tab.size()) ;
+
+	for(size_t i=0;i<primitive_tab.size();++i)
+	{
+		AxisAlignedBox_xyz bbox = primitive_tab[i]->bbox() ;
+
+		bboxes[4*i  ] = bbox.mini().x() ;
+		bboxes[4*i+1] = bbox.mini().y() ;
+		bboxes[4*i+2] = bbox.maxi().x() ;
+		bboxes[4*i+3] = bbox.maxi().y() ;
+	}
+
+	vector<float> offsets(4*cache.pairs.size()) ;
+	PositionCache missing ;
+	vector<size_t> missing_indices ;
+	size_t s = 0 ;
+
+	for(size_t k=0;k<cache.pairs.size();++k)
+	{
+		size_t i = (size_t)(cache.pairs[k] >> 32) ;
+		size_t j = (size_t)(cache.pairs[k] & 0xffffffff) ;
+		float *offset = &offsets[4*k] ;
+
+		for(int c=0;c<4;++c)
+			offset[c] = bboxes[4*j+c] - bboxes[4*i+c] ;
+
+		// Both arrays of pairs are sorted.
+
+		while(s < state.pairs.size() && state.pairs[s] < cache.pairs[k])
+			++s ;
+
+		bool reuse = (s < state.pairs.size() && state.pairs[s] == cache.pairs[k] && state.positions[s] != PrimitivePositioning::Independent) ;
+
+		for(int c=0;c<4 && reuse;++c)
+			if(!(fabs(offset[c] - state.offsets[4*s+c]) <= state.tolerance))
+				reuse = false ;
+
+		if(reuse)
+		{
+			cache.positions[k] = state.positions[s] ;
+
+			for(int c=0;c<4;++c)
+				offset[c] = state.offsets[4*s+c] ;
+		}
+		else
+		{
+			missing.pairs.push_back(cache.pairs[k]) ;
+			missing_indices.push_back(k) ;
+		}
+	}
+
+	missing.positions.resize(missing.pairs.size()) ;
+	computeAllRelativePositions(primitive_tab,missing) ;
+
+	for(size_t m=0;m<missing_indices.size();++m)
+		cache.positions[missing_indices[m]] = missing.positions[m] ;
+
+	cache.nb_reused = cache.pairs.size() - missing.pairs.size() ;
+
+	state.pairs = cache.pairs ;
+	state.positions = cache.positions ;
+	state.offsets.swap(offsets) ;
 }
 
+//  Refines the quadtree cell and appends candidate pairs of the leaves to pairs. If cells
+// is not NULL, refinement stops as soon as there are enough cells for all threads, and
+// the cells left to refine are appended to it.
+
 void TopologicalSortUtils::recursFindNeighbors(const vector<PtrPrimitive>& primitive_tab,
 																const vector<size_t>& pindices,
-																vector< vector<size_t> >& precedence_graph,
+																vector<quint64>& pairs,
+																vector<QuadtreeCell> *cells,
 																const AxisAlignedBox_xy& bbox,
 																int depth)
 {
 	static const size_t MAX_PRIMITIVES_IN_CELL = 5 ;
+	static const int PARALLEL_DEPTH = 3 ;
 
 	// Refinment: first decide which sub-cell each primitive meets, then call
 	// algorithm recursively.
 
-	if(primitive_tab.size() > MAX_PRIMITIVES_IN_CELL)
+	if(pindices.size() > MAX_PRIMITIVES_IN_CELL)
 	{
+		if(cells != NULL && depth == PARALLEL_DEPTH)
+		{
+			cells->push_back(QuadtreeCell()) ;
+			cells->back().pindices = pindices ;
+			cells->back().bbox = bbox ;
+			return ;
+		}
+
 		vector<size_t> p_indices_min_min ;
 		vector<size_t> p_indices_min_max ;
 		vector<size_t> p_indices_max_min ;
@@ -232,27 +624,20 @@ void TopologicalSortUtils::recursFindNeighbors(const vector<PtrPrimitive>& primi
 		if(p_indices_min_min.size() < pindices.size() && p_indices_max_min.size() < pindices.size()
 				&& p_indices_min_max.size() < pindices.size() && p_indices_max_max.size() < pindices.size())
 		{
-			recursFindNeighbors(primitive_tab,p_indices_min_min,precedence_graph,AxisAlignedBox_xy(Vector2(xmin,xMean),Vector2(ymin,yMean)),depth+1) ;
-			recursFindNeighbors(primitive_tab,p_indices_min_max,precedence_graph,AxisAlignedBox_xy(Vector2(xmin,xMean),Vector2(yMean,ymax)),depth+1) ;
-			recursFindNeighbors(primitive_tab,p_indices_max_min,precedence_graph,AxisAlignedBox_xy(Vector2(xMean,xmax),Vector2(ymin,yMean)),depth+1) ;
-			recursFindNeighbors(primitive_tab,p_indices_max_max,precedence_graph,AxisAlignedBox_xy(Vector2(xMean,xmax),Vector2(yMean,ymax)),depth+1) ;
+			recursFindNeighbors(primitive_tab,p_indices_min_min,pairs,cells,AxisAlignedBox_xy(Vector2(xmin,ymin),Vector2(xMean,yMean)),depth+1) ;
+			recursFindNeighbors(primitive_tab,p_indices_min_max,pairs,cells,AxisAlignedBox_xy(Vector2(xmin,yMean),Vector2(xMean,ymax)),depth+1) ;
+			recursFindNeighbors(primitive_tab,p_indices_max_min,pairs,cells,AxisAlignedBox_xy(Vector2(xMean,ymin),Vector2(xmax,yMean)),depth+1) ;
+			recursFindNeighbors(primitive_tab,p_indices_max_max,pairs,cells,AxisAlignedBox_xy(Vector2(xMean,yMean),Vector2(xmax,ymax)),depth+1) ;
 			return ;
 		}
 	}
 
 	// No refinment either because it could not be possible, or because the number of primitives is below
-	// the predefined limit.
+	// the predefined limit. pindices is always sorted, so (pindices[i],pindices[j]) is an ordered pair.
 
 	for(size_t i=0;i<pindices.size();++i)
 		for(size_t j=i+1;j<pindices.size();++j)
-		{
-			// Compute the position of j as regard to i
-
-			int prp = PrimitivePositioning::computeRelativePosition(	primitive_tab[pindices[i]], primitive_tab[pindices[j]]) ;
-
-			if(prp & PrimitivePositioning::Upper) checkAndAddEdgeToGraph(pindices[j],pindices[i],precedence_graph) ;
-			if(prp & PrimitivePositioning::Lower) checkAndAddEdgeToGraph(pindices[i],pindices[j],precedence_graph) ;
-		}
+			pairs.push_back(PositionCache::key(pindices[i],pindices[j])) ;
 }
 
 void TopologicalSortUtils::checkAndAddEdgeToGraph(size_t a,size_t b,vector< vector<size_t> >& precedence_graph)
@@ -294,9 +679,10 @@ void TopologicalSortUtils::suppressPrecedence(size_t a,size_t b,vector< vector<s
 
 void TopologicalSortUtils::topologicalSort(vector< vector<size_t> >& precedence_graph,
 														 vector<PtrPrimitive>& primitive_tab,
+														 const vector<size_t>& first_order,
+														 vector<size_t>& order,
 														 VRenderParams& vparams)
 {
-	vector<PtrPrimitive> new_pr_tab ;
 	vector<bool> already_visited(primitive_tab.size(),false) ;
 	vector<bool> already_rendered(primitive_tab.size(),false) ;
 	size_t nb_skews = 0 ;
@@ -306,9 +692,13 @@ void TopologicalSortUtils::topologicalSort(vector< vector<size_t> >& precedence_
 
 	// 1 - sorts primitives by rendering order
 
+	for(size_t k=0;k<first_order.size();++k)
+		if(first_order[k] < primitive_tab.size() && !already_rendered[first_order[k]])
+			recursTopologicalSort(precedence_graph,primitive_tab,already_rendered,already_visited,order,first_order[k],nb_skews,vparams,info_cnt,nbrendered);
+
 	for(size_t i=0;i<primitive_tab.size();++i)
 		if(!already_rendered[i])
-			recursTopologicalSort(precedence_graph,primitive_tab,already_rendered,already_visited,new_pr_tab,i,nb_skews,vparams,info_cnt,nbrendered);
+			recursTopologicalSort(precedence_graph,primitive_tab,already_rendered,already_visited,order,i,nb_skews,vparams,info_cnt,nbrendered);
 
 #ifdef DEBUG_TS
 	if(nb_skews > 0)
@@ -316,14 +706,22 @@ void TopologicalSortUtils::topologicalSort(vector< vector<size_t> >& precedence_
 	else
 		cout << "No cycles found." << endl ;
 #endif
+	// 2 - rendered primitives are never split, so their indices are still valid.
+
+	vector<PtrPrimitive> new_pr_tab(order.size()) ;
+
+	for(size_t k=0;k<order.size();++k)
+		new_pr_tab[k] = primitive_tab[order[k]] ;
+
 	primitive_tab = new_pr_tab ;
 }
 
 void TopologicalSortUtils::topologicalSortBreakCycles(vector< vector<size_t> >& precedence_graph,
 																		vector<PtrPrimitive>& primitive_tab,
+																		const vector<size_t>& first_order,
+																		vector<size_t>& order,
 																		VRenderParams& vparams)
 {
-	vector<PtrPrimitive> new_pr_tab ;
 	vector<bool> already_visited(primitive_tab.size(),false) ;
 	vector<bool> already_rendered(primitive_tab.size(),false) ;
 	vector<size_t> ancestors ;
@@ -335,10 +733,15 @@ void TopologicalSortUtils::topologicalSortBreakCycles(vector< vector<size_t> >&
 
 	// 1 - sorts primitives by rendering order
 
+	for(size_t k=0;k<first_order.size();++k)
+		if(first_order[k] < primitive_tab.size() && !already_rendered[first_order[k]])
+			recursTopologicalSort(precedence_graph,primitive_tab,already_rendered,already_visited,
+										order,first_order[k],ancestors,ancestors_backward_index,nb_skews,vparams,info_cnt,nbrendered) ;
+
 	for(size_t i=0;i<primitive_tab.size();++i)
 		if(!already_rendered[i])
 			recursTopologicalSort(precedence_graph,primitive_tab,already_rendered,already_visited,
-										new_pr_tab,i,ancestors,ancestors_backward_index,nb_skews,vparams,info_cnt,nbrendered) ;
+										order,i,ancestors,ancestors_backward_index,nb_skews,vparams,info_cnt,nbrendered) ;
 
 #ifdef DEBUG_TS
 	if(nb_skews > 0)
@@ -346,6 +749,13 @@ void TopologicalSortUtils::topologicalSortBreakCycles(vector< vector<size_t> >&
 	else
 		cout << "No cycles found." << endl ;
 #endif
+	// 2 - rendered primitives are never split, so their indices are still valid.
+
+	vector<PtrPrimitive> new_pr_tab(order.size()) ;
+
+	for(size_t k=0;k<order.size();++k)
+		new_pr_tab[k] = primitive_tab[order[k]] ;
+
 	primitive_tab = new_pr_tab ;
 }
 
@@ -353,7 +763,7 @@ void TopologicalSortUtils::recursTopologicalSort(	vector< vector<size_t> >& prec
 																	vector<PtrPrimitive>& primitive_tab,
 																	vector<bool>& already_rendered,
 																	vector<bool>& already_visited,
-																	vector<PtrPrimitive>& new_pr_tab,
+																	vector<size_t>& order,
 																	size_t indx,
 																	size_t& nb_cycles,
 																	VRenderParams& vparams,
@@ -374,7 +784,7 @@ void TopologicalSortUtils::recursTopologicalSort(	vector< vector<size_t> >& prec
 		{
 			if(!already_rendered[precedence_graph[indx][j]])
 				recursTopologicalSort(	precedence_graph,primitive_tab,already_rendered,already_visited,
-												new_pr_tab,precedence_graph[indx][j],nb_cycles,vparams,info_cnt,nbrendered) ;
+												order,precedence_graph[indx][j],nb_cycles,vparams,info_cnt,nbrendered) ;
 		}
 		else //  A cycle is detected, but in this version, it is not broken.
 			++nb_cycles ;
@@ -382,7 +792,7 @@ void TopologicalSortUtils::recursTopologicalSort(	vector< vector<size_t> >& prec
 
 	if(!already_rendered[indx])
 	{
-		new_pr_tab.push_back(primitive_tab[indx]) ;
+		order.push_back(indx) ;
 
 		if((++nbrendered)%info_cnt==0)
 			vparams.progress(nbrendered/(float)primitive_tab.size(), QGLViewer::tr("Topological sort")) ;
@@ -396,7 +806,7 @@ void TopologicalSortUtils::recursTopologicalSort(	vector< vector<size_t> >& prec
 																	vector<PtrPrimitive>& primitive_tab,
 																	vector<bool>& already_rendered,
 																	vector<bool>& already_visited,
-																	vector<PtrPrimitive>& new_pr_tab,
+																	vector<size_t>& order,
 																	size_t indx,
 																	vector<size_t>& ancestors,
 																	size_t& ancestors_backward_index,
@@ -421,7 +831,7 @@ void TopologicalSortUtils::recursTopologicalSort(	vector< vector<size_t> >& prec
 			if(!already_rendered[precedence_graph[indx][j]])
 			{
 				recursTopologicalSort(	precedence_graph,primitive_tab,already_rendered,already_visited,
-												new_pr_tab,precedence_graph[indx][j],ancestors,ancestors_backward_index,nb_cycles,vparams,info_cnt,nbrendered) ;
+												order,precedence_graph[indx][j],ancestors,ancestors_backward_index,nb_cycles,vparams,info_cnt,nbrendered) ;
 
 				if(ancestors_backward_index != INT_MAX && ancestors.size() > (size_t)(ancestors_backward_index+1))
 				{
@@ -470,7 +880,7 @@ void TopologicalSortUtils::recursTopologicalSort(	vector< vector<size_t> >& prec
 			// Go down ancestors tab, starting from the skewing primitive, and stopping at it.
 
 			for(size_t i2=(size_t)cycle_beginning_index;i2<ancestors.size() && split_prim_ancestor_indx < 0;++i2)
-				if(primitive_tab[ancestors[i2]]->nbVertices() > 2)
+				if(primitive_tab[ancestors[i2]]->type() == Primitive::POLYGON)
 				{
 					split_prim_ancestor_indx = (long)i2 ;
 					split_prim_indx = (long)ancestors[i2] ;
@@ -484,7 +894,7 @@ void TopologicalSortUtils::recursTopologicalSort(	vector< vector<size_t> >& prec
 
 			// 2 - split all necessary primitives
 
-			const Polygone *P = dynamic_cast<const Polygone *>(primitive_tab[(size_t)split_prim_indx]) ;
+			const Polygone *P = static_cast<const Polygone *>(primitive_tab[(size_t)split_prim_indx]) ;
 			const NVector3& normal = NVector3(P->normal()) ;
 			double c(P->c()) ;
 			ancestors.push_back(precedence_graph[indx][j]) ;				// sentinel
@@ -674,7 +1084,7 @@ void TopologicalSortUtils::recursTopologicalSort(	vector< vector<size_t> >& prec
 #ifdef DEBUG_TS
 		cout << "Returning ok. Rendered primitive " << indx << endl ;
 #endif
-		new_pr_tab.push_back(primitive_tab[indx]) ;
+		order.push_back(indx) ;
 
 		if((++nbrendered)%info_cnt==0)
 			vparams.progress(nbrendered/(float)primitive_tab.size(), QGLViewer::tr("Advanced topological sort")) ;
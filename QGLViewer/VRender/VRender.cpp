@@ -57,84 +57,93 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <QThread>
+
 #include "VRender.h"
 #include "ParserGL.h"
+#include "PrimitiveCapture.h"
 #include "Exporter.h"
 #include "SortMethod.h"
 #include "Optimizer.h"
+#include "PrimitiveStream.h"
+#include "PrimitiveFile.h"
 
 using namespace vrender ;
 using namespace std ;
 
-void vrender::VectorialRender(RenderCB render_callback, void *callback_params, VRenderParams& vparams)
-{
-	GLfloat *feedbackBuffer = NULL ;
-	SortMethod *sort_method = NULL ;
-	Exporter *exporter = NULL ;
-
-	try
-	{
-		GLint returned = -1 ;
-
-		vparams.error() = 0 ;
-
-		int nb_renders = 0 ;
+//  Thrown by VRenderParams::progress() when the time budget is exceeded during
+// an interruptible stage. Never leaves this file.
 
-		vparams.progress(0.0, QGLViewer::tr("Rendering...")) ;
-
-		while(returned < 0)
-		{
-			if(feedbackBuffer != NULL)
-				delete[] feedbackBuffer ;
-
-			feedbackBuffer = new GLfloat[vparams.size()] ;
-
-			if(feedbackBuffer == NULL)
-				throw std::runtime_error("Out of memory during feedback buffer allocation.") ;
-
-			glFeedbackBuffer(vparams.size(), GL_3D_COLOR, feedbackBuffer);
-			glRenderMode(GL_FEEDBACK);
-			render_callback(callback_params);
-			returned = glRenderMode(GL_RENDER);
-
-			nb_renders++ ;
-
-			if(returned < 0)
-				vparams.size() *= 2 ;
-		}
+class VRenderTimeout: public std::runtime_error
+{
+	public:
+		VRenderTimeout() : std::runtime_error("Time budget exceeded.") {}
+};
 
-#ifdef A_VOIR
-		if(SortMethod != EPS_DONT_SORT)
-		{
-			GLint depth_bits ;
-			glGetIntegerv(GL_DEPTH_BITS, &depth_bits) ;
+namespace vrender
+{
+	//  Adds the time spent in its scope to one of the stage times of the
+	// render, and tells whether the time budget may interrupt it.
 
-			EGALITY_EPS 		= 2.0/(1 << depth_bits) ;
-			LINE_EGALITY_EPS 	= 2.0/(1 << depth_bits) ;
-		}
-#endif
-		if (returned > vparams.size())
-			vparams.size() = returned;
-#ifdef _VRENDER_DEBUG
-		cout << "Size = " << vparams.size() << ", returned=" << returned << endl ;
-#endif
+	class VRenderStageTimer
+	{
+		public:
+			VRenderStageTimer(VRenderParams& vparams,VRenderParams::VRenderStage stage,bool interruptible = false)
+				: _vparams(vparams), _stage(stage)
+			{
+				_vparams._interruptible = interruptible ;
+				_time.start() ;
+			}
+
+			~VRenderStageTimer()
+			{
+				_vparams._interruptible = false ;
+				_vparams._stage_times[_stage] += _time.elapsed() ;
+			}
+
+			void timeBudgetExceeded()
+			{
+				_vparams._interruptible = false ;
+				_vparams._time_budget_exceeded = true ;
+			}
+
+		private:
+			VRenderParams& _vparams ;
+			VRenderParams::VRenderStage _stage ;
+			QTime _time ;
+	};
+
+	//  Everything that is read from GL, so that the rest of the render can be
+	// done without it, possibly on another thread. The feedback buffer is used
+	// if not NULL, the capture otherwise.
+
+	class VRenderInput
+	{
+		public:
+			VRenderInput() : feedback_buffer(NULL), feedback_size(0) {}
+			~VRenderInput() { delete[] feedback_buffer ; }
 
-		//  On a un beau feedback buffer tout plein de saloperies. Faut aller
-		// defricher tout ca. Ouaiiiis !
+			GLfloat *feedback_buffer ;
+			GLint feedback_size ;
+			PrimitiveCapture capture ;
 
-		vector<PtrPrimitive> primitive_tab ;
+			GLfloat viewport[4] ;
+			GLfloat clear_color[4] ;
+	};
+}
 
-		ParserGL parserGL ;
-		parserGL.parseFeedbackBuffer(feedbackBuffer,returned,primitive_tab,vparams) ;
+//  Everything that comes after parsing and before export: culling, sorting and
+// optimizations.
 
-		if(feedbackBuffer != NULL)
-		{
-			delete[] feedbackBuffer ;
-			feedbackBuffer = NULL ;
-		}
+static void ProcessPrimitives(vector<PtrPrimitive>& primitive_tab, VRenderParams& vparams)
+{
+	SortMethod *sort_method = NULL ;
 
+	try
+	{
 		if(vparams.isEnabled(VRenderParams::OptimizeBackFaceCulling))
 		{
+			VRenderStageTimer timer(vparams,VRenderParams::BackFaceCulling) ;
 			BackFaceCullingOptimizer bfopt ;
 			bfopt.optimize(primitive_tab,vparams) ;
 		}
@@ -160,82 +169,484 @@ void vrender::VectorialRender(RenderCB render_callback, void *callback_params, V
 			throw std::runtime_error("Unknown sorting method.") ;
 		}
 
-		sort_method->sortPrimitives(primitive_tab,vparams) ;
+		//  Topological sorts can be interrupted by the time budget. The array
+		// then still holds all the primitives, unsorted, and is BSP sorted.
+		// Once the budget is exceeded, BSP sorting is used directly.
+
+		bool topological = (vparams.sortMethod() == VRenderParams::TopologicalSort || vparams.sortMethod() == VRenderParams::AdvancedTopologicalSort) ;
+
+		if(topological && vparams.timeBudgetExceeded())
+		{
+			delete sort_method ;
+			sort_method = NULL ;
+			sort_method = new BSPSortMethod() ;
+			topological = false ;
+		}
+
+		{
+			VRenderStageTimer timer(vparams,VRenderParams::Sorting,topological) ;
+
+			try
+			{
+				sort_method->sortPrimitives(primitive_tab,vparams) ;
+			}
+			catch(VRenderTimeout&)
+			{
+				timer.timeBudgetExceeded() ;
+
+				delete sort_method ;
+				sort_method = NULL ;
+				sort_method = new BSPSortMethod() ;
+				sort_method->sortPrimitives(primitive_tab,vparams) ;
+			}
+		}
 
 		// Lance les optimisations. L'ordre est important.
 
-		if(vparams.isEnabled(VRenderParams::CullHiddenFaces))
+		if(vparams.isEnabled(VRenderParams::ApproximateHiddenFaces))
 		{
+			VRenderStageTimer timer(vparams,VRenderParams::HiddenFaceCulling) ;
+			RasterVisibilityOptimizer rvopt ;
+			rvopt.optimize(primitive_tab,vparams) ;
+		}
+		else if(vparams.isEnabled(VRenderParams::CullHiddenFaces))
+		{
+			VRenderStageTimer timer(vparams,VRenderParams::HiddenFaceCulling) ;
 			VisibilityOptimizer vopt ;
 			vopt.optimize(primitive_tab,vparams) ;
 		}
 
-#ifdef A_FAIRE
 		if(vparams.isEnabled(VRenderParams::OptimizePrimitiveSplit))
 		{
+			VRenderStageTimer timer(vparams,VRenderParams::PrimitiveMerging) ;
 			PrimitiveSplitOptimizer psopt ;
-			psopt.optimize(primitive_tab) ;
+			psopt.optimize(primitive_tab,vparams) ;
 		}
-#endif
-		// Ecrit le fichier
 
-		switch(vparams.format())
-		{
-		case VRenderParams::EPS: exporter = new EPSExporter() ;
-			break ;
-		case VRenderParams::PS:  exporter = new PSExporter() ;
-			break ;
-		case VRenderParams::XFIG:exporter = new FIGExporter() ;
-			break ;
-#ifdef A_FAIRE
-		case VRenderParams::SVG: exporter = new SVGExporter() ;
-			break ;
-#endif
-		default:
-			throw std::runtime_error("Sorry, this output format is not handled now. Only EPS and PS are currently supported.") ;
-		}
+		delete sort_method ;
+	}
+	catch(exception&)
+	{
+		if(sort_method != NULL) delete sort_method ;
+
+		throw ;
+	}
+}
+
+//  bounding_box is the one of the primitives, (xmin,ymin,xmax,ymax), used when
+// TightenBoundingBox is enabled.
 
-		// sets background and black & white options
+static Exporter *CreateExporter(const GLfloat *bounding_box, const VRenderInput& input, VRenderParams& vparams)
+{
+	Exporter *exporter = NULL ;
 
-		GLfloat viewport[4],clearColor[4],lineWidth,pointSize ;
+	switch(vparams.format())
+	{
+	case VRenderParams::EPS: exporter = new EPSExporter() ;
+		break ;
+	case VRenderParams::PS:  exporter = new PSExporter() ;
+		break ;
+	case VRenderParams::XFIG:exporter = new FIGExporter() ;
+		break ;
+	case VRenderParams::SVG: exporter = new SVGExporter() ;
+		break ;
+	default:
+		throw std::runtime_error("Sorry, this output format is not handled now. Only EPS, PS, XFIG and SVG are currently supported.") ;
+	}
+
+	// Sets which bounding box to use.
+
+	const GLfloat *viewport = input.viewport ;
+
+	if(vparams.isEnabled(VRenderParams::TightenBoundingBox))
+		exporter->setBoundingBox(bounding_box[0],bounding_box[1],bounding_box[2],bounding_box[3]) ;
+	else
+		exporter->setBoundingBox(viewport[0],viewport[1],viewport[0]+viewport[2],viewport[1]+viewport[3]) ;
 
-		glGetFloatv(GL_COLOR_CLEAR_VALUE, clearColor);
-		glGetFloatv(GL_LINE_WIDTH, &lineWidth);
-		glGetFloatv(GL_POINT_SIZE, &pointSize);
-		glGetFloatv(GL_VIEWPORT, viewport);
+	// sets background and black & white options
 
-		lineWidth /= (float)max(viewport[2] - viewport[0],viewport[3]-viewport[1]) ;
+	exporter->setBlackAndWhite(vparams.isEnabled(VRenderParams::RenderBlackAndWhite)) ;
+	exporter->setClearBackground(vparams.isEnabled(VRenderParams::AddBackground)) ;
+	exporter->setClearColor(input.clear_color[0],input.clear_color[1],input.clear_color[2]) ;
+	exporter->setReferenceFormatting(vparams.isEnabled(VRenderParams::ReferenceFormatting)) ;
 
-		// Sets which bounding box to use.
+	if(vparams.format() == VRenderParams::EPS || vparams.format() == VRenderParams::PS)
+		static_cast<EPSExporter *>(exporter)->setLevel3Shading(vparams.isEnabled(VRenderParams::PostScriptLevel3Shading)) ;
 
-		if(vparams.isEnabled(VRenderParams::TightenBoundingBox))
-			exporter->setBoundingBox(parserGL.xmin(),parserGL.ymin(),parserGL.xmax(),parserGL.ymax()) ;
-		else
-			exporter->setBoundingBox(viewport[0],viewport[1],viewport[0]+viewport[2],viewport[1]+viewport[3]) ;
+	return exporter ;
+}
+
+//  Processes and exports all the primitives at once. Deletes the primitives.
+
+static void ExportPrimitives(vector<PtrPrimitive>& primitive_tab, const ParserGL& parserGL, const VRenderInput& input, VRenderParams& vparams)
+{
+	const GLfloat bounding_box[4] = { parserGL.xmin(),parserGL.ymin(),parserGL.xmax(),parserGL.ymax() } ;
+	Exporter *exporter = NULL ;
+
+	try
+	{
+		ProcessPrimitives(primitive_tab,vparams) ;
+
+		// Ecrit le fichier
 
-		exporter->setBlackAndWhite(vparams.isEnabled(VRenderParams::RenderBlackAndWhite)) ;
-		exporter->setClearBackground(vparams.isEnabled(VRenderParams::AddBackground)) ;
-		exporter->setClearColor(clearColor[0],clearColor[1],clearColor[2]) ;
+		VRenderStageTimer timer(vparams,VRenderParams::Exporting) ;
 
+		if(!vparams.primitiveFilename().isEmpty())
+		{
+			PrimitiveFile file ;
+			file.create(vparams.primitiveFilename(),bounding_box,input.viewport,input.clear_color) ;
+			file.append(primitive_tab) ;
+			file.close() ;
+		}
+
+		exporter = CreateExporter(bounding_box,input,vparams) ;
 		exporter->exportToFile(vparams.filename(),primitive_tab,vparams) ;
 
-		// deletes primitives
+		delete exporter ;
+	}
+	catch(exception&)
+	{
+		if(exporter != NULL) delete exporter ;
 
 		for(unsigned int i=0;i<primitive_tab.size();++i)
 			delete primitive_tab[i] ;
 
+		throw ;
+	}
+
+	// deletes primitives
+
+	for(unsigned int i=0;i<primitive_tab.size();++i)
+		delete primitive_tab[i] ;
+}
+
+//  Streaming version of ExportPrimitives: the depth buckets of the stream are
+// processed and exported one after the other, from the farthest to the
+// closest, so that only one of them is in memory at a time. Sorting, hidden
+// face culling and merging only consider primitives of the same bucket.
+
+static void ExportStream(PrimitiveStream& stream, const ParserGL& parserGL, const VRenderInput& input, VRenderParams& vparams)
+{
+	const GLfloat bounding_box[4] = { parserGL.xmin(),parserGL.ymin(),parserGL.xmax(),parserGL.ymax() } ;
+	const bool save_primitives = !vparams.primitiveFilename().isEmpty() ;
+	Exporter *exporter = NULL ;
+	PrimitiveFile file ;
+	vector<PtrPrimitive> primitive_tab ;
+
+	try
+	{
+		{
+			VRenderStageTimer timer(vparams,VRenderParams::Parsing) ;
+			stream.makeBuckets() ;
+		}
+
+		if(save_primitives)
+			file.create(vparams.primitiveFilename(),bounding_box,input.viewport,input.clear_color) ;
+
+		exporter = CreateExporter(bounding_box,input,vparams) ;
+
+		exporter->beginExport(vparams.filename()) ;
+
+		for(size_t k=0;k<stream.nbBuckets();++k)
+		{
+			{
+				VRenderStageTimer timer(vparams,VRenderParams::Parsing) ;
+				stream.readBucket(k,primitive_tab) ;
+			}
+
+			ProcessPrimitives(primitive_tab,vparams) ;
+
+			VRenderStageTimer timer(vparams,VRenderParams::Exporting) ;
+
+			if(save_primitives)
+				file.append(primitive_tab) ;
+
+			exporter->exportPrimitives(primitive_tab,vparams) ;
+
+			for(size_t i=0;i<primitive_tab.size();++i)
+				delete primitive_tab[i] ;
+
+			primitive_tab.clear() ;
+		}
+
+		exporter->endExport() ;
+
+		if(save_primitives)
+			file.close() ;
+
+		delete exporter ;
+	}
+	catch(exception&)
+	{
 		if(exporter != NULL) delete exporter ;
-		if(sort_method != NULL) delete sort_method ;
+
+		for(size_t i=0;i<primitive_tab.size();++i)
+			delete primitive_tab[i] ;
+
+		throw ;
+	}
+}
+
+//  Everything that does not need GL: parsing, sorting, optimizations and
+// export. Shared by the feedback buffer and the capture entry points, and by
+// VRenderJob. Frees the feedback buffer and the capture as soon as possible.
+
+static void RenderInput(VRenderInput& input, VRenderParams& vparams)
+{
+	ParserGL parserGL ;
+
+	if(vparams.isEnabled(VRenderParams::StreamPrimitives))
+	{
+		PrimitiveStream stream(vparams.memoryBudget()) ;
+
+		{
+			VRenderStageTimer timer(vparams,VRenderParams::Parsing) ;
+
+			if(input.feedback_buffer != NULL)
+			{
+				parserGL.parseFeedbackBuffer(input.feedback_buffer,input.feedback_size,stream,vparams) ;
+
+				delete[] input.feedback_buffer ;
+				input.feedback_buffer = NULL ;
+			}
+			else
+			{
+				parserGL.parseCapture(input.capture,stream,vparams) ;
+				input.capture.clear() ;
+			}
+		}
+
+		ExportStream(stream,parserGL,input,vparams) ;
+	}
+	else
+	{
+		vector<PtrPrimitive> primitive_tab ;
+
+		try
+		{
+			VRenderStageTimer timer(vparams,VRenderParams::Parsing) ;
+
+			if(input.feedback_buffer != NULL)
+			{
+				parserGL.parseFeedbackBuffer(input.feedback_buffer,input.feedback_size,primitive_tab,vparams) ;
+
+				delete[] input.feedback_buffer ;
+				input.feedback_buffer = NULL ;
+			}
+			else
+			{
+				parserGL.parseCapture(input.capture,primitive_tab,vparams) ;
+				input.capture.clear() ;
+			}
+		}
+		catch(exception&)
+		{
+			// e.g. the render was cancelled while parsing.
+
+			for(size_t i=0;i<primitive_tab.size();++i)
+				delete primitive_tab[i] ;
+
+			throw ;
+		}
+
+		ExportPrimitives(primitive_tab,parserGL,input,vparams) ;
+	}
+}
+
+//  Reads the feedback buffer, and the GL state needed by the exporters. The
+// buffer size is doubled until the buffer is large enough, and kept for the
+// next renders.
+
+static void CaptureFeedbackBuffer(RenderCB render_callback, void *callback_params, VRenderInput& input, int& size)
+{
+	GLint returned = -1 ;
+
+	while(returned < 0)
+	{
+		if(input.feedback_buffer != NULL)
+			delete[] input.feedback_buffer ;
+
+		input.feedback_buffer = new GLfloat[size] ;
+
+		if(input.feedback_buffer == NULL)
+			throw std::runtime_error("Out of memory during feedback buffer allocation.") ;
+
+		glFeedbackBuffer(size, GL_3D_COLOR, input.feedback_buffer);
+		glRenderMode(GL_FEEDBACK);
+		render_callback(callback_params);
+		returned = glRenderMode(GL_RENDER);
+
+		if(returned < 0)
+			size *= 2 ;
+	}
+
+#ifdef A_VOIR
+	if(SortMethod != EPS_DONT_SORT)
+	{
+		GLint depth_bits ;
+		glGetIntegerv(GL_DEPTH_BITS, &depth_bits) ;
+
+		EGALITY_EPS 		= 2.0/(1 << depth_bits) ;
+		LINE_EGALITY_EPS 	= 2.0/(1 << depth_bits) ;
+	}
+#endif
+	if (returned > size)
+		size = returned;
+#ifdef _VRENDER_DEBUG
+	cout << "Size = " << size << ", returned=" << returned << endl ;
+#endif
+
+	input.feedback_size = returned ;
+
+	glGetFloatv(GL_VIEWPORT, input.viewport);
+	glGetFloatv(GL_COLOR_CLEAR_VALUE, input.clear_color);
+}
+
+static void CaptureCallback(CaptureCB capture_callback, void *callback_params, VRenderInput& input)
+{
+	capture_callback(input.capture,callback_params) ;
+
+	for(int i=0;i<4;++i)
+		input.viewport[i] = input.capture.viewport()[i] ;
+
+	glGetFloatv(GL_COLOR_CLEAR_VALUE, input.clear_color);
+}
+
+void vrender::VectorialRender(RenderCB render_callback, void *callback_params, VRenderParams& vparams)
+{
+	try
+	{
+		vparams.error() = 0 ;
+		vparams.startRender() ;
+
+		vparams.progress(0.0, QGLViewer::tr("Rendering...")) ;
+
+		VRenderInput input ;
+		CaptureFeedbackBuffer(render_callback,callback_params,input,vparams.size()) ;
+
+		//  On a un beau feedback buffer tout plein de saloperies. Faut aller
+		// defricher tout ca. Ouaiiiis !
+
+		RenderInput(input,vparams) ;
 	}
 	catch(exception& e)
 	{
 		cout << "Render aborted: " << e.what() << endl ;
 
-		if(exporter != NULL) delete exporter ;
-		if(sort_method != NULL) delete sort_method ;
-		if(feedbackBuffer != NULL) delete[] feedbackBuffer ;
+		throw ;
+	}
+}
+
+void vrender::VectorialRender(CaptureCB capture_callback, void *callback_params, VRenderParams& vparams)
+{
+	try
+	{
+		vparams.error() = 0 ;
+		vparams.startRender() ;
+
+		vparams.progress(0.0, QGLViewer::tr("Rendering...")) ;
 
-		throw e ;
+		VRenderInput input ;
+		CaptureCallback(capture_callback,callback_params,input) ;
+
+		RenderInput(input,vparams) ;
+	}
+	catch(exception& e)
+	{
+		cout << "Render aborted: " << e.what() << endl ;
+
+		throw ;
+	}
+}
+
+//  Number of primitives read from a primitive file, and given to the exporters,
+// at a time.
+
+static const size_t PRIMITIVE_FILE_CHUNK_SIZE = 65536 ;
+
+void vrender::ExportPrimitiveFile(const QString& primitive_filename, VRenderParams& vparams)
+{
+	ExportPrimitiveFile(primitive_filename,vector<VRenderParams *>(1,&vparams)) ;
+}
+
+void vrender::ExportPrimitiveFile(const QString& primitive_filename, const vector<VRenderParams *>& vparams)
+{
+	vector<Exporter *> exporters ;
+	vector<PtrPrimitive> primitive_tab ;
+
+	if(vparams.empty())
+		return ;
+
+	try
+	{
+		for(size_t i=0;i<vparams.size();++i)
+		{
+			vparams[i]->error() = 0 ;
+			vparams[i]->startRender() ;
+		}
+
+		vparams[0]->progress(0.0, QGLViewer::tr("Rendering...")) ;
+
+		PrimitiveFile file ;
+		VRenderInput input ;
+
+		{
+			VRenderStageTimer timer(*vparams[0],VRenderParams::Parsing) ;
+			file.open(primitive_filename) ;
+		}
+
+		for(int i=0;i<4;++i)
+		{
+			input.viewport[i] = file.viewport()[i] ;
+			input.clear_color[i] = file.clearColor()[i] ;
+		}
+
+		//  An output file that can not be opened aborts the whole export.
+
+		for(size_t i=0;i<vparams.size();++i)
+		{
+			exporters.push_back(CreateExporter(file.boundingBox(),input,*vparams[i])) ;
+			exporters.back()->beginExport(vparams[i]->filename()) ;
+		}
+
+		for(;;)
+		{
+			{
+				VRenderStageTimer timer(*vparams[0],VRenderParams::Parsing) ;
+
+				if(file.read(primitive_tab,PRIMITIVE_FILE_CHUNK_SIZE) == 0)
+					break ;
+			}
+
+			for(size_t i=0;i<exporters.size();++i)
+			{
+				VRenderStageTimer timer(*vparams[i],VRenderParams::Exporting) ;
+				exporters[i]->exportPrimitives(primitive_tab,*vparams[i]) ;
+			}
+
+			for(size_t i=0;i<primitive_tab.size();++i)
+				delete primitive_tab[i] ;
+
+			primitive_tab.clear() ;
+		}
+
+		for(size_t i=0;i<exporters.size();++i)
+			exporters[i]->endExport() ;
+
+		for(size_t i=0;i<exporters.size();++i)
+			delete exporters[i] ;
+	}
+	catch(exception& e)
+	{
+		for(size_t i=0;i<exporters.size();++i)
+			delete exporters[i] ;
+
+		for(size_t i=0;i<primitive_tab.size();++i)
+			delete primitive_tab[i] ;
+
+		cout << "Render aborted: " << e.what() << endl ;
+
+		throw ;
 	}
 }
 
@@ -246,15 +657,48 @@ VRenderParams::VRenderParams()
 	_filename = "" ;
 	_progress_function = NULL ;
 	_sortMethod = BSPSort ;
+	_raster_resolution = 2048 ;
+	_memory_budget = 256*1024*1024 ;
+	_time_budget = 0 ;
+	_time_budget_exceeded = false ;
+	_interruptible = false ;
+	_job = NULL ;
+	_sort_cache = NULL ;
+
+	for(int i=0;i<NbStages;++i)
+		_stage_times[i] = 0 ;
 }
 
 VRenderParams::~VRenderParams()
 {}
 
+void VRenderParams::startRender()
+{
+	_time_budget_exceeded = false ;
+	_interruptible = false ;
+	_render_time.start() ;
+
+	for(int i=0;i<NbStages;++i)
+		_stage_times[i] = 0 ;
+}
+
+//  Called regularly by all the stages of the render, on the thread that runs
+// it. Cancellation and time budget are checked here.
 
 void VRenderParams::progress(float f, const QString& progress_string)
 {
-	_progress_function(f,progress_string) ;
+	if(_job != NULL)
+	{
+		if(_job->isCancelled())
+			throw VRenderCancelled() ;
+
+		_job->setProgress(f,progress_string) ;
+	}
+	else if(_progress_function != NULL)
+		_progress_function(f,progress_string) ;
+
+	if(_interruptible && _time_budget > 0 && _render_time.elapsed() > _time_budget)
+		throw VRenderTimeout() ;
 }
 
 void VRenderParams::setFilename(const QString& filename)
@@ -274,3 +718,194 @@ bool VRenderParams::isEnabled(VRenderOption opt)
 {
 	return (_options & opt) > 0 ;
 }
+
+//  Primitives of a stream are sorted by buckets, which have nothing in common:
+// the cache is not used.
+
+TopologicalSortState *VRenderParams::sortState()
+{
+	if(_sort_cache == NULL || isEnabled(StreamPrimitives))
+		return NULL ;
+
+	return _sort_cache->_state ;
+}
+
+VRenderSortCache::VRenderSortCache()
+{
+	_state = new TopologicalSortState ;
+}
+
+VRenderSortCache::~VRenderSortCache()
+{
+	delete _state ;
+}
+
+void VRenderSortCache::clear()
+{
+	_state->clear() ;
+}
+
+float VRenderSortCache::tolerance() const
+{
+	return _state->tolerance ;
+}
+
+void VRenderSortCache::setTolerance(float pixels)
+{
+	_state->tolerance = pixels ;
+}
+
+namespace vrender
+{
+	class VRenderJobThread: public QThread
+	{
+		public:
+			VRenderJobThread(VRenderJob *job) : _job(job) {}
+
+		protected:
+			virtual void run()
+			{
+				VRenderParams& vparams = _job->_vparams ;
+
+				vparams._job = _job ;
+
+				try
+				{
+					RenderInput(*_job->_input,vparams) ;
+					_job->setStatus(VRenderJob::Finished) ;
+				}
+				catch(VRenderCancelled&)
+				{
+					_job->setStatus(VRenderJob::Cancelled) ;
+				}
+				catch(exception& e)
+				{
+					_job->setStatus(VRenderJob::Failed,QString(e.what())) ;
+				}
+
+				vparams._job = NULL ;
+
+				delete _job->_input ;
+				_job->_input = NULL ;
+			}
+
+		private:
+			VRenderJob *_job ;
+	};
+}
+
+VRenderJob::VRenderJob(const VRenderParams& vparams)
+	: _vparams(vparams)
+{
+	_input = NULL ;
+	_thread = NULL ;
+	_status = NotStarted ;
+	_cancelled = false ;
+	_progress = 0.0f ;
+}
+
+VRenderJob::~VRenderJob()
+{
+	cancel() ;
+	wait() ;
+
+	delete _thread ;
+	delete _input ;
+}
+
+void VRenderJob::capture(RenderCB render_callback, void *callback_params)
+{
+	if(_thread != NULL)
+		throw std::runtime_error("VRenderJob::capture() called after start().") ;
+
+	delete _input ;
+	_input = new VRenderInput ;
+
+	_vparams.error() = 0 ;
+	_vparams.startRender() ;
+
+	CaptureFeedbackBuffer(render_callback,callback_params,*_input,_vparams.size()) ;
+}
+
+void VRenderJob::capture(CaptureCB capture_callback, void *callback_params)
+{
+	if(_thread != NULL)
+		throw std::runtime_error("VRenderJob::capture() called after start().") ;
+
+	delete _input ;
+	_input = new VRenderInput ;
+
+	_vparams.error() = 0 ;
+	_vparams.startRender() ;
+
+	CaptureCallback(capture_callback,callback_params,*_input) ;
+}
+
+void VRenderJob::start()
+{
+	if(_input == NULL || _thread != NULL)
+		throw std::runtime_error("VRenderJob::start() must be called once, after capture().") ;
+
+	setStatus(Running) ;
+
+	_thread = new VRenderJobThread(this) ;
+	_thread->start() ;
+}
+
+void VRenderJob::cancel()
+{
+	QMutexLocker locker(&_mutex) ;
+	_cancelled = true ;
+}
+
+bool VRenderJob::wait(unsigned long msecs)
+{
+	if(_thread == NULL)
+		return true ;
+
+	return _thread->wait(msecs) ;
+}
+
+VRenderJob::Status VRenderJob::status() const
+{
+	QMutexLocker locker(&_mutex) ;
+	return _status ;
+}
+
+float VRenderJob::progress() const
+{
+	QMutexLocker locker(&_mutex) ;
+	return _progress ;
+}
+
+QString VRenderJob::progressText() const
+{
+	QMutexLocker locker(&_mutex) ;
+	return _progress_text ;
+}
+
+QString VRenderJob::errorMessage() const
+{
+	QMutexLocker locker(&_mutex) ;
+	return _error_message ;
+}
+
+void VRenderJob::setProgress(float f,const QString& text)
+{
+	QMutexLocker locker(&_mutex) ;
+	_progress = f ;
+	_progress_text = text ;
+}
+
+bool VRenderJob::isCancelled() const
+{
+	QMutexLocker locker(&_mutex) ;
+	return _cancelled ;
+}
+
+void VRenderJob::setStatus(Status status,const QString& message)
+{
+	QMutexLocker locker(&_mutex) ;
+	_status = status ;
+	_error_message = message ;
+}
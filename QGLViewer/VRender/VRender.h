@@ -48,17 +48,92 @@
 #include "../config.h"
 #include <QTextStream>
 #include <QString>
+#include <QMutex>
+#include <QTime>
+
+#include <climits>
+#include <stdexcept>
+#include <vector>
 
 #include "../qglviewer.h"
 
 namespace vrender
 {
 	class VRenderParams ;
+	class PrimitiveCapture ;
+	class VRenderInput ;
+	class VRenderJob ;
+	class VRenderJobThread ;
+	class TopologicalSortState ;
 	typedef void (*RenderCB)(void *) ;
+	typedef void (*CaptureCB)(PrimitiveCapture&, void *) ;
 	typedef void (*ProgressFunction)(float,const QString&) ;
 
 	void VectorialRender(RenderCB DrawFunc, void *callback_params, VRenderParams& render_params) ;
 
+	//  Same as above, but primitives are pushed by the callback into a
+	// PrimitiveCapture instead of being drawn in GL_FEEDBACK mode. The render
+	// mode is never changed; only the clear color is still read from GL.
+	void VectorialRender(CaptureCB CaptureFunc, void *callback_params, VRenderParams& render_params) ;
+
+	//  Exports primitives saved by a previous render (see
+	// VRenderParams::setPrimitiveFilename()) to the format and file of
+	// render_params, without capturing, parsing and sorting them again. Only the
+	// export options are used: RenderBlackAndWhite, AddBackground,
+	// TightenBoundingBox, ReferenceFormatting and PostScriptLevel3Shading.
+	void ExportPrimitiveFile(const QString& primitive_filename, VRenderParams& render_params) ;
+
+	//  Same as above, to several formats or files at once, in a single pass over
+	// the saved primitives. Progress is reported through the first parameters.
+	void ExportPrimitiveFile(const QString& primitive_filename, const std::vector<VRenderParams *>& render_params) ;
+
+	//  Thrown by the render when it is cancelled. See VRenderJob::cancel().
+	class VRenderCancelled: public std::runtime_error
+	{
+		public:
+			VRenderCancelled() : std::runtime_error("Render cancelled.") {}
+	};
+
+	//  Keeps what the topological sorts of a render computed, so that the next
+	// render of nearly the same view, such as the next frame of an animation,
+	// sorts faster (see VRenderParams::setSortCache()):
+	//
+	//		VRenderSortCache cache ;
+	//		vparams.setSortCache(&cache) ;
+	//		for(int frame=0;frame<nb_frames;++frame)
+	//			VectorialRender(drawFunc,&frame,vparams) ;
+	//
+	//  The relative position of two primitives whose projections overlap is
+	// kept until their screen bounding boxes move, relative to each other, by
+	// more than tolerance() pixels. Since they can only swap in depth once their
+	// projections stop overlapping, this is safe for small tolerances. The
+	// previous rendering order is kept wherever it is still valid.
+	//
+	//  Primitives are matched by their order in the feedback buffer: the cache
+	// is only used when the scene gives the same number of primitives (after
+	// back face culling), with the same number of vertices each, and is reset
+	// otherwise. It is not used with BSP sorting nor with StreamPrimitives.
+
+	class VRenderSortCache
+	{
+		public:
+			VRenderSortCache() ;
+			~VRenderSortCache() ;
+
+			void clear() ;
+
+			float tolerance() const ;
+			void setTolerance(float pixels) ;
+
+		private:
+			VRenderSortCache(const VRenderSortCache&) ;
+			VRenderSortCache& operator=(const VRenderSortCache&) ;
+
+			TopologicalSortState *_state ;
+
+			friend class VRenderParams ;
+	};
+
 	class VRenderParams
 	{
 		public:
@@ -69,10 +144,15 @@ namespace vrender
 			enum VRenderFormat     { EPS, PS, XFIG, SVG };
 
 			enum VRenderOption {	CullHiddenFaces         = 0x1,
+						OptimizePrimitiveSplit  = 0x2,
 						OptimizeBackFaceCulling = 0x4,
 						RenderBlackAndWhite     = 0x8,
 						AddBackground           = 0x10,
-						TightenBoundingBox      = 0x20 } ;
+						TightenBoundingBox      = 0x20,
+						ApproximateHiddenFaces  = 0x40,
+						ReferenceFormatting     = 0x80,
+						StreamPrimitives        = 0x100,
+						PostScriptLevel3Shading = 0x200 } ;
 
 			int sortMethod()    { return _sortMethod; }
 			void setSortMethod(VRenderParams::VRenderSortMethod s) { _sortMethod = s ; }
@@ -83,11 +163,45 @@ namespace vrender
 			const QString filename() { return _filename ; }
 			void setFilename(const QString& filename) ;
 
+			//  When not empty, the primitives are also saved to this file once
+			// culled and sorted, so that they can be exported again later with
+			// ExportPrimitiveFile().
+			const QString primitiveFilename() const { return _primitive_filename ; }
+			void setPrimitiveFilename(const QString& filename) { _primitive_filename = filename ; }
+
 			void setOption(VRenderOption,bool) ;
 			bool isEnabled(VRenderOption) ;
 
 			void setProgressFunction(ProgressFunction pf) { _progress_function = pf ; }
 
+			//  Cache used by topological sorts, NULL (the default) for none. It is
+			// not owned by the parameters, and is shared by their copies: renders
+			// using the same cache must not run at the same time.
+			VRenderSortCache *sortCache() const { return _sort_cache ; }
+			void setSortCache(VRenderSortCache *cache) { _sort_cache = cache ; }
+
+			//  Resolution, in pixels along the longest side of the image, of the item
+			// buffer used when ApproximateHiddenFaces is enabled.
+			int rasterResolution() const { return _raster_resolution ; }
+			void setRasterResolution(int r) { _raster_resolution = r ; }
+
+			//  Approximate amount of memory, in bytes, used for primitives when
+			// StreamPrimitives is enabled. Primitives are then stored in temporary
+			// files, and sorted and exported by slices of depth that fit in it.
+			size_t memoryBudget() const { return _memory_budget ; }
+			void setMemoryBudget(size_t b) { _memory_budget = b ; }
+
+			//  Wall-clock time budget of a render, in milliseconds (0, the default,
+			// means no budget). When it is exceeded during a topological sort, the
+			// sort is given up and a BSP sort is done instead.
+			int timeBudget() const { return _time_budget ; }
+			void setTimeBudget(int msecs) { _time_budget = msecs ; }
+			bool timeBudgetExceeded() const { return _time_budget_exceeded ; }
+
+			//  Time spent in each stage by the last render, in milliseconds.
+			enum VRenderStage { Parsing, BackFaceCulling, Sorting, HiddenFaceCulling, PrimitiveMerging, Exporting, NbStages } ;
+			int stageTime(VRenderStage s) const { return _stage_times[s] ; }
+
 		private:
 			int _error;
 			VRenderSortMethod _sortMethod;
@@ -96,22 +210,109 @@ namespace vrender
 			ProgressFunction _progress_function ;
 
 			unsigned int _options; // _DrawMode; _ClearBG; _TightenBB;
+			int _raster_resolution ;
+			size_t _memory_budget ;
 			QString _filename;
+			QString _primitive_filename ;
+
+			int _time_budget ;
+			bool _time_budget_exceeded ;
+			bool _interruptible ;
+			QTime _render_time ;
+			int _stage_times[NbStages] ;
+
+			VRenderJob *_job ;
+			VRenderSortCache *_sort_cache ;
 
 			friend void VectorialRender(	RenderCB render_callback,
 							void *callback_params,
 							VRenderParams& vparams);
+			friend void VectorialRender(	CaptureCB capture_callback,
+							void *callback_params,
+							VRenderParams& vparams);
+			friend void ExportPrimitiveFile(	const QString& primitive_filename,
+								const std::vector<VRenderParams *>& vparams);
 			friend class ParserGL ;
 			friend class Exporter ;
 			friend class BSPSortMethod ;
 			friend class VisibilityOptimizer ;
+			friend class RasterVisibilityOptimizer ;
+			friend class PrimitiveSplitOptimizer ;
 			friend class TopologicalSortMethod ;
 			friend class TopologicalSortUtils ;
+			friend class VRenderStageTimer ;
+			friend class VRenderJob ;
+			friend class VRenderJobThread ;
+
+			TopologicalSortState *sortState() ;
 
 			int& error() { return _error ; }
 			int& size()  { static int size=1000000; return size ; }
 
 			void progress(float,const QString&) ;
+			void startRender() ;
+	};
+
+	//  Runs a render without blocking the calling thread. Primitives are read
+	// from GL by capture(), on the thread that owns the GL context. Parsing,
+	// sorting, optimizations and export are then done on a worker thread by
+	// start(), and can be cancelled at any time:
+	//
+	//		VRenderJob job(vparams) ;
+	//		job.capture(drawFunc,params) ;
+	//		job.start() ;
+	//		while(!job.wait(100))
+	//			showProgress(job.progress(),job.progressText()) ;
+	//
+	//  The progress function of the parameters is not called: progress() is
+	// meant to be polled instead.
+
+	class VRenderJob
+	{
+		public:
+			enum Status { NotStarted, Running, Finished, Cancelled, Failed } ;
+
+			VRenderJob(const VRenderParams& vparams) ;
+			~VRenderJob() ;		// Cancels the render and waits for it.
+
+			void capture(RenderCB render_callback, void *callback_params) ;
+			void capture(CaptureCB capture_callback, void *callback_params) ;
+
+			void start() ;
+			void cancel() ;
+
+			//  Returns true when the render is over, or if it was not started.
+			bool wait(unsigned long msecs = ULONG_MAX) ;
+
+			Status status() const ;
+			float progress() const ;
+			QString progressText() const ;
+			QString errorMessage() const ;
+
+			//  Parameters of the render, with its stage times once it is over.
+			const VRenderParams& params() const { return _vparams ; }
+
+		private:
+			VRenderJob(const VRenderJob&) ;
+			VRenderJob& operator=(const VRenderJob&) ;
+
+			void setProgress(float,const QString&) ;
+			bool isCancelled() const ;
+			void setStatus(Status,const QString& message = QString()) ;
+
+			VRenderParams _vparams ;
+			VRenderInput *_input ;
+			VRenderJobThread *_thread ;
+
+			mutable QMutex _mutex ;
+			Status _status ;
+			bool _cancelled ;
+			float _progress ;
+			QString _progress_text ;
+			QString _error_message ;
+
+			friend class VRenderParams ;
+			friend class VRenderJobThread ;
 	};
 }
 #endif
@@ -43,6 +43,11 @@
 *****************************************************************************/
 
 #include <vector>
+#include <algorithm>
+#include <float.h>
+#include <QRunnable>
+#include <QSemaphore>
+#include <QThreadPool>
 #include "VRender.h"
 #include "Optimizer.h"
 #include "Primitive.h"
@@ -52,224 +57,364 @@
 using namespace vrender ;
 using namespace std ;
 
-#ifdef A_FAIRE
-void VisibilityOptimizer::optimize(vector<PtrPrimitive>& primitives,float& percentage_finished,string& message)
-#else
+//  The screen is divided into tiles, each tile keeping the union of the visible
+// primitives clipped to it. A primitive is visible if it is visible in at least one
+// of the tiles it overlaps. Since unions stay local, their size does not grow with
+// the whole scene, and tiles are processed independently on the global thread pool.
+
+namespace vrender
+{
+        class VisibilityTile
+        {
+                public:
+                        VisibilityTile(double xmin,double ymin,double xmax,double ymax)
+                                : _xmin(xmin),_ymin(ymin),_xmax(xmax),_ymax(ymax) {}
+
+                        void addPrimitive(size_t pindex) { _pindices.push_back(pindex) ; }
+                        bool isEmpty() const { return _pindices.empty() ; }
+
+                        // Primitives found visible, filled by cull().
+                        const vector<size_t>& visiblePrimitives() const { return _visible ; }
+
+                        void cull(const vector<PtrPrimitive>& primitives) ;
+
+                private:
+                        double _xmin,_ymin,_xmax,_ymax ;
+                        vector<size_t> _pindices ;	// primitives overlapping the tile, from front to back
+                        vector<size_t> _visible ;
+        };
+
+        class VisibilityTileTask: public QRunnable
+        {
+                public:
+                        VisibilityTileTask(VisibilityTile& tile,const vector<PtrPrimitive>& primitives,QSemaphore *done)
+                                : _tile(tile),_primitives(primitives),_done(done)
+                        {
+                                setAutoDelete(true) ;
+                        }
+
+                        virtual void run()
+                        {
+                                _tile.cull(_primitives) ;
+                                _done->release() ;
+                        }
+
+                private:
+                        VisibilityTile& _tile ;
+                        const vector<PtrPrimitive>& _primitives ;
+                        QSemaphore *_done ;
+        };
+}
+
+static void setGPCPolygon(gpc_polygon& P,vector<gpc_vertex>& verts)
+{
+        gpc_vertex_list contour ;
+        contour.num_vertices = verts.size() ;
+        contour.vertex = &verts[0] ;
+
+        P.num_contours = 0 ;
+        P.hole = NULL ;
+        P.contour = NULL ;
+
+        gpc_add_contour(&P,&contour,false) ;
+}
+
+static double GPCPolygonArea(const gpc_polygon& P)
+{
+        double area = 0.0 ;
+
+        for(unsigned long i=0;i<P.num_contours;++i)
+        {
+                double a = 0.0 ;
+                const gpc_vertex *v = P.contour[i].vertex ;
+                long n = P.contour[i].num_vertices ;
+
+                for(long j=0;j<n;++j)
+                        a += v[j].x*v[(j+1)%n].y - v[(j+1)%n].x*v[j].y ;
+
+                area += (P.hole[i]?-1.0:1.0) * fabs(a) * 0.5 ;
+        }
+
+        return area ;
+}
+
+//  Computes the polygon covered by the primitive, and a slightly reduced version of it
+// used for the visibility test. Segments are turned into thin quads.
+
+static void primitiveToGPC(const Primitive *p,vector<gpc_vertex>& verts,vector<gpc_vertex>& reduced_verts)
+{
+        if(p->nbVertices() == 2)
+        {
+                verts.resize(4) ;
+
+                double deps = 0.001 ;
+                double du = p->vertex(1).y()-p->vertex(0).y() ;
+                double dv = p->vertex(1).x()-p->vertex(0).x() ;
+                double n = sqrt(du*du+dv*dv) ;
+                du *= deps/n ;
+                dv *= deps/n ;
+                verts[0].x = p->vertex(0).x() + du ;
+                verts[0].y = p->vertex(0).y() + dv ;
+                verts[1].x = p->vertex(1).x() + du ;
+                verts[1].y = p->vertex(1).y() + dv ;
+                verts[2].x = p->vertex(1).x() - du ;
+                verts[2].y = p->vertex(1).y() - dv ;
+                verts[3].x = p->vertex(0).x() - du ;
+                verts[3].y = p->vertex(0).y() - dv ;
+
+                reduced_verts = verts ;
+        }
+        else
+        {
+                double mx = 0.0 ;
+                double my = 0.0 ;
+
+                verts.resize(p->nbVertices()) ;
+                reduced_verts.resize(p->nbVertices()) ;
+
+                for(size_t i=0;i<p->nbVertices();++i)
+                {
+                        verts[i].x = p->vertex(i).x() ;
+                        verts[i].y = p->vertex(i).y() ;
+                        mx += p->vertex(i).x() ;
+                        my += p->vertex(i).y() ;
+                }
+                mx /= p->nbVertices() ;
+                my /= p->nbVertices() ;
+
+                for(size_t j=0;j<p->nbVertices();++j)
+                {
+                        reduced_verts[j].x = mx + (p->vertex(j).x() - mx)*0.999 ;
+                        reduced_verts[j].y = my + (p->vertex(j).y() - my)*0.999 ;
+                }
+        }
+}
+
+void VisibilityTile::cull(const vector<PtrPrimitive>& primitives)
+{
+        // Ca serait pas mal mieux avec une interface c++...
+
+        gpc_polygon cumulated_union ;
+        cumulated_union.num_contours = 0 ;
+        cumulated_union.hole = NULL ;
+        cumulated_union.contour = NULL ;
+
+        vector<gpc_vertex> tile_verts(4) ;
+        tile_verts[0].x = _xmin ; tile_verts[0].y = _ymin ;
+        tile_verts[1].x = _xmax ; tile_verts[1].y = _ymin ;
+        tile_verts[2].x = _xmax ; tile_verts[2].y = _ymax ;
+        tile_verts[3].x = _xmin ; tile_verts[3].y = _ymax ;
+
+        gpc_polygon tile_poly ;
+        setGPCPolygon(tile_poly,tile_verts) ;
+
+        double tile_area = (_xmax-_xmin)*(_ymax-_ymin) ;
+
+        vector<gpc_vertex> verts ;
+        vector<gpc_vertex> reduced_verts ;
+
+        for(size_t k=0;k<_pindices.size();++k)
+        {
+                PtrPrimitive p(primitives[_pindices[k]]) ;
+
+                try
+                {
+                        gpc_polygon new_poly ;
+                        gpc_polygon new_poly_reduced ;
+                        gpc_polygon difference ;
+
+                        // 1 - creates gpc_polygons corresponding to the current primitive, clipped
+                        // 	to the tile when it is not entirely inside.
+
+                        primitiveToGPC(p,verts,reduced_verts) ;
+
+                        bool inside = true ;
+
+                        for(size_t i=0;i<verts.size() && inside;++i)
+                                if(verts[i].x < _xmin || verts[i].x > _xmax || verts[i].y < _ymin || verts[i].y > _ymax)
+                                        inside = false ;
+
+                        setGPCPolygon(new_poly_reduced,reduced_verts) ;
+
+                        if(!inside)
+                        {
+                                gpc_polygon clipped ;
+                                gpc_polygon_clip(GPC_INT,&new_poly_reduced,&tile_poly,&clipped) ;
+                                gpc_free_polygon(&new_poly_reduced) ;
+                                new_poly_reduced = clipped ;
+                        }
+
+                        // 2 - computes the difference between this polygon, and the union of the
+                        // 	preceeding ones.
+
+                        gpc_polygon_clip(GPC_DIFF,&new_poly_reduced,&cumulated_union,&difference) ;
+                        gpc_free_polygon(&new_poly_reduced) ;
+
+                        // 3 - checks the difference. If void, the primitive is not visible in
+                        // 	this tile.
+
+                        bool visible = (difference.num_contours > 0) ;
+                        gpc_free_polygon(&difference) ;
+
+                        if(!visible)
+                                continue ;
+
+                        _visible.push_back(_pindices[k]) ;
+
+                        // 4 - The primitive is visible. Let's add it to the cumulated union of
+                        // 	primitives.
+
+                        if(p->nbVertices() > 2)
+                        {
+                                setGPCPolygon(new_poly,verts) ;
+
+                                if(!inside)
+                                {
+                                        gpc_polygon clipped ;
+                                        gpc_polygon_clip(GPC_INT,&new_poly,&tile_poly,&clipped) ;
+                                        gpc_free_polygon(&new_poly) ;
+                                        new_poly = clipped ;
+                                }
+
+                                gpc_polygon cumulated_union_tmp ;
+                                gpc_polygon_clip(GPC_UNION,&new_poly,&cumulated_union,&cumulated_union_tmp) ;
+
+                                gpc_free_polygon(&new_poly) ;
+                                gpc_free_polygon(&cumulated_union) ;
+                                cumulated_union = cumulated_union_tmp ;
+
+                                // 5 - once the tile is entirely covered, all remaining primitives are hidden.
+
+                                if(GPCPolygonArea(cumulated_union) >= tile_area*(1.0-1e-9))
+                                        break ;
+                        }
+                }
+                catch(exception& )
+                {
+                        _visible.push_back(_pindices[k]) ; // std::cout << "Could not treat primitive " << _pindices[k] << ": internal gpc error." << endl ;
+                }
+        }
+
+        gpc_free_polygon(&cumulated_union) ;
+        gpc_free_polygon(&tile_poly) ;
+}
+
 void VisibilityOptimizer::optimize(vector<PtrPrimitive>& primitives,VRenderParams& vparams)
-#endif
 {
 #ifdef DEBUG_VO
         cout << "Optimizing visibility." << endl ;
 #endif
-        unsigned long N = primitives.size()/200 + 1 ;
+        static const double PRIMITIVES_PER_TILE = 64.0 ;
+        static const int MAX_TILES_PER_AXIS = 32 ;
+
+        // 1 - computes the tiling from the bounding box of the primitives.
 
-#ifdef DEBUG_EPSRENDER__SHOW1
-//	cout << "Showing viewer." << endl ;
-//	myViewer viewer ;
-//	viewer.show();
         double minx =  FLT_MAX ;
         double miny =  FLT_MAX ;
         double maxx = -FLT_MAX ;
         double maxy = -FLT_MAX ;
-        for(unsigned int i=0;i<primitives.size();++i)
-                for(int j=0;j<primitives[i]->nbVertices();++j)
+        size_t nb_primitives = 0 ;
+
+        for(size_t i=0;i<primitives.size();++i)
+                if(primitives[i] != NULL && primitives[i]->nbVertices() > 1)
                 {
-                        if(maxx < primitives[i]->vertex(j).x()) maxx = primitives[i]->vertex(j).x() ;
-                        if(maxy < primitives[i]->vertex(j).y()) maxy = primitives[i]->vertex(j).y() ;
-                        if(minx > primitives[i]->vertex(j).x()) minx = primitives[i]->vertex(j).x() ;
-                        if(miny > primitives[i]->vertex(j).y()) miny = primitives[i]->vertex(j).y() ;
+                        for(size_t j=0;j<primitives[i]->nbVertices();++j)
+                        {
+                                if(maxx < primitives[i]->vertex(j).x()) maxx = primitives[i]->vertex(j).x() ;
+                                if(maxy < primitives[i]->vertex(j).y()) maxy = primitives[i]->vertex(j).y() ;
+                                if(minx > primitives[i]->vertex(j).x()) minx = primitives[i]->vertex(j).x() ;
+                                if(miny > primitives[i]->vertex(j).y()) miny = primitives[i]->vertex(j).y() ;
+                        }
+                        ++nb_primitives ;
                 }
 
-        glMatrixMode(GL_PROJECTION) ;
-        glLoadIdentity() ;
-        glOrtho(minx,maxx,miny,maxy,-1,1) ;
-        glMatrixMode(GL_MODELVIEW) ;
-        glLoadIdentity() ;
+        if(nb_primitives == 0)
+                return ;
 
-        cout << "Window set to " << minx << " " << maxx << " " << miny << " " << maxy << endl ;
-        glClear(GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT) ;
-        glLineWidth(3.0) ;
-#endif
+        // Margin, so that thin quads of segments on the border are inside the tiling.
 
-        int nb_culled = 0 ;
+        minx -= 1.0 ; miny -= 1.0 ;
+        maxx += 1.0 ; maxy += 1.0 ;
 
-        // Ca serait pas mal mieux avec une interface c++...
+        int nb_tiles = max(1,min(MAX_TILES_PER_AXIS,int(sqrt(nb_primitives/PRIMITIVES_PER_TILE)))) ;
+        double dx = (maxx-minx)/nb_tiles ;
+        double dy = (maxy-miny)/nb_tiles ;
 
-        gpc_polygon cumulated_union ;
-        cumulated_union.num_contours = 0 ;
-        cumulated_union.hole = NULL ;
-        cumulated_union.contour = NULL ;
-        size_t nboptimised = 0 ;
+        vector<VisibilityTile> tiles ;
+        tiles.reserve(nb_tiles*nb_tiles) ;
 
-        for(size_t pindex = primitives.size() - 1; long(pindex) >= 0;--pindex,++nboptimised)
-                if(primitives[pindex] != NULL)
+        for(int j=0;j<nb_tiles;++j)
+                for(int i=0;i<nb_tiles;++i)
+                        tiles.push_back(VisibilityTile(	minx+i*dx, miny+j*dy,
+                                                                                (i==nb_tiles-1)?maxx:minx+(i+1)*dx,
+                                                                                (j==nb_tiles-1)?maxy:miny+(j+1)*dy)) ;
+
+        // 2 - dispatches primitives from front to back into the tiles they overlap.
+
+        for(size_t pindex = primitives.size() - 1; long(pindex) >= 0;--pindex)
+                if(primitives[pindex] != NULL && primitives[pindex]->nbVertices() > 1)
                 {
-#ifdef A_FAIRE
-                        percentage_finished = pindex / (float)primitives.size() ;
-#endif
+                        AxisAlignedBox_xyz B(primitives[pindex]->bbox()) ;
 
-                        if(primitives[pindex]->nbVertices() > 1)
-                        {
-#ifdef DEBUG_VO
-                                if(pindex%50==0)
-                                {
-                                        char buff[500] ;
-                                        sprintf(buff,"Left: % 6ld - Culled: % 6ld", pindex,(long)nb_culled) ;
-                                        fprintf(stdout,buff);
+                        int imin = max(0,min(nb_tiles-1,int((B.mini().x()-0.001-minx)/dx))) ;
+                        int imax = max(0,min(nb_tiles-1,int((B.maxi().x()+0.001-minx)/dx))) ;
+                        int jmin = max(0,min(nb_tiles-1,int((B.mini().y()-0.001-miny)/dy))) ;
+                        int jmax = max(0,min(nb_tiles-1,int((B.maxi().y()+0.001-miny)/dy))) ;
 
-                                        for(unsigned int j=0;j<strlen(buff);++j)
-                                                fprintf(stdout,"\b") ;
+                        for(int j=jmin;j<=jmax;++j)
+                                for(int i=imin;i<=imax;++i)
+                                        tiles[j*nb_tiles+i].addPrimitive(pindex) ;
+                }
 
-                                        fflush(stdout) ;
-                                }
-#endif
+        // 3 - culls each tile in parallel.
 
-                                try
-                                {
-                                        PtrPrimitive p(primitives[pindex]) ;
-                                        gpc_polygon difference ;
-                                        gpc_polygon new_poly ;
-                                        gpc_polygon new_poly_reduced ;
-                                        new_poly.num_contours = 0 ;
-                                        new_poly.hole = NULL ;
-                                        new_poly.contour = NULL ;
-                                        new_poly_reduced.num_contours = 0 ;
-                                        new_poly_reduced.hole = NULL ;
-                                        new_poly_reduced.contour = NULL ;
-
-                                        // 1 - creates a gpc_polygon corresponding to the current primitive
-
-                                        gpc_vertex_list *new_poly_verts = new gpc_vertex_list ;
-                                        gpc_vertex_list *new_poly_reduced_verts = new gpc_vertex_list ;
-
-                                        double mx = 0.0 ;
-                                        double my = 0.0 ;
-
-                                        if(p->nbVertices() == 2)
-                                        {
-                                                new_poly_verts->num_vertices = 4 ;
-                                                new_poly_verts->vertex = new gpc_vertex[4] ;
-                                                new_poly_reduced_verts->num_vertices = 4 ;
-                                                new_poly_reduced_verts->vertex = new gpc_vertex[4] ;
-
-                                                double deps = 0.001 ;
-                                                double du = p->vertex(1).y()-p->vertex(0).y() ;
-                                                double dv = p->vertex(1).x()-p->vertex(0).x() ;
-                                                double n = sqrt(du*du+dv*dv) ;
-                                                du *= deps/n ;
-                                                dv *= deps/n ;
-                                                new_poly_verts->vertex[0].x = p->vertex(0).x() + du ;
-                                                new_poly_verts->vertex[0].y = p->vertex(0).y() + dv ;
-                                                new_poly_verts->vertex[1].x = p->vertex(1).x() + du ;
-                                                new_poly_verts->vertex[1].y = p->vertex(1).y() + dv ;
-                                                new_poly_verts->vertex[2].x = p->vertex(1).x() - du ;
-                                                new_poly_verts->vertex[2].y = p->vertex(1).y() - dv ;
-                                                new_poly_verts->vertex[3].x = p->vertex(0).x() - du ;
-                                                new_poly_verts->vertex[3].y = p->vertex(0).y() - dv ;
-
-                                                new_poly_reduced_verts->vertex[0].x = p->vertex(0).x() + du ;
-                                                new_poly_reduced_verts->vertex[0].y = p->vertex(0).y() + dv ;
-                                                new_poly_reduced_verts->vertex[1].x = p->vertex(1).x() + du ;
-                                                new_poly_reduced_verts->vertex[1].y = p->vertex(1).y() + dv ;
-                                                new_poly_reduced_verts->vertex[2].x = p->vertex(1).x() - du ;
-                                                new_poly_reduced_verts->vertex[2].y = p->vertex(1).y() - dv ;
-                                                new_poly_reduced_verts->vertex[3].x = p->vertex(0).x() - du ;
-                                                new_poly_reduced_verts->vertex[3].y = p->vertex(0).y() - dv ;
-                                        }
-                                        else
-                                        {
-                                                new_poly_verts->num_vertices = p->nbVertices() ;
-                                                new_poly_verts->vertex = new gpc_vertex[p->nbVertices()] ;
-
-                                                for(size_t i=0;i<p->nbVertices();++i)
-                                                {
-                                                        new_poly_verts->vertex[i].x = p->vertex(i).x() ;
-                                                        new_poly_verts->vertex[i].y = p->vertex(i).y() ;
-                                                        mx += p->vertex(i).x() ;
-                                                        my += p->vertex(i).y() ;
-                                                }
-                                                mx /= p->nbVertices() ;
-                                                my /= p->nbVertices() ;
-
-                                                new_poly_reduced_verts->num_vertices = p->nbVertices() ;
-                                                new_poly_reduced_verts->vertex = new gpc_vertex[p->nbVertices()] ;
-
-                                                for(size_t j=0;j<p->nbVertices();++j)
-                                                {
-                                                        new_poly_reduced_verts->vertex[j].x = mx + (p->vertex(j).x() - mx)*0.999 ;
-                                                        new_poly_reduced_verts->vertex[j].y = my + (p->vertex(j).y() - my)*0.999 ;
-                                                }
-                                        }
-                                        gpc_add_contour(&new_poly,new_poly_verts,false) ;
-                                        gpc_add_contour(&new_poly_reduced,new_poly_reduced_verts,false) ;
-
-                                        // 2 - computes the difference between this polygon, and the union of the
-                                        // 	preceeding ones.
-
-                                        gpc_polygon_clip(GPC_DIFF,&new_poly_reduced,&cumulated_union,&difference) ;
-
-                                        // 3 - checks the difference. If void, the primitive is not visible: skip it
-                                        // 	and go to next primitive.
-
-                                        if(difference.num_contours == 0)
-                                        {
-                                                ++nb_culled ;
-                                                delete p ;
-                                                primitives[pindex] = NULL ;
-                                                continue ;
-                                        }
-
-                                        // 4 - The primitive is visible. Let's add it to the cumulated union of
-                                        // 	primitives.
-
-                                        if(p->nbVertices() > 2)
-                                        {
-                                                gpc_polygon cumulated_union_tmp ;
-                                                cumulated_union_tmp.num_contours = 0 ;
-                                                cumulated_union_tmp.hole = NULL ;
-                                                cumulated_union_tmp.contour = NULL ;
-
-                                                gpc_polygon_clip(GPC_UNION,&new_poly,&cumulated_union,&cumulated_union_tmp) ;
-
-                                                gpc_free_polygon(&cumulated_union) ;
-                                                cumulated_union = cumulated_union_tmp ;
-                                        }
+        QSemaphore done ;
+        size_t nb_tasks = 0 ;
 
-                                        gpc_free_polygon(&new_poly) ;
-                                        gpc_free_polygon(&new_poly_reduced) ;
-                                        gpc_free_polygon(&difference) ;
-#ifdef DEBUG_EPSRENDER__SHOW1
-                                        glClear(GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT) ;
-
-                                        glColor3f(1.0,0.0,0.0) ;
-
-                                        for(unsigned long i=0;i<cumulated_union.num_contours;++i)
-                                        {
-                                                glBegin(GL_LINE_LOOP) ;
-                                                for(unsigned long j=0;j<cumulated_union.contour[i].num_vertices;++j)
-                                                        glVertex2f(cumulated_union.contour[i].vertex[j].x,cumulated_union.contour[i].vertex[j].y) ;
-                                                glEnd() ;
-                                        }
-
-                                        glFlush() ;
-                                        glXSwapBuffers(glXGetCurrentDisplay(),glXGetCurrentDrawable()) ;
-#endif
-                                }
-                                catch(exception& )
-                                {
-                                        ; // std::cout << "Could not treat primitive " << pindex << ": internal gpc error." << endl ;
-                                }
-                        }
+        for(size_t i=0;i<tiles.size();++i)
+                if(!tiles[i].isEmpty())
+                {
+                        QThreadPool::globalInstance()->start(new VisibilityTileTask(tiles[i],primitives,&done)) ;
+                        ++nb_tasks ;
+                }
 
-                        if(nboptimised%N==0)
-                                vparams.progress(nboptimised/(float)primitives.size(), QGLViewer::tr("Visibility optimization")) ;
+        // progress() throws if the render is cancelled: running tasks must be waited for.
+
+        size_t nb_done = 0 ;
+
+        try
+        {
+                for(;nb_done<nb_tasks;++nb_done)
+                {
+                        done.acquire() ;
+                        vparams.progress(nb_done/(float)nb_tasks, QGLViewer::tr("Visibility optimization")) ;
+                }
+        }
+        catch(exception&)
+        {
+                done.acquire(int(nb_tasks - nb_done - 1)) ;
+                throw ;
+        }
+
+        // 4 - a primitive is visible if it is visible in at least one tile.
+
+        vector<bool> visible(primitives.size(),false) ;
+
+        for(size_t i=0;i<tiles.size();++i)
+                for(size_t j=0;j<tiles[i].visiblePrimitives().size();++j)
+                        visible[tiles[i].visiblePrimitives()[j]] = true ;
+
+        int nb_culled = 0 ;
+
+        for(size_t pindex=0;pindex<primitives.size();++pindex)
+                if(primitives[pindex] != NULL && primitives[pindex]->nbVertices() > 1 && !visible[pindex])
+                {
+                        ++nb_culled ;
+                        delete primitives[pindex] ;
+                        primitives[pindex] = NULL ;
                 }
 
 #ifdef DEBUG_VO
         cout << nb_culled << " primitives culled over " << primitives.size() << "." << endl ;
 #endif
-
-        gpc_free_polygon(&cumulated_union) ;
 }
-
-
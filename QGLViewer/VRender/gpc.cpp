@@ -154,6 +154,32 @@ using namespace std ;
 
 #define FREE(p)            {if (p) {free(p); (p)= NULL;}}
 
+/* Temporary structures of a clip. See the arena allocator below. */
+
+#ifdef GPC_NO_ARENA
+#define ARENA_MALLOC(p, b, s, t) MALLOC(p, b, s, t)
+#define ARENA_FREE(p)            FREE(p)
+#define NODE_MALLOC(p, l, s, t)  MALLOC(p, sizeof(t), s, t)
+#define NODE_FREE(p, l)          FREE(p)
+#else
+#define ARENA_MALLOC(p, b, s, t) {if ((b) > 0) { \
+							p= (t*)gpc_current_arena->allocate(b, s);} \
+							else p= NULL;}
+#define ARENA_FREE(p)            {(void)(p); (p)= NULL;}
+#define NODE_MALLOC(p, l, s, t)  {p= (t*)gpc_current_arena->allocate_node(l, \
+							sizeof(t), s);}
+#define NODE_FREE(p, l)          {gpc_current_arena->release_node(l, p); \
+							(p)= NULL;}
+#endif
+
+#if __cplusplus >= 201103L
+#define GPC_THREAD_LOCAL   thread_local
+#elif defined(_MSC_VER)
+#define GPC_THREAD_LOCAL   __declspec(thread)
+#else
+#define GPC_THREAD_LOCAL   __thread
+#endif
+
 
 /*
 ===========================================================================
@@ -299,6 +325,154 @@ const h_state next_h_state[3][6]=
 };
 
 
+/*
+===========================================================================
+							 Arena Allocator
+===========================================================================
+*/
+
+/* All the temporary structures of a clip (local minima and scanbeam
+   tables, edge tables, intersection, contour and vertex nodes) are
+   carved out of an arena owned by the clip, instead of being allocated
+   and freed one by one. The arena starts with a block on the stack,
+   which is enough for small polygons, and chains larger heap blocks
+   when needed. Everything is released at once when the clip returns,
+   or throws. The results given to the caller still use malloc, since
+   they are released by gpc_free_polygon() and gpc_free_tristrip().
+
+   Intersection and sorted edge nodes are rebuilt for every scanbeam.
+   They are recycled through per-type free lists of the arena, so that
+   its size stays proportional to the number of active edges rather
+   than growing with the number of scanbeams.
+
+   The arena of the running clip is found through a thread local
+   pointer, so that clips run concurrently in different threads. Define
+   GPC_NO_ARENA to allocate everything with malloc, e.g. for memory
+   checkers. */
+
+#define ARENA_ALIGNMENT    sizeof(double)
+#define ARENA_STACK_SIZE   8192
+#define ARENA_BLOCK_SIZE   65536
+
+typedef enum                        /* Node types with a free list       */
+{
+  IT_NODES,
+  ST_NODES,
+  NB_NODE_TYPES
+} node_type;
+
+class gpc_arena
+{
+	public:
+		gpc_arena() ;
+		~gpc_arena() ;
+
+#ifndef GPC_NO_ARENA
+		void *allocate(size_t b, const char *s) ;
+		void *allocate_node(node_type l, size_t b, const char *s) ;
+		void  release_node(node_type l, void *p) ;
+
+	private:
+		gpc_arena(const gpc_arena&) ;
+		gpc_arena& operator=(const gpc_arena&) ;
+
+		union
+		{
+			char   data[ARENA_STACK_SIZE] ;
+			double alignment ;
+		} _stack ;
+
+		void       *_blocks ;         /* Heap blocks, each starting with a
+													pointer to the previous one      */
+		char       *_top ;
+		char       *_end ;
+		size_t      _block_size ;
+		gpc_arena  *_previous ;       /* Arena of an enclosing clip        */
+		void       *_free_nodes[NB_NODE_TYPES] ; /* Released nodes, each
+													starting with a pointer to
+													the next one                 */
+#endif
+} ;
+
+#ifdef GPC_NO_ARENA
+
+gpc_arena::gpc_arena() {}
+gpc_arena::~gpc_arena() {}
+
+#else
+
+static GPC_THREAD_LOCAL gpc_arena *gpc_current_arena= NULL;
+
+gpc_arena::gpc_arena()
+	: _blocks(NULL), _top(_stack.data), _end(_stack.data + ARENA_STACK_SIZE),
+	  _block_size(ARENA_BLOCK_SIZE), _previous(gpc_current_arena)
+{
+  for (int l= 0; l < NB_NODE_TYPES; l++)
+	_free_nodes[l]= NULL;
+
+  gpc_current_arena= this;
+}
+
+gpc_arena::~gpc_arena()
+{
+  while (_blocks)
+  {
+	void *previous= *(void **)_blocks;
+	free(_blocks);
+	_blocks= previous;
+  }
+
+  gpc_current_arena= _previous;
+}
+
+void *gpc_arena::allocate(size_t b, const char *s)
+{
+  void *p;
+
+  b= (b + ARENA_ALIGNMENT - 1) / ARENA_ALIGNMENT * ARENA_ALIGNMENT;
+
+  if ((size_t)(_end - _top) < b)
+  {
+	/* Blocks double in size, so that large clips only need a few */
+	size_t size= ARENA_ALIGNMENT + b;
+	if (size < _block_size)
+	  size= _block_size;
+	_block_size*= 2;
+
+	char *block;
+	MALLOC(block, size, s, char);
+	*(void **)block= _blocks;
+	_blocks= block;
+
+	_top= block + ARENA_ALIGNMENT;
+	_end= block + size;
+  }
+
+  p= _top;
+  _top+= b;
+  return p;
+}
+
+void *gpc_arena::allocate_node(node_type l, size_t b, const char *s)
+{
+  void *p= _free_nodes[l];
+
+  if (!p)
+	return allocate(b, s);
+
+  _free_nodes[l]= *(void **)p;
+  return p;
+}
+
+void gpc_arena::release_node(node_type l, void *p)
+{
+  *(void **)p= _free_nodes[l];
+  _free_nodes[l]= p;
+}
+
+#endif
+
+
 /*
 ===========================================================================
 							 Private Functions
@@ -312,7 +486,7 @@ static void reset_it(it_node **it)
   while (*it)
   {
 	itn= (*it)->next;
-	FREE(*it);
+	NODE_FREE(*it, IT_NODES);
 	*it= itn;
   }
 }
@@ -325,7 +499,7 @@ static void reset_lmt(lmt_node **lmt)
   while (*lmt)
   {
 	lmtn= (*lmt)->next;
-	FREE(*lmt);
+	ARENA_FREE(*lmt);
 	*lmt= lmtn;
   }
 }
@@ -385,7 +559,7 @@ static edge_node **bound_list(lmt_node **lmt, double y)
   if (!*lmt)
   {
 	/* Add node onto the tail end of the LMT */
-	MALLOC(*lmt, sizeof(lmt_node), "LMT insertion", lmt_node);
+	ARENA_MALLOC(*lmt, sizeof(lmt_node), "LMT insertion", lmt_node);
 	(*lmt)->y= y;
 	(*lmt)->first_bound= NULL;
 	(*lmt)->next= NULL;
@@ -396,7 +570,7 @@ static edge_node **bound_list(lmt_node **lmt, double y)
 	{
 	  /* Insert a new LMT node before the current node */
 	  existing_node= *lmt;
-	  MALLOC(*lmt, sizeof(lmt_node), "LMT insertion", lmt_node);
+	  ARENA_MALLOC(*lmt, sizeof(lmt_node), "LMT insertion", lmt_node);
 	  (*lmt)->y= y;
 	  (*lmt)->first_bound= NULL;
 	  (*lmt)->next= existing_node;
@@ -417,7 +591,7 @@ static void add_to_sbtree(int *entries, sb_tree **sbtree, double y)
   if (!*sbtree)
   {
 	/* Add a new tree node here */
-	MALLOC(*sbtree, sizeof(sb_tree), "scanbeam tree insertion", sb_tree);
+	ARENA_MALLOC(*sbtree, sizeof(sb_tree), "scanbeam tree insertion", sb_tree);
 	(*sbtree)->y= y;
 	(*sbtree)->less= NULL;
 	(*sbtree)->more= NULL;
@@ -459,7 +633,7 @@ static void free_sbtree(sb_tree **sbtree)
   {
 	free_sbtree(&((*sbtree)->less));
 	free_sbtree(&((*sbtree)->more));
-	FREE(*sbtree);
+	ARENA_FREE(*sbtree);
   }
 }
 
@@ -492,7 +666,7 @@ static edge_node *build_lmt(lmt_node **lmt, sb_tree **sbtree,
 	total_vertices+= count_optimal_vertices(p->contour[c]);
 
   /* Create the entire input polygon edge table in one go */
-  MALLOC(edge_table, total_vertices * sizeof(edge_node), "edge table creation", edge_node);
+  ARENA_MALLOC(edge_table, total_vertices * sizeof(edge_node), "edge table creation", edge_node);
   for(int k=0;k<total_vertices;++k)
 	  edge_table[k] = edge_node() ;
 
@@ -682,7 +856,7 @@ static void add_intersection(it_node **it, edge_node *edge0, edge_node *edge1,
   if (!*it)
   {
 	/* Append a new node to the tail of the list */
-	MALLOC(*it, sizeof(it_node), "IT insertion", it_node);
+	NODE_MALLOC(*it, IT_NODES, "IT insertion", it_node);
 	(*it)->ie[0]= edge0;
 	(*it)->ie[1]= edge1;
 	(*it)->point.x= x;
@@ -695,7 +869,7 @@ static void add_intersection(it_node **it, edge_node *edge0, edge_node *edge1,
 	{
 	  /* Insert a new node mid-list */
 	  existing_node= *it;
-	  MALLOC(*it, sizeof(it_node), "IT insertion", it_node);
+	  NODE_MALLOC(*it, IT_NODES, "IT insertion", it_node);
 	  (*it)->ie[0]= edge0;
 	  (*it)->ie[1]= edge1;
 	  (*it)->point.x= x;
@@ -718,7 +892,7 @@ static void add_st_edge(st_node **st, it_node **it, edge_node *edge,
   if (!*st)
   {
 	/* Append edge onto the tail end of the ST */
-	MALLOC(*st, sizeof(st_node), "ST insertion", st_node);
+	NODE_MALLOC(*st, ST_NODES, "ST insertion", st_node);
 	(*st)->edge= edge;
 	(*st)->xb= edge->xb;
 	(*st)->xt= edge->xt;
@@ -735,7 +909,7 @@ static void add_st_edge(st_node **st, it_node **it, edge_node *edge,
 	{
 	  /* No intersection - insert edge here (before the ST edge) */
 	  existing_node= *st;
-	  MALLOC(*st, sizeof(st_node), "ST insertion", st_node);
+	  NODE_MALLOC(*st, ST_NODES, "ST insertion", st_node);
 	  (*st)->edge= edge;
 	  (*st)->xb= edge->xb;
 	  (*st)->xt= edge->xt;
@@ -780,7 +954,7 @@ static void build_intersection_table(it_node **it, edge_node *aet, double dy)
   while (st)
   {
 	stp= st->prev;
-	FREE(st);
+	NODE_FREE(st, ST_NODES);
 	st= stp;
   }
 }
@@ -810,7 +984,7 @@ static int count_contours(polygon_node *polygon)
 		for (v= polygon->proxy->v[LEFT]; v; v= nextv)
 		{
 		  nextv= v->next;
-		  FREE(v);
+		  ARENA_FREE(v);
 		}
 		polygon->active= 0;
 	  }
@@ -826,7 +1000,7 @@ static void add_left(polygon_node *p, double x, double y)
   if(p == NULL) throw runtime_error("GPC: Something's wrong.") ;
 
   /* Create a new vertex node and set its fields */
-  MALLOC(nv, sizeof(vertex_node), "vertex node creation", vertex_node);
+  ARENA_MALLOC(nv, sizeof(vertex_node), "vertex node creation", vertex_node);
   nv->x= x;
   nv->y= y;
 
@@ -875,7 +1049,7 @@ static void add_right(polygon_node *p, double x, double y)
   if(p == NULL) throw runtime_error("GPC: Something's wrong.") ;
 
   /* Create a new vertex node and set its fields */
-  MALLOC(nv, sizeof(vertex_node), "vertex node creation", vertex_node);
+  ARENA_MALLOC(nv, sizeof(vertex_node), "vertex node creation", vertex_node);
   nv->x= x;
   nv->y= y;
   nv->next= NULL;
@@ -926,11 +1100,11 @@ static void add_local_min(polygon_node **p, edge_node *edge,
 
   existing_min= *p;
 
-  MALLOC(*p, sizeof(polygon_node), "polygon node creation", polygon_node);
+  ARENA_MALLOC(*p, sizeof(polygon_node), "polygon node creation", polygon_node);
   **p = polygon_node() ;
 
   /* Create a new vertex node and set its fields */
-  MALLOC(nv, sizeof(vertex_node), "vertex node creation", vertex_node);
+  ARENA_MALLOC(nv, sizeof(vertex_node), "vertex node creation", vertex_node);
   *nv = vertex_node() ;
 
   nv->x= x;
@@ -966,7 +1140,7 @@ static void add_vertex(vertex_node **t, double x, double y)
 {
   if (!(*t))
   {
-	MALLOC(*t, sizeof(vertex_node), "tristrip vertex creation", vertex_node);
+	ARENA_MALLOC(*t, sizeof(vertex_node), "tristrip vertex creation", vertex_node);
 	(*t)->x= x;
 	(*t)->y= y;
 	(*t)->next= NULL;
@@ -982,7 +1156,7 @@ static void new_tristrip(polygon_node **tn, edge_node *edge,
 {
   if (!(*tn))
   {
-	MALLOC(*tn, sizeof(polygon_node), "tristrip node creation", polygon_node);
+	ARENA_MALLOC(*tn, sizeof(polygon_node), "tristrip node creation", polygon_node);
 	 **tn = polygon_node() ;
 
 	(*tn)->next= NULL;
@@ -1003,7 +1177,7 @@ static bbox *create_contour_bboxes(gpc_polygon *p)
   bbox *box;
   int   v;
 
-  MALLOC(box, p->num_contours * sizeof(bbox), "Bounding box creation", bbox);
+  ARENA_MALLOC(box, p->num_contours * sizeof(bbox), "Bounding box creation", bbox);
 
   /* Construct contour bounding boxes */
   for (size_t c= 0; c < p->num_contours; c++)
@@ -1039,7 +1213,7 @@ static void minimax_test(gpc_polygon *subj, gpc_polygon *clip, gpc_op op)
   s_bbox= create_contour_bboxes(subj);
   c_bbox= create_contour_bboxes(clip);
 
-  MALLOC(o_table, subj->num_contours * clip->num_contours * sizeof(int),
+  ARENA_MALLOC(o_table, subj->num_contours * clip->num_contours * sizeof(int),
 		 "overlap table creation", int);
 
   /* Check all subject contour bounding boxes against clip boxes */
@@ -1078,9 +1252,9 @@ static void minimax_test(gpc_polygon *subj, gpc_polygon *clip, gpc_op op)
 	}
   }
 
-  FREE(s_bbox);
-  FREE(c_bbox);
-  FREE(o_table);
+  ARENA_FREE(s_bbox);
+  ARENA_FREE(c_bbox);
+  ARENA_FREE(o_table);
 }
 
 
@@ -1189,6 +1363,7 @@ void gpc_add_contour(gpc_polygon *p, gpc_vertex_list *new_contour, int hole)
 void gpc_polygon_clip(gpc_op op, gpc_polygon *subj, gpc_polygon *clip,
 					  gpc_polygon *result)
 {
+  gpc_arena      arena;
   sb_tree       *sbtree= NULL;
   it_node       *it= NULL, *intersect=0;
   edge_node     *edge=0, *prev_edge=0, *next_edge=0, *succ_edge=0, *e0=0, *e1=0;
@@ -1231,13 +1406,13 @@ void gpc_polygon_clip(gpc_op op, gpc_polygon *subj, gpc_polygon *clip,
 	result->hole= NULL;
 	result->contour= NULL;
 	reset_lmt(&lmt);
-	FREE(s_heap);
-	FREE(c_heap);
+	ARENA_FREE(s_heap);
+	ARENA_FREE(c_heap);
 	return;
   }
 
   /* Build scanbeam table from scanbeam tree */
-  MALLOC(sbt, sbt_entries * sizeof(double), "sbt creation", double);
+  ARENA_MALLOC(sbt, sbt_entries * sizeof(double), "sbt creation", double);
   build_sbt(&scanbeam, sbt, sbtree);
   scanbeam= 0;
   free_sbtree(&sbtree);
@@ -1800,12 +1975,12 @@ void gpc_polygon_clip(gpc_op op, gpc_polygon *subj, gpc_polygon *clip,
 		  nv= vtx->next;
 		  result->contour[c].vertex[v].x= vtx->x;
 		  result->contour[c].vertex[v].y= vtx->y;
-		  FREE(vtx);
+		  ARENA_FREE(vtx);
 		  v--;
 		}
 		c++;
 	  }
-	  FREE(poly);
+	  ARENA_FREE(poly);
 	}
   }
   else
@@ -1813,16 +1988,16 @@ void gpc_polygon_clip(gpc_op op, gpc_polygon *subj, gpc_polygon *clip,
 	for (poly= out_poly; poly; poly= npoly)
 	{
 	  npoly= poly->next;
-	  FREE(poly);
+	  ARENA_FREE(poly);
 	}
   }
 
   /* Tidy up */
   reset_it(&it);
   reset_lmt(&lmt);
-  FREE(c_heap);
-  FREE(s_heap);
-  FREE(sbt);
+  ARENA_FREE(c_heap);
+  ARENA_FREE(s_heap);
+  ARENA_FREE(sbt);
 }
 
 
@@ -1849,6 +2024,7 @@ void gpc_polygon_to_tristrip(gpc_polygon *s, gpc_tristrip *t)
 void gpc_tristrip_clip(gpc_op op, gpc_polygon *subj, gpc_polygon *clip,
 					   gpc_tristrip *result)
 {
+  gpc_arena      arena;
   sb_tree       *sbtree= NULL;
   it_node       *it= NULL, *intersect;
   edge_node     *edge=0, *prev_edge=0, *next_edge=0, *succ_edge=0, *e0=0, *e1=0;
@@ -1890,13 +2066,13 @@ void gpc_tristrip_clip(gpc_op op, gpc_polygon *subj, gpc_polygon *clip,
 	result->num_strips= 0;
 	result->strip= NULL;
 	reset_lmt(&lmt);
-	FREE(s_heap);
-	FREE(c_heap);
+	ARENA_FREE(s_heap);
+	ARENA_FREE(c_heap);
 	return;
   }
 
   /* Build scanbeam table from scanbeam tree */
-  MALLOC(sbt, sbt_entries * sizeof(double), "sbt creation", double);
+  ARENA_MALLOC(sbt, sbt_entries * sizeof(double), "sbt creation", double);
   build_sbt(&scanbeam, sbt, sbtree);
   scanbeam= 0;
   free_sbtree(&sbtree);
@@ -2496,7 +2672,7 @@ void gpc_tristrip_clip(gpc_op op, gpc_polygon *subj, gpc_polygon *clip,
 			result->strip[s].vertex[v].x= lt->x;
 			result->strip[s].vertex[v].y= lt->y;
 			v++;
-			FREE(lt);
+			ARENA_FREE(lt);
 			lt= ltn;
 		  }
 		  if (rt)
@@ -2505,7 +2681,7 @@ void gpc_tristrip_clip(gpc_op op, gpc_polygon *subj, gpc_polygon *clip,
 			result->strip[s].vertex[v].x= rt->x;
 			result->strip[s].vertex[v].y= rt->y;
 			v++;
-			FREE(rt);
+			ARENA_FREE(rt);
 			rt= rtn;
 		  }
 		}
@@ -2517,24 +2693,24 @@ void gpc_tristrip_clip(gpc_op op, gpc_polygon *subj, gpc_polygon *clip,
 		for (lt= tn->v[LEFT]; lt; lt= ltn)
 		{
 		  ltn= lt->next;
-		  FREE(lt);
+		  ARENA_FREE(lt);
 		}
 		for (rt= tn->v[RIGHT]; rt; rt=rtn)
 		{
 		  rtn= rt->next;
-		  FREE(rt);
+		  ARENA_FREE(rt);
 		}
 	  }
-	  FREE(tn);
+	  ARENA_FREE(tn);
 	}
   }
 
   /* Tidy up */
   reset_it(&it);
   reset_lmt(&lmt);
-  FREE(c_heap);
-  FREE(s_heap);
-  FREE(sbt);
+  ARENA_FREE(c_heap);
+  ARENA_FREE(s_heap);
+  ARENA_FREE(sbt);
 }
 
 /*
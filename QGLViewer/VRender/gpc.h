@@ -93,6 +93,10 @@ Copyright: (C) 1997-2004, Advanced Interfaces Group,
 
 #define GPC_VERSION "2.32"
 
+/* Clips can run concurrently in different threads. Their temporary
+   structures come from a per-clip arena (see gpc.cpp), unless gpc.cpp
+   is compiled with GPC_NO_ARENA defined.                                */
+
 
 /*
 ===========================================================================
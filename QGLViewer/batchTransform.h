@@ -0,0 +1,211 @@
+/****************************************************************************
+
+ Copyright (C) 2002-2014 Gilles Debunne. All rights reserved.
+
+ This file is part of the QGLViewer library version 2.6.3.
+
+ http://www.libqglviewer.com - contact@libqglviewer.com
+
+ This file may be used under the terms of the GNU General Public License 
+ versions 2.0 or 3.0 as published by the Free Software Foundation and
+ appearing in the LICENSE file included in the packaging of this file.
+ In addition, as a special exception, Gilles Debunne gives you certain 
+ additional rights, described in the file GPL_EXCEPTION in this package.
+
+ libQGLViewer uses dual licensing. Commercial/proprietary software must
+ purchase a libQGLViewer Commercial License.
+
+ This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+ WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+
+*****************************************************************************/
+
+#ifndef QGLVIEWER_BATCH_TRANSFORM_H
+#define QGLVIEWER_BATCH_TRANSFORM_H
+
+// Internal helpers shared by the array versions of the Frame and Camera coordinate conversion
+// methods. Not part of the public API.
+
+#ifndef DOXYGEN
+
+#include <QRunnable>
+#include <QSemaphore>
+#include <QThread>
+#include <QThreadPool>
+
+#include "config.h"
+
+namespace qglviewer {
+namespace batch {
+
+// Below this number of points, conversions are done in the calling thread.
+static const int PARALLEL_THRESHOLD = 65536;
+
+// Product a*b of two OpenGL (column major) 4x4 matrices.
+inline void multiply(const GLdouble a[16], const GLdouble b[16], GLdouble res[16])
+{
+	GLdouble tmp[16];
+	for (int i=0; i<4; ++i)
+		for (int j=0; j<4; ++j)
+		{
+			GLdouble sum = 0.0;
+			for (int k=0; k<4; ++k)
+				sum += a[i+4*k]*b[k+4*j];
+			tmp[i+4*j] = sum;
+		}
+	for (int i=0; i<16; ++i)
+		res[i] = tmp[i];
+}
+
+// Inverse of an OpenGL 4x4 matrix. Returns false if m is singular.
+inline bool invert(const GLdouble m[16], GLdouble res[16])
+{
+	GLdouble inv[16];
+	inv[0]  =  m[5]*m[10]*m[15] - m[5]*m[11]*m[14] - m[9]*m[6]*m[15] + m[9]*m[7]*m[14] + m[13]*m[6]*m[11] - m[13]*m[7]*m[10];
+	inv[4]  = -m[4]*m[10]*m[15] + m[4]*m[11]*m[14] + m[8]*m[6]*m[15] - m[8]*m[7]*m[14] - m[12]*m[6]*m[11] + m[12]*m[7]*m[10];
+	inv[8]  =  m[4]*m[9] *m[15] - m[4]*m[11]*m[13] - m[8]*m[5]*m[15] + m[8]*m[7]*m[13] + m[12]*m[5]*m[11] - m[12]*m[7]*m[9];
+	inv[12] = -m[4]*m[9] *m[14] + m[4]*m[10]*m[13] + m[8]*m[5]*m[14] - m[8]*m[6]*m[13] - m[12]*m[5]*m[10] + m[12]*m[6]*m[9];
+	inv[1]  = -m[1]*m[10]*m[15] + m[1]*m[11]*m[14] + m[9]*m[2]*m[15] - m[9]*m[3]*m[14] - m[13]*m[2]*m[11] + m[13]*m[3]*m[10];
+	inv[5]  =  m[0]*m[10]*m[15] - m[0]*m[11]*m[14] - m[8]*m[2]*m[15] + m[8]*m[3]*m[14] + m[12]*m[2]*m[11] - m[12]*m[3]*m[10];
+	inv[9]  = -m[0]*m[9] *m[15] + m[0]*m[11]*m[13] + m[8]*m[1]*m[15] - m[8]*m[3]*m[13] - m[12]*m[1]*m[11] + m[12]*m[3]*m[9];
+	inv[13] =  m[0]*m[9] *m[14] - m[0]*m[10]*m[13] - m[8]*m[1]*m[14] + m[8]*m[2]*m[13] + m[12]*m[1]*m[10] - m[12]*m[2]*m[9];
+	inv[2]  =  m[1]*m[6] *m[15] - m[1]*m[7] *m[14] - m[5]*m[2]*m[15] + m[5]*m[3]*m[14] + m[13]*m[2]*m[7]  - m[13]*m[3]*m[6];
+	inv[6]  = -m[0]*m[6] *m[15] + m[0]*m[7] *m[14] + m[4]*m[2]*m[15] - m[4]*m[3]*m[14] - m[12]*m[2]*m[7]  + m[12]*m[3]*m[6];
+	inv[10] =  m[0]*m[5] *m[15] - m[0]*m[7] *m[13] - m[4]*m[1]*m[15] + m[4]*m[3]*m[13] + m[12]*m[1]*m[7]  - m[12]*m[3]*m[5];
+	inv[14] = -m[0]*m[5] *m[14] + m[0]*m[6] *m[13] + m[4]*m[1]*m[14] - m[4]*m[2]*m[13] - m[12]*m[1]*m[6]  + m[12]*m[2]*m[5];
+	inv[3]  = -m[1]*m[6] *m[11] + m[1]*m[7] *m[10] + m[5]*m[2]*m[11] - m[5]*m[3]*m[10] - m[9] *m[2]*m[7]  + m[9] *m[3]*m[6];
+	inv[7]  =  m[0]*m[6] *m[11] - m[0]*m[7] *m[10] - m[4]*m[2]*m[11] + m[4]*m[3]*m[10] + m[8] *m[2]*m[7]  - m[8] *m[3]*m[6];
+	inv[11] = -m[0]*m[5] *m[11] + m[0]*m[7] *m[9]  + m[4]*m[1]*m[11] - m[4]*m[3]*m[9]  - m[8] *m[1]*m[7]  + m[8] *m[3]*m[5];
+	inv[15] =  m[0]*m[5] *m[10] - m[0]*m[6] *m[9]  - m[4]*m[1]*m[10] + m[4]*m[2]*m[9]  + m[8] *m[1]*m[6]  - m[8] *m[2]*m[5];
+
+	const GLdouble det = m[0]*inv[0] + m[1]*inv[4] + m[2]*inv[8] + m[3]*inv[12];
+	if (det == 0.0)
+		return false;
+
+	for (int i=0; i<16; ++i)
+		res[i] = inv[i] / det;
+	return true;
+}
+
+// Points are given by three coordinate pointers and a stride, which covers both the packed x,y,z
+// (stride 3) and the separate x[], y[], z[] arrays (stride 1) layouts.
+template <typename T>
+struct Points
+{
+	T* x;
+	T* y;
+	T* z;
+	int stride;
+
+	Points<T> offset(int n) const
+	{
+		Points<T> p = { x + n*stride, y + n*stride, z + n*stride, stride };
+		return p;
+	}
+};
+
+// Transforms the nb points of src by m (column major), dividing by the homogeneous coordinate when
+// projective is true. src and res may be identical.
+template <typename T>
+void transform(const GLdouble m[16], bool projective, Points<const T> src, Points<T> res, int nb)
+{
+	const T m0 = T(m[0]), m1 = T(m[1]), m2 = T(m[2]), m3 = T(m[3]);
+	const T m4 = T(m[4]), m5 = T(m[5]), m6 = T(m[6]), m7 = T(m[7]);
+	const T m8 = T(m[8]), m9 = T(m[9]), m10 = T(m[10]), m11 = T(m[11]);
+	const T m12 = T(m[12]), m13 = T(m[13]), m14 = T(m[14]), m15 = T(m[15]);
+
+	const int ss = src.stride;
+	const int rs = res.stride;
+
+	if (projective)
+		for (int i=0; i<nb; ++i)
+		{
+			const T x = src.x[i*ss], y = src.y[i*ss], z = src.z[i*ss];
+			const T w = T(1) / (m3*x + m7*y + m11*z + m15);
+			res.x[i*rs] = (m0*x + m4*y + m8 *z + m12) * w;
+			res.y[i*rs] = (m1*x + m5*y + m9 *z + m13) * w;
+			res.z[i*rs] = (m2*x + m6*y + m10*z + m14) * w;
+		}
+	else
+		for (int i=0; i<nb; ++i)
+		{
+			const T x = src.x[i*ss], y = src.y[i*ss], z = src.z[i*ss];
+			res.x[i*rs] = m0*x + m4*y + m8 *z + m12;
+			res.y[i*rs] = m1*x + m5*y + m9 *z + m13;
+			res.z[i*rs] = m2*x + m6*y + m10*z + m14;
+		}
+}
+
+template <typename T>
+class TransformTask : public QRunnable
+{
+public:
+	TransformTask(const GLdouble m[16], bool projective, Points<const T> src, Points<T> res, int nb, QSemaphore* done)
+		: m_(m), projective_(projective), src_(src), res_(res), nb_(nb), done_(done)
+	{
+		setAutoDelete(true);
+	}
+
+	virtual void run()
+	{
+		transform(m_, projective_, src_, res_, nb_);
+		done_->release();
+	}
+
+private:
+	const GLdouble* m_;
+	bool projective_;
+	Points<const T> src_;
+	Points<T> res_;
+	int nb_;
+	QSemaphore* done_;
+};
+
+// Same as transform(), but large arrays are split in chunks processed by the global QThreadPool.
+template <typename T>
+void parallelTransform(const GLdouble m[16], bool projective, Points<const T> src, Points<T> res, int nb)
+{
+	const int nbThreads = QThread::idealThreadCount();
+	if (nb < PARALLEL_THRESHOLD || nbThreads < 2)
+	{
+		transform(m, projective, src, res, nb);
+		return;
+	}
+
+	const int chunk = (nb + nbThreads - 1) / nbThreads;
+	QSemaphore done;
+	int nbTasks = 0;
+	for (int first=chunk; first<nb; first+=chunk)
+	{
+		const int n = qMin(chunk, nb-first);
+		QThreadPool::globalInstance()->start(new TransformTask<T>(m, projective, src.offset(first), res.offset(first), n, &done));
+		++nbTasks;
+	}
+
+	// The first chunk is processed by the calling thread
+	transform(m, projective, src, res, qMin(chunk, nb));
+	done.acquire(nbTasks);
+}
+
+// Packed x,y,z layout
+template <typename T>
+inline Points<T> packed(T* p)
+{
+	Points<T> res = { p, p+1, p+2, 3 };
+	return res;
+}
+
+// Separate x[], y[] and z[] arrays layout
+template <typename T, typename A>
+inline Points<T> separate(A p)
+{
+	Points<T> res = { p[0], p[1], p[2], 1 };
+	return res;
+}
+
+} // namespace batch
+} // namespace qglviewer
+
+#endif // DOXYGEN
+
+#endif // QGLVIEWER_BATCH_TRANSFORM_H
@@ -24,6 +24,7 @@
 #include "camera.h"
 #include "qglviewer.h"
 #include "manipulatedCameraFrame.h"
+#include "batchTransform.h"
 
 using namespace std;
 using namespace qglviewer;
@@ -1656,6 +1657,117 @@ void Camera::getUnprojectedCoordinatesOf(const qreal src[3], qreal res[3], const
 		res[i] = r[i];
 }
 
+// Composition of the viewport, projection, modelView and frame world matrices: the result maps
+// frame coordinates to homogeneous screen coordinates, as done by gluProject().
+void Camera::getProjectionTransform(GLdouble m[16], const Frame* frame) const
+{
+	GLdouble mvp[16];
+	batch::multiply(projectionMatrix_, modelViewMatrix_, mvp);
+	if (frame)
+	{
+		GLdouble world[16];
+		Frame(frame->position(), frame->orientation()).getMatrix(world);
+		batch::multiply(mvp, world, mvp);
+	}
+
+	GLint viewport[4];
+	getViewport(viewport);
+	const GLdouble sx = viewport[2] / 2.0;
+	const GLdouble sy = viewport[3] / 2.0;
+	const GLdouble tx = viewport[0] + sx;
+	const GLdouble ty = viewport[1] + sy;
+
+	for (int j=0; j<4; ++j)
+	{
+		m[4*j]   = sx  * mvp[4*j]   + tx  * mvp[4*j+3];
+		m[4*j+1] = sy  * mvp[4*j+1] + ty  * mvp[4*j+3];
+		m[4*j+2] = 0.5 * mvp[4*j+2] + 0.5 * mvp[4*j+3];
+		m[4*j+3] = mvp[4*j+3];
+	}
+}
+
+// Inverse of getProjectionTransform(), as done by gluUnProject(). Returns false if it is singular.
+bool Camera::getUnprojectionTransform(GLdouble m[16], const Frame* frame) const
+{
+	GLdouble proj[16];
+	getProjectionTransform(proj, frame);
+	return batch::invert(proj, m);
+}
+
+/*! Array version of getProjectedCoordinatesOf(): projects the \p nb points of \p src, packed as
+ successive \c x,y,z triplets (3*nb values) and defined in the \p frame coordinate system (world
+ coordinate system when \p frame is \c NULL).
+
+ The complete projection matrix (see projectedCoordinatesOf()) is computed once and the points are
+ then converted in a tight loop. Large arrays are split in chunks that are processed in parallel by
+ the \c QThreadPool::globalInstance(). \p src and \p res can be identical pointers. */
+void Camera::getProjectedCoordinatesOf(const float src[], float res[], int nb, const Frame* frame) const
+{
+	GLdouble m[16];
+	getProjectionTransform(m, frame);
+	batch::parallelTransform(m, true, batch::packed(src), batch::packed(res), nb);
+}
+
+/*! Same as getProjectedCoordinatesOf(const float[], float[], int, const Frame*), with \c double values. */
+void Camera::getProjectedCoordinatesOf(const double src[], double res[], int nb, const Frame* frame) const
+{
+	GLdouble m[16];
+	getProjectionTransform(m, frame);
+	batch::parallelTransform(m, true, batch::packed(src), batch::packed(res), nb);
+}
+
+/*! Same as getProjectedCoordinatesOf(const float[], float[], int, const Frame*), with separate
+ coordinate arrays: \p src[0], \p src[1] and \p src[2] (resp. \p res) are the \c x, \c y and \c z
+ arrays of \p nb values. */
+void Camera::getProjectedCoordinatesOf(const float* const src[3], float* const res[3], int nb, const Frame* frame) const
+{
+	GLdouble m[16];
+	getProjectionTransform(m, frame);
+	batch::parallelTransform(m, true, batch::separate<const float>(src), batch::separate<float>(res), nb);
+}
+
+/*! Same as getProjectedCoordinatesOf(const float* const[3], float* const[3], int, const Frame*), with \c double values. */
+void Camera::getProjectedCoordinatesOf(const double* const src[3], double* const res[3], int nb, const Frame* frame) const
+{
+	GLdouble m[16];
+	getProjectionTransform(m, frame);
+	batch::parallelTransform(m, true, batch::separate<const double>(src), batch::separate<double>(res), nb);
+}
+
+/*! Array version of getUnprojectedCoordinatesOf(), see getProjectedCoordinatesOf(const float[],
+ float[], int, const Frame*). \p res is left unchanged if the projection matrix is singular. */
+void Camera::getUnprojectedCoordinatesOf(const float src[], float res[], int nb, const Frame* frame) const
+{
+	GLdouble m[16];
+	if (getUnprojectionTransform(m, frame))
+		batch::parallelTransform(m, true, batch::packed(src), batch::packed(res), nb);
+}
+
+/*! Same as getUnprojectedCoordinatesOf(const float[], float[], int, const Frame*), with \c double values. */
+void Camera::getUnprojectedCoordinatesOf(const double src[], double res[], int nb, const Frame* frame) const
+{
+	GLdouble m[16];
+	if (getUnprojectionTransform(m, frame))
+		batch::parallelTransform(m, true, batch::packed(src), batch::packed(res), nb);
+}
+
+/*! Array version of getUnprojectedCoordinatesOf(), see getProjectedCoordinatesOf(const float*
+ const[3], float* const[3], int, const Frame*). */
+void Camera::getUnprojectedCoordinatesOf(const float* const src[3], float* const res[3], int nb, const Frame* frame) const
+{
+	GLdouble m[16];
+	if (getUnprojectionTransform(m, frame))
+		batch::parallelTransform(m, true, batch::separate<const float>(src), batch::separate<float>(res), nb);
+}
+
+/*! Same as getUnprojectedCoordinatesOf(const float* const[3], float* const[3], int, const Frame*), with \c double values. */
+void Camera::getUnprojectedCoordinatesOf(const double* const src[3], double* const res[3], int nb, const Frame* frame) const
+{
+	GLdouble m[16];
+	if (getUnprojectionTransform(m, frame))
+		batch::parallelTransform(m, true, batch::separate<const double>(src), batch::separate<double>(res), nb);
+}
+
 /////////////////////////////////////  KFI /////////////////////////////////////////
 
 /*! Returns the KeyFrameInterpolator that defines the Camera path number \p i.
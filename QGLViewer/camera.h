@@ -401,6 +401,14 @@ public:
 	Vec unprojectedCoordinatesOf(const Vec& src, const Frame* frame=NULL) const;
 	void getProjectedCoordinatesOf(const qreal src[3], qreal res[3], const Frame* frame=NULL) const;
 	void getUnprojectedCoordinatesOf(const qreal src[3], qreal res[3], const Frame* frame=NULL) const;
+	void getProjectedCoordinatesOf(const float src[], float res[], int nb, const Frame* frame) const;
+	void getProjectedCoordinatesOf(const double src[], double res[], int nb, const Frame* frame) const;
+	void getProjectedCoordinatesOf(const float* const src[3], float* const res[3], int nb, const Frame* frame) const;
+	void getProjectedCoordinatesOf(const double* const src[3], double* const res[3], int nb, const Frame* frame) const;
+	void getUnprojectedCoordinatesOf(const float src[], float res[], int nb, const Frame* frame) const;
+	void getUnprojectedCoordinatesOf(const double src[], double res[], int nb, const Frame* frame) const;
+	void getUnprojectedCoordinatesOf(const float* const src[3], float* const res[3], int nb, const Frame* frame) const;
+	void getUnprojectedCoordinatesOf(const double* const src[3], double* const res[3], int nb, const Frame* frame) const;
 	void convertClickToLine(const QPoint& pixel, Vec& orig, Vec& dir) const;
 	Vec pointUnderPixel(const QPoint& pixel, bool& found) const;
 	//@}
@@ -480,6 +488,9 @@ private Q_SLOTS:
 	void onFrameModified();
 
 private:
+	void getProjectionTransform(GLdouble m[16], const Frame* frame) const;
+	bool getUnprojectionTransform(GLdouble m[16], const Frame* frame) const;
+
 	// F r a m e
 	ManipulatedCameraFrame* frame_;
 
@@ -22,6 +22,7 @@
 
 #include "domUtils.h"
 #include "frame.h"
+#include "batchTransform.h"
 #include <math.h>
 
 using namespace qglviewer;
@@ -33,7 +34,7 @@ using namespace std;
   Its position() is (0,0,0) and it has an identity orientation() Quaternion. The referenceFrame()
   and the constraint() are \c NULL. */
 Frame::Frame()
-	: constraint_(NULL), referenceFrame_(NULL)
+	: constraint_(NULL), referenceFrame_(NULL), worldCacheIsValid_(false)
 {}
 
 /*! Creates a Frame with a position() and an orientation().
@@ -43,12 +44,30 @@ Frame::Frame()
  The Frame is defined in the world coordinate system (its referenceFrame() is \c NULL). It
  has a \c NULL associated constraint(). */
 Frame::Frame(const Vec& position, const Quaternion& orientation)
-	: t_(position), q_(orientation), constraint_(NULL), referenceFrame_(NULL)
+	: t_(position), q_(orientation), constraint_(NULL), referenceFrame_(NULL), worldCacheIsValid_(false)
 {}
 
+/*! Virtual destructor.
+
+  The Frame is removed from the hierarchy: the Frames that used it as their referenceFrame() are
+  now defined in the world coordinate system (their referenceFrame() is set to \c NULL, without
+  emitting the modified() signal). */
+Frame::~Frame()
+{
+	if (referenceFrame_)
+		referenceFrame_->children_.removeOne(this);
+
+	Q_FOREACH (Frame* child, children_)
+	{
+		child->referenceFrame_ = NULL;
+		child->invalidateWorldCache();
+	}
+}
+
 /*! Equal operator.
 
-  The referenceFrame() and constraint() pointers are copied.
+  The referenceFrame() and constraint() pointers are copied. The Frames that use \p frame as their
+  referenceFrame() are not affected, and neither are the ones that use this Frame.
 
   \attention Signal and slot connections are not copied. */
 Frame& Frame::operator=(const Frame& frame)
@@ -66,7 +85,7 @@ Frame& Frame::operator=(const Frame& frame)
   The translation() and rotation() as well as constraint() and referenceFrame() pointers are
   copied. */
 Frame::Frame(const Frame& frame)
-	: QObject()
+	: QObject(), constraint_(NULL), referenceFrame_(NULL), worldCacheIsValid_(false)
 {
 	(*this) = frame;
 }
@@ -242,6 +261,7 @@ void Frame::setFromMatrix(const GLdouble m[4][4])
 			rot[i][j] = m[j][i] / m[3][3];
 	}
 	q_.setFromRotationMatrix(rot);
+	invalidateWorldCache();
 	Q_EMIT modified();
 }
 
@@ -337,6 +357,7 @@ void Frame::translate(Vec& t)
 	if (constraint())
 		constraint()->constrainTranslation(t, this);
 	t_ += t;
+	invalidateWorldCache();
 	Q_EMIT modified();
 }
 
@@ -379,6 +400,7 @@ void Frame::rotate(Quaternion& q)
 		constraint()->constrainRotation(q, this);
 	q_ *= q;
 	q_.normalize(); // Prevents numerical drift
+	invalidateWorldCache();
 	Q_EMIT modified();
 }
 
@@ -417,10 +439,12 @@ void Frame::rotateAroundPoint(Quaternion& rotation, const Vec& point)
 		constraint()->constrainRotation(rotation, this);
 	q_ *= rotation;
 	q_.normalize(); // Prevents numerical drift
+	invalidateWorldCache();
 	Vec trans = point + Quaternion(inverseTransformOf(rotation.axis()), rotation.angle()).rotate(position()-point) - t_;
 	if (constraint())
 		constraint()->constrainTranslation(trans, this);
 	t_ += trans;
+	invalidateWorldCache();
 	Q_EMIT modified();
 }
 
@@ -471,6 +495,7 @@ void Frame::setPositionAndOrientation(const Vec& position, const Quaternion& ori
 		t_ = position;
 		q_ = orientation;
 	}
+	invalidateWorldCache();
 	Q_EMIT modified();
 }
 
@@ -484,6 +509,7 @@ void Frame::setTranslationAndRotation(const Vec& translation, const Quaternion&
 {
 	t_ = translation;
 	q_ = rotation;
+	invalidateWorldCache();
 	Q_EMIT modified();
 }
 
@@ -535,24 +561,46 @@ void Frame::getOrientation(qreal& q0, qreal& q1, qreal& q2, qreal& q3) const
 /*! Returns the position of the Frame, defined in the world coordinate system. See also
 	orientation(), setPosition() and translation(). */
 Vec Frame::position() const {
-	if (referenceFrame_)
-		return inverseCoordinatesOf(Vec(0.0,0.0,0.0));
-	else
-		return t_;
+	if (!worldCacheIsValid_)
+		updateWorldCache();
+	return worldPosition_;
 }
 
 /*! Returns the orientation of the Frame, defined in the world coordinate system. See also
   position(), setOrientation() and rotation(). */
 Quaternion Frame::orientation() const
 {
-	Quaternion res = rotation();
-	const Frame* fr = referenceFrame();
-	while (fr != NULL)
+	if (!worldCacheIsValid_)
+		updateWorldCache();
+	return worldOrientation_;
+}
+
+// The world position() and orientation() are cached and lazily recomputed from the (cached) values
+// of the referenceFrame(). A valid cache implies that the caches of all the referenceFrame() chain
+// are valid, hence the invalidation stops at the first already invalid Frame.
+void Frame::updateWorldCache() const
+{
+	if (referenceFrame_)
 	{
-		res = fr->rotation() * res;
-		fr  = fr->referenceFrame();
+		worldOrientation_ = referenceFrame_->orientation() * q_;
+		worldPosition_ = referenceFrame_->inverseCoordinatesOf(t_);
 	}
-	return res;
+	else
+	{
+		worldOrientation_ = q_;
+		worldPosition_ = t_;
+	}
+	worldCacheIsValid_ = true;
+}
+
+void Frame::invalidateWorldCache() const
+{
+	if (!worldCacheIsValid_)
+		return;
+
+	worldCacheIsValid_ = false;
+	Q_FOREACH (const Frame* child, children_)
+		child->invalidateWorldCache();
 }
 
 
@@ -587,6 +635,7 @@ void Frame::setRotationWithConstraint(Quaternion& rotation)
 
 	setRotation(this->rotation() * deltaQ);
 	q_.normalize();
+	invalidateWorldCache();
 	rotation = this->rotation();
 }
 
@@ -613,6 +662,7 @@ void Frame::setTranslationAndRotationWithConstraint(Vec& translation, Quaternion
 	translation = this->translation();
 	rotation = this->rotation();
 
+	invalidateWorldCache();
 	Q_EMIT modified();
 }
 
@@ -669,9 +719,16 @@ void Frame::setReferenceFrame(const Frame* const refFrame)
 	else
 	{
 		bool identical = (referenceFrame_ == refFrame);
-		referenceFrame_ = refFrame;
 		if (!identical)
+		{
+			if (referenceFrame_)
+				referenceFrame_->children_.removeOne(this);
+			referenceFrame_ = refFrame;
+			if (referenceFrame_)
+				referenceFrame_->children_.append(this);
+			invalidateWorldCache();
 			Q_EMIT modified();
+		}
 	}
 }
 
@@ -701,10 +758,7 @@ bool Frame::settingAsReferenceFrameWillCreateALoop(const Frame* const frame)
  illustration. */
 Vec Frame::coordinatesOf(const Vec& src) const
 {
-	if (referenceFrame())
-		return localCoordinatesOf(referenceFrame()->coordinatesOf(src));
-	else
-		return localCoordinatesOf(src);
+	return orientation().inverseRotate(src - position());
 }
 
 /*! Returns the world coordinates of the point whose position in the Frame coordinate system is \p
@@ -714,14 +768,7 @@ Vec Frame::coordinatesOf(const Vec& src) const
   instead of 3D coordinates. */
 Vec Frame::inverseCoordinatesOf(const Vec& src) const
 {
-	const Frame* fr = this;
-	Vec res = src;
-	while (fr != NULL)
-	{
-		res = fr->localInverseCoordinatesOf(res);
-		fr  = fr->referenceFrame();
-	}
-	return res;
+	return orientation().rotate(src) + position();
 }
 
 /*! Returns the Frame coordinates of a point \p src defined in the referenceFrame() coordinate
@@ -829,6 +876,76 @@ void Frame::getCoordinatesOfFrom(const qreal src[3], qreal res[3], const Frame*
 		res[i] = r[i];
 }
 
+/*! Array version of getCoordinatesOf(): converts the \p nb points of \p src, packed as successive
+  \c x,y,z triplets (3*nb values), from the world to the Frame coordinate system.
+
+  The transformation matrix is computed once and the points are then converted in a tight loop.
+  Large arrays are split in chunks that are processed in parallel by the \c QThreadPool::globalInstance().
+  \p src and \p res can be identical pointers. */
+void Frame::getCoordinatesOf(const float src[], float res[], int nb) const
+{
+	GLdouble m[16];
+	worldInverse().getMatrix(m);
+	batch::parallelTransform(m, false, batch::packed(src), batch::packed(res), nb);
+}
+
+/*! Same as getCoordinatesOf(const float[], float[], int), with \c double values. */
+void Frame::getCoordinatesOf(const double src[], double res[], int nb) const
+{
+	GLdouble m[16];
+	worldInverse().getMatrix(m);
+	batch::parallelTransform(m, false, batch::packed(src), batch::packed(res), nb);
+}
+
+/*! Same as getCoordinatesOf(const float[], float[], int), with separate coordinate arrays: \p src[0],
+  \p src[1] and \p src[2] (resp. \p res) are the \c x, \c y and \c z arrays of \p nb values. */
+void Frame::getCoordinatesOf(const float* const src[3], float* const res[3], int nb) const
+{
+	GLdouble m[16];
+	worldInverse().getMatrix(m);
+	batch::parallelTransform(m, false, batch::separate<const float>(src), batch::separate<float>(res), nb);
+}
+
+/*! Same as getCoordinatesOf(const float* const[3], float* const[3], int), with \c double values. */
+void Frame::getCoordinatesOf(const double* const src[3], double* const res[3], int nb) const
+{
+	GLdouble m[16];
+	worldInverse().getMatrix(m);
+	batch::parallelTransform(m, false, batch::separate<const double>(src), batch::separate<double>(res), nb);
+}
+
+/*! Array version of getInverseCoordinatesOf(), see getCoordinatesOf(const float[], float[], int). */
+void Frame::getInverseCoordinatesOf(const float src[], float res[], int nb) const
+{
+	GLdouble m[16];
+	Frame(position(), orientation()).getMatrix(m);
+	batch::parallelTransform(m, false, batch::packed(src), batch::packed(res), nb);
+}
+
+/*! Same as getInverseCoordinatesOf(const float[], float[], int), with \c double values. */
+void Frame::getInverseCoordinatesOf(const double src[], double res[], int nb) const
+{
+	GLdouble m[16];
+	Frame(position(), orientation()).getMatrix(m);
+	batch::parallelTransform(m, false, batch::packed(src), batch::packed(res), nb);
+}
+
+/*! Array version of getInverseCoordinatesOf(), see getCoordinatesOf(const float* const[3], float* const[3], int). */
+void Frame::getInverseCoordinatesOf(const float* const src[3], float* const res[3], int nb) const
+{
+	GLdouble m[16];
+	Frame(position(), orientation()).getMatrix(m);
+	batch::parallelTransform(m, false, batch::separate<const float>(src), batch::separate<float>(res), nb);
+}
+
+/*! Same as getInverseCoordinatesOf(const float* const[3], float* const[3], int), with \c double values. */
+void Frame::getInverseCoordinatesOf(const double* const src[3], double* const res[3], int nb) const
+{
+	GLdouble m[16];
+	Frame(position(), orientation()).getMatrix(m);
+	batch::parallelTransform(m, false, batch::separate<const double>(src), batch::separate<double>(res), nb);
+}
+
 
 ///////////////////////// FRAME TRANSFORMATIONS OF VECTORS //////////////////////////////
 
@@ -842,10 +959,7 @@ void Frame::getCoordinatesOfFrom(const qreal src[3], qreal res[3], const Frame*
  illustration. */
 Vec Frame::transformOf(const Vec& src) const
 {
-	if (referenceFrame())
-		return localTransformOf(referenceFrame()->transformOf(src));
-	else
-		return localTransformOf(src);
+	return orientation().inverseRotate(src);
 }
 
 /*! Returns the world transform of the vector whose coordinates in the Frame coordinate
@@ -855,14 +969,7 @@ Vec Frame::transformOf(const Vec& src) const
   coordinates instead of 3D vectors. */
 Vec Frame::inverseTransformOf(const Vec& src) const
 {
-	const Frame* fr = this;
-	Vec res = src;
-	while (fr != NULL)
-	{
-		res = fr->localInverseTransformOf(res);
-		fr  = fr->referenceFrame();
-	}
-	return res;
+	return orientation().rotate(src);
 }
 
 /*! Returns the Frame transform of a vector \p src defined in the referenceFrame() coordinate system
@@ -88,6 +88,12 @@ namespace qglviewer {
   settingAsReferenceFrameWillCreateALoop() checks this and prevents setReferenceFrame() from
   creating such a loop.
 
+  The world position() and orientation() of a Frame are cached. They are only recomputed when the
+  Frame or one of its referenceFrame() ancestors has been modified, so that coordinatesOf() and
+  inverseCoordinatesOf() do not depend on the depth of the hierarchy. Since this cache is updated
+  by \c const methods, concurrent queries on a Frame hierarchy from different threads should be
+  protected.
+
   This frame hierarchy is used in methods like coordinatesOfIn(), coordinatesOfFrom()... which allow
   coordinates (or vector) conversions from a Frame to any other one (including the world coordinate
   system).
@@ -125,8 +131,7 @@ class QGLVIEWER_EXPORT Frame : public QObject
 public:
 	Frame();
 
-	/*! Virtual destructor. Empty. */
-	virtual ~Frame() {}
+	virtual ~Frame();
 
 	Frame(const Frame& frame);
 	Frame& operator=(const Frame& frame);
@@ -198,7 +203,7 @@ public:
 
 	Use setPosition() to define the world coordinates position(). Use
 	setTranslationWithConstraint() to take into account the potential constraint() of the Frame. */
-	void setTranslation(const Vec& translation) { t_ = translation; Q_EMIT modified(); }
+	void setTranslation(const Vec& translation) { t_ = translation; invalidateWorldCache(); Q_EMIT modified(); }
 	void setTranslation(qreal x, qreal y, qreal z);
 	void setTranslationWithConstraint(Vec& translation);
 
@@ -212,7 +217,7 @@ public:
 	 Use setOrientation() to define the world coordinates orientation(). The potential
 	 constraint() of the Frame is not taken into account, use setRotationWithConstraint()
 	 instead. */
-	void setRotation(const Quaternion& rotation) { q_ = rotation; Q_EMIT modified(); }
+	void setRotation(const Quaternion& rotation) { q_ = rotation; invalidateWorldCache(); Q_EMIT modified(); }
 	void setRotation(qreal q0, qreal q1, qreal q2, qreal q3);
 	void setRotationWithConstraint(Quaternion& rotation);
 
@@ -304,6 +309,15 @@ public:
 	void getLocalInverseCoordinatesOf(const qreal src[3], qreal res[3]) const;
 	void getCoordinatesOfIn(const qreal src[3], qreal res[3], const Frame* const in) const;
 	void getCoordinatesOfFrom(const qreal src[3], qreal res[3], const Frame* const from) const;
+
+	void getCoordinatesOf(const float src[], float res[], int nb) const;
+	void getCoordinatesOf(const double src[], double res[], int nb) const;
+	void getCoordinatesOf(const float* const src[3], float* const res[3], int nb) const;
+	void getCoordinatesOf(const double* const src[3], double* const res[3], int nb) const;
+	void getInverseCoordinatesOf(const float src[], float res[], int nb) const;
+	void getInverseCoordinatesOf(const double src[], double res[], int nb) const;
+	void getInverseCoordinatesOf(const float* const src[3], float* const res[3], int nb) const;
+	void getInverseCoordinatesOf(const double* const src[3], double* const res[3], int nb) const;
 	//@}
 
 	/*! @name Coordinate system transformation of vectors */
@@ -408,6 +422,15 @@ private:
 
 	// F r a m e   c o m p o s i t i o n
 	const Frame* referenceFrame_;
+	// Frames which referenceFrame() is this Frame, invalidated with it.
+	mutable QList<Frame*> children_;
+
+	// C a c h e d   w o r l d   p o s i t i o n   a n d   o r i e n t a t i o n
+	void invalidateWorldCache() const;
+	void updateWorldCache() const;
+	mutable Vec worldPosition_;
+	mutable Quaternion worldOrientation_;
+	mutable bool worldCacheIsValid_;
 };
 
 } // namespace qglviewer
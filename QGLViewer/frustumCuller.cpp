@@ -0,0 +1,415 @@
+/****************************************************************************
+
+ Copyright (C) 2002-2014 Gilles Debunne. All rights reserved.
+
+ This file is part of the QGLViewer library version 2.6.3.
+
+ http://www.libqglviewer.com - contact@libqglviewer.com
+
+ This file may be used under the terms of the GNU General Public License 
+ versions 2.0 or 3.0 as published by the Free Software Foundation and
+ appearing in the LICENSE file included in the packaging of this file.
+ In addition, as a special exception, Gilles Debunne gives you certain 
+ additional rights, described in the file GPL_EXCEPTION in this package.
+
+ libQGLViewer uses dual licensing. Commercial/proprietary software must
+ purchase a libQGLViewer Commercial License.
+
+ This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+ WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+
+*****************************************************************************/
+
+#include "frustumCuller.h"
+#include "camera.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+# define QGLVIEWER_FRUSTUM_CULLER_SSE
+# include <xmmintrin.h>
+#endif
+
+using namespace qglviewer;
+using namespace std;
+
+// Maximum number of objects in a hierarchy leaf.
+static const int LEAF_SIZE = 8;
+
+// A sphere "extent" is stored in the first lane only, its radius is hence weighted by (1,0,0).
+static const float SPHERE_WEIGHT[6][3] = { {1,0,0}, {1,0,0}, {1,0,0}, {1,0,0}, {1,0,0}, {1,0,0} };
+
+#ifndef DOXYGEN
+namespace {
+	// Orders object indices along one axis of their bounding box centers.
+	class CenterLess
+	{
+	public:
+		CenterLess(const vector<float>& centers, int axis) : centers_(centers), axis_(axis) {}
+		bool operator()(int i, int j) const { return centers_[3*i+axis_] < centers_[3*j+axis_]; }
+	private:
+		const vector<float>& centers_;
+		int axis_;
+	};
+}
+#endif
+
+/*! Creates a FrustumCuller. Use setFrustum() before any culling. */
+FrustumCuller::FrustumCuller()
+	: nbObjects_(0)
+{
+	for (int i=0; i<6; ++i)
+	{
+		for (int j=0; j<4; ++j)
+			normal_[i][j] = 0.0f;
+		for (int j=0; j<3; ++j)
+			absNormal_[i][j] = 0.0f;
+	}
+}
+
+/*! Sets the frustum planes to those of \p camera, using Camera::getFrustumPlanesCoefficients().
+
+Call this method each time the camera is modified, typically at the beginning of your
+QGLViewer::draw() method. */
+void FrustumCuller::setFrustum(const Camera* const camera)
+{
+	GLdouble coef[6][4];
+	camera->getFrustumPlanesCoefficients(coef);
+	setFrustumPlanes(coef);
+}
+
+/*! Sets the six frustum planes, given in the Camera::getFrustumPlanesCoefficients() format.
+
+Plane normals must be normalized and point outside of the frustum: a point \c p is outside the
+plane \c i when \c coef[i][0]*p.x + \c coef[i][1]*p.y + \c coef[i][2]*p.z > \c coef[i][3]. */
+void FrustumCuller::setFrustumPlanes(const GLdouble coef[6][4])
+{
+	for (int i=0; i<6; ++i)
+	{
+		for (int j=0; j<4; ++j)
+			normal_[i][j] = float(coef[i][j]);
+		for (int j=0; j<3; ++j)
+			absNormal_[i][j] = fabs(normal_[i][j]);
+	}
+}
+
+void FrustumCuller::resetCoherency(int nbGroups)
+{
+	if (int(lastPlane_.size()) != nbGroups)
+		lastPlane_.assign(nbGroups, 0);
+}
+
+// Tests up to 4 objects (given as centers and extents in lanes, see cullBoxes()) against the
+// frustum planes. Returns the bitmask of the rejected lanes. Lanes not in laneMask are ignored.
+// The tests start with lastPlane, which is updated with the plane that rejected the objects.
+int FrustumCuller::rejectGroup(const float lanes[6][4], const float weight[6][3], int laneMask, unsigned char& lastPlane) const
+{
+	const int all = 0xF;
+	int rejected = all & ~laneMask;
+	int firstReject = -1;
+
+#ifdef QGLVIEWER_FRUSTUM_CULLER_SSE
+	const __m128 cx = _mm_loadu_ps(lanes[0]);
+	const __m128 cy = _mm_loadu_ps(lanes[1]);
+	const __m128 cz = _mm_loadu_ps(lanes[2]);
+	const __m128 ex = _mm_loadu_ps(lanes[3]);
+	const __m128 ey = _mm_loadu_ps(lanes[4]);
+	const __m128 ez = _mm_loadu_ps(lanes[5]);
+#endif
+
+	for (int k=0; k<6; ++k)
+	{
+		int p = lastPlane + k;
+		if (p >= 6)
+			p -= 6;
+
+#ifdef QGLVIEWER_FRUSTUM_CULLER_SSE
+		const __m128 dist = _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(normal_[p][0]), cx),
+															 _mm_mul_ps(_mm_set1_ps(normal_[p][1]), cy)),
+												  _mm_mul_ps(_mm_set1_ps(normal_[p][2]), cz)),
+									   _mm_set1_ps(normal_[p][3]));
+		const __m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(weight[p][0]), ex),
+											   _mm_mul_ps(_mm_set1_ps(weight[p][1]), ey)),
+									_mm_mul_ps(_mm_set1_ps(weight[p][2]), ez));
+		const int out = _mm_movemask_ps(_mm_cmpgt_ps(dist, r));
+#else
+		int out = 0;
+		for (int l=0; l<4; ++l)
+		{
+			const float dist = normal_[p][0]*lanes[0][l] + normal_[p][1]*lanes[1][l] + normal_[p][2]*lanes[2][l] - normal_[p][3];
+			const float r = weight[p][0]*lanes[3][l] + weight[p][1]*lanes[4][l] + weight[p][2]*lanes[5][l];
+			if (dist > r)
+				out |= 1 << l;
+		}
+#endif
+
+		if (out & ~rejected)
+		{
+			if (firstReject < 0)
+				firstReject = p;
+			rejected |= out;
+			if (rejected == all)
+			{
+				lastPlane = (unsigned char)(p);
+				return rejected;
+			}
+		}
+	}
+
+	if (firstReject >= 0)
+		lastPlane = (unsigned char)(firstReject);
+	return rejected & laneMask;
+}
+
+/*! Tests \p nb axis aligned bounding boxes against the frustum planes (see setFrustum()).
+
+\p boxMin and \p boxMax hold the \c x,y,z min and max corners of each box (3*nb floats each).
+Bit \c i of \p visible is set if box \c i intersects the frustum, see isVisible(). \p visible must
+hold at least \c (nb+31)/32 words.
+
+The test is conservative: boxes that intersect the frustum are never culled, but a few boxes
+located near the frustum corners may be reported visible. */
+void FrustumCuller::cullBoxes(const float* boxMin, const float* boxMax, int nb, quint32* visible)
+{
+	const int nbGroups = (nb+3) / 4;
+	resetCoherency(nbGroups);
+	fill(visible, visible + (nb+31)/32, 0u);
+
+	float lanes[6][4];
+	for (int g=0; g<nbGroups; ++g)
+	{
+		const int base = 4*g;
+		const int n = min(4, nb-base);
+		for (int l=0; l<4; ++l)
+		{
+			if (l < n)
+			{
+				const float* bmin = boxMin + 3*(base+l);
+				const float* bmax = boxMax + 3*(base+l);
+				for (int j=0; j<3; ++j)
+				{
+					lanes[j][l]   = 0.5f * (bmin[j] + bmax[j]);
+					lanes[3+j][l] = 0.5f * (bmax[j] - bmin[j]);
+				}
+			}
+			else
+				for (int j=0; j<6; ++j)
+					lanes[j][l] = 0.0f;
+		}
+
+		const int laneMask = (1 << n) - 1;
+		const int rejected = rejectGroup(lanes, absNormal_, laneMask, lastPlane_[g]);
+		visible[base >> 5] |= quint32(~rejected & laneMask) << (base & 31);
+	}
+}
+
+/*! Same as cullBoxes(), but with bounding spheres.
+
+\p center holds the \c x,y,z coordinates of the \p nb sphere centers, and \p radius their \p nb
+radii. */
+void FrustumCuller::cullSpheres(const float* center, const float* radius, int nb, quint32* visible)
+{
+	const int nbGroups = (nb+3) / 4;
+	resetCoherency(nbGroups);
+	fill(visible, visible + (nb+31)/32, 0u);
+
+	float lanes[6][4];
+	for (int g=0; g<nbGroups; ++g)
+	{
+		const int base = 4*g;
+		const int n = min(4, nb-base);
+		for (int l=0; l<4; ++l)
+		{
+			for (int j=0; j<3; ++j)
+				lanes[j][l] = (l < n) ? center[3*(base+l)+j] : 0.0f;
+			lanes[3][l] = (l < n) ? radius[base+l] : 0.0f;
+			lanes[4][l] = 0.0f;
+			lanes[5][l] = 0.0f;
+		}
+
+		const int laneMask = (1 << n) - 1;
+		const int rejected = rejectGroup(lanes, SPHERE_WEIGHT, laneMask, lastPlane_[g]);
+		visible[base >> 5] |= quint32(~rejected & laneMask) << (base & 31);
+	}
+}
+
+/*! Creates a bounding volume hierarchy on the \p nb boxes, see cullHierarchy().
+
+Parameters are the same as for cullBoxes(). The boxes are copied: call this method again when they
+are modified. */
+void FrustumCuller::buildHierarchy(const float* boxMin, const float* boxMax, int nb)
+{
+	clearHierarchy();
+	if (nb <= 0)
+		return;
+
+	nbObjects_ = nb;
+	objectCenter_.resize(3*nb);
+	objectExtent_.resize(3*nb);
+	objectIndex_.resize(nb);
+	objectLastPlane_.assign(nb, 0);
+	for (int i=0; i<nb; ++i)
+	{
+		for (int j=0; j<3; ++j)
+		{
+			objectCenter_[3*i+j] = 0.5f * (boxMin[3*i+j] + boxMax[3*i+j]);
+			objectExtent_[3*i+j] = 0.5f * (boxMax[3*i+j] - boxMin[3*i+j]);
+		}
+		objectIndex_[i] = i;
+	}
+
+	nodes_.reserve(2 * (nb / LEAF_SIZE + 1));
+	buildNode(0, nb);
+}
+
+// Creates the node holding objectIndex_[first..first+count[ and its subtree. Objects are split at
+// the median of the longest axis of the node. Returns the index of the node in nodes_.
+int FrustumCuller::buildNode(int first, int count)
+{
+	float bmin[3], bmax[3];
+	for (int j=0; j<3; ++j)
+	{
+		bmin[j] =  HUGE_VAL;
+		bmax[j] = -HUGE_VAL;
+	}
+	for (int i=first; i<first+count; ++i)
+	{
+		const int o = objectIndex_[i];
+		for (int j=0; j<3; ++j)
+		{
+			bmin[j] = min(bmin[j], objectCenter_[3*o+j] - objectExtent_[3*o+j]);
+			bmax[j] = max(bmax[j], objectCenter_[3*o+j] + objectExtent_[3*o+j]);
+		}
+	}
+
+	const int index = int(nodes_.size());
+	Node node;
+	for (int j=0; j<3; ++j)
+	{
+		node.center[j] = 0.5f * (bmin[j] + bmax[j]);
+		node.extent[j] = 0.5f * (bmax[j] - bmin[j]);
+	}
+	node.secondChild = -1;
+	node.first = first;
+	node.count = count;
+	node.lastPlane = 0;
+	nodes_.push_back(node);
+
+	if (count > LEAF_SIZE)
+	{
+		int axis = 0;
+		if (node.extent[1] > node.extent[axis]) axis = 1;
+		if (node.extent[2] > node.extent[axis]) axis = 2;
+
+		const int half = count / 2;
+		nth_element(objectIndex_.begin() + first, objectIndex_.begin() + first + half,
+					objectIndex_.begin() + first + count, CenterLess(objectCenter_, axis));
+
+		buildNode(first, half);
+		const int second = buildNode(first + half, count - half);
+		nodes_[index].secondChild = second;
+	}
+
+	return index;
+}
+
+/*! Deletes the hierarchy created by buildHierarchy(). */
+void FrustumCuller::clearHierarchy()
+{
+	nodes_.clear();
+	objectIndex_.clear();
+	objectCenter_.clear();
+	objectExtent_.clear();
+	objectLastPlane_.clear();
+	nbObjects_ = 0;
+}
+
+// Classifies the box (center c, half extent e) with respect to the planes of planeMask.
+// Returns -1 if it is outside, 1 if it is inside all the planes and 0 otherwise. Planes the box is
+// fully inside of are removed from planeMask. lastPlane is tested first and updated on rejection.
+int FrustumCuller::classifyBox(const float c[3], const float e[3], int& planeMask, unsigned char& lastPlane) const
+{
+	for (int k=0; k<6; ++k)
+	{
+		int p = lastPlane + k;
+		if (p >= 6)
+			p -= 6;
+		if (!(planeMask & (1 << p)))
+			continue;
+
+		const float dist = normal_[p][0]*c[0] + normal_[p][1]*c[1] + normal_[p][2]*c[2] - normal_[p][3];
+		const float r = absNormal_[p][0]*e[0] + absNormal_[p][1]*e[1] + absNormal_[p][2]*e[2];
+		if (dist > r)
+		{
+			lastPlane = (unsigned char)(p);
+			return -1;
+		}
+		if (dist < -r)
+			planeMask &= ~(1 << p);
+	}
+	return planeMask ? 0 : 1;
+}
+
+/*! Same as cullBoxes(), using the hierarchy created by buildHierarchy() on the boxes.
+
+Subtrees that are outside of the frustum are skipped, and the planes a node is fully inside of are
+no longer tested for its descendants. \p visible must hold at least \c (nb+31)/32 words, where \c nb
+is the number of boxes given to buildHierarchy(). Nothing is done if hasHierarchy() is \c false. */
+void FrustumCuller::cullHierarchy(quint32* visible)
+{
+	if (!hasHierarchy())
+		return;
+
+	fill(visible, visible + (nbObjects_+31)/32, 0u);
+
+	// Median splits make the tree balanced: its depth is less than 32.
+	int nodeStack[64];
+	int maskStack[64];
+	int top = 0;
+	nodeStack[0] = 0;
+	maskStack[0] = 0x3F;
+
+	while (top >= 0)
+	{
+		const int current = nodeStack[top];
+		Node& node = nodes_[current];
+		int planeMask = maskStack[top];
+		--top;
+
+		const int status = classifyBox(node.center, node.extent, planeMask, node.lastPlane);
+		if (status < 0)
+			continue;
+
+		if (status > 0)
+		{
+			// Fully inside: the whole subtree is visible
+			for (int i=node.first; i<node.first+node.count; ++i)
+			{
+				const int o = objectIndex_[i];
+				visible[o >> 5] |= 1u << (o & 31);
+			}
+			continue;
+		}
+
+		if (node.secondChild < 0)
+		{
+			for (int i=node.first; i<node.first+node.count; ++i)
+			{
+				const int o = objectIndex_[i];
+				int objectMask = planeMask;
+				if (classifyBox(&objectCenter_[3*o], &objectExtent_[3*o], objectMask, objectLastPlane_[o]) >= 0)
+					visible[o >> 5] |= 1u << (o & 31);
+			}
+			continue;
+		}
+
+		// First child is stored right after its parent
+		++top;
+		nodeStack[top] = node.secondChild;
+		maskStack[top] = planeMask;
+		++top;
+		nodeStack[top] = current + 1;
+		maskStack[top] = planeMask;
+	}
+}
@@ -0,0 +1,131 @@
+/****************************************************************************
+
+ Copyright (C) 2002-2014 Gilles Debunne. All rights reserved.
+
+ This file is part of the QGLViewer library version 2.6.3.
+
+ http://www.libqglviewer.com - contact@libqglviewer.com
+
+ This file may be used under the terms of the GNU General Public License 
+ versions 2.0 or 3.0 as published by the Free Software Foundation and
+ appearing in the LICENSE file included in the packaging of this file.
+ In addition, as a special exception, Gilles Debunne gives you certain 
+ additional rights, described in the file GPL_EXCEPTION in this package.
+
+ libQGLViewer uses dual licensing. Commercial/proprietary software must
+ purchase a libQGLViewer Commercial License.
+
+ This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+ WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+
+*****************************************************************************/
+
+#ifndef QGLVIEWER_FRUSTUM_CULLER_H
+#define QGLVIEWER_FRUSTUM_CULLER_H
+
+#include <vector>
+
+#include "config.h"
+
+namespace qglviewer {
+class Camera;
+/*! \brief Culls large sets of bounding volumes against a Camera frustum.
+  \class FrustumCuller frustumCuller.h QGLViewer/frustumCuller.h
+
+  A FrustumCuller holds the six planes returned by Camera::getFrustumPlanesCoefficients() and tests
+  arrays of axis aligned bounding boxes or spheres against them. The result is a visibility
+  bitmask: bit \c i%32 of word \c i/32 is set when object \c i intersects the frustum. The mask must
+  hence hold at least \c (nb+31)/32 words.
+
+  Typical usage, in your QGLViewer::draw() method:
+  \code
+  culler.setFrustum(camera());
+  culler.cullBoxes(boxMin, boxMax, nbObjects, visible);
+  for (int i=0; i<nbObjects; ++i)
+	if (FrustumCuller::isVisible(visible, i))
+	  drawObject(i);
+  \endcode
+
+  \p boxMin and \p boxMax (resp. sphere centers) are packed \c x,y,z float triplets, in the same
+  coordinate system as the Camera (i.e. the world coordinate system).
+
+  Boxes are tested four at a time using SSE when it is available (a scalar version is used
+  otherwise). The index of the plane that rejected a group of objects is remembered and tested
+  first at the next call, which quickly rejects objects that stay out of the frustum as the
+  camera moves smoothly. This cache is reset when the number of objects changes.
+
+  For very large static scenes, buildHierarchy() creates a bounding volume hierarchy on the boxes,
+  and cullHierarchy() then skips whole subtrees that are fully outside (or fully inside) the
+  frustum. Call buildHierarchy() again when the boxes are modified. */
+class QGLVIEWER_EXPORT FrustumCuller
+{
+public:
+	FrustumCuller();
+
+	/*! @name Frustum planes */
+	//@{
+public:
+	void setFrustum(const Camera* const camera);
+	void setFrustumPlanes(const GLdouble coef[6][4]);
+	//@}
+
+	/*! @name Culling */
+	//@{
+public:
+	void cullBoxes(const float* boxMin, const float* boxMax, int nb, quint32* visible);
+	void cullSpheres(const float* center, const float* radius, int nb, quint32* visible);
+
+	/*! Returns \c true when bit \p i of the \p visible bitmask (filled by one of the cull
+	methods) is set. */
+	static bool isVisible(const quint32* visible, int i) { return (visible[i >> 5] >> (i & 31)) & 1u; }
+	//@}
+
+	/*! @name Bounding volume hierarchy */
+	//@{
+public:
+	void buildHierarchy(const float* boxMin, const float* boxMax, int nb);
+	void clearHierarchy();
+	/*! Returns \c true when a hierarchy was created by buildHierarchy(). */
+	bool hasHierarchy() const { return !nodes_.empty(); }
+	void cullHierarchy(quint32* visible);
+	//@}
+
+private:
+	int rejectGroup(const float lanes[6][4], const float weight[6][3], int laneMask, unsigned char& lastPlane) const;
+	int classifyBox(const float c[3], const float e[3], int& planeMask, unsigned char& lastPlane) const;
+	void resetCoherency(int nbGroups);
+
+#ifndef DOXYGEN
+	struct Node
+	{
+		float center[3];
+		float extent[3];
+		// Inner node: index of the second child (first one is next in nodes_).
+		// Leaf: range of objects in objectIndex_.
+		int secondChild;
+		int first, count;
+		unsigned char lastPlane;
+	};
+#endif
+
+	int buildNode(int first, int count);
+
+	// F r u s t u m   p l a n e s
+	float normal_[6][4]; // x, y, z and distance
+	float absNormal_[6][3];
+
+	// P l a n e   c o h e r e n c y
+	std::vector<unsigned char> lastPlane_;
+
+	// H i e r a r c h y
+	std::vector<Node> nodes_;
+	std::vector<int> objectIndex_;
+	std::vector<float> objectCenter_;
+	std::vector<float> objectExtent_;
+	std::vector<unsigned char> objectLastPlane_;
+	int nbObjects_;
+};
+
+} // namespace qglviewer
+
+#endif // QGLVIEWER_FRUSTUM_CULLER_H
@@ -23,6 +23,8 @@
 #include "domUtils.h"
 #include "qglviewer.h" // for QGLViewer::drawAxis and Camera::drawCamera
 
+#include <algorithm>
+
 using namespace qglviewer;
 using namespace std;
 
@@ -34,7 +36,8 @@ using namespace std;
   values. */
 KeyFrameInterpolator::KeyFrameInterpolator(Frame* frame)
 	: frame_(NULL), period_(40), interpolationTime_(0.0), interpolationSpeed_(1.0), interpolationStarted_(false),
-	  closedPath_(false), loopInterpolation_(false), pathIsValid_(false), valuesAreValid_(true), currentFrameValid_(false)
+	  closedPath_(false), loopInterpolation_(false), pathIsValid_(false), valuesAreValid_(true), currentFrameValid_(false),
+	  bakeRate_(0.0), bakedPathIsValid_(false)
 	// #CONNECTION# Values cut pasted initFromDOMElement()
 {
 	setFrame(frame);
@@ -187,6 +190,7 @@ void KeyFrameInterpolator::addKeyFrame(const Frame* const frame, qreal time)
 	valuesAreValid_ = false;
 	pathIsValid_ = false;
 	currentFrameValid_ = false;
+	bakedPathIsValid_ = false;
 	resetInterpolation();
 }
 
@@ -210,6 +214,7 @@ void KeyFrameInterpolator::addKeyFrame(const Frame& frame, qreal time)
 	valuesAreValid_ = false;
 	pathIsValid_ = false;
 	currentFrameValid_ = false;
+	bakedPathIsValid_ = false;
 	resetInterpolation();
 }
 
@@ -253,6 +258,7 @@ void KeyFrameInterpolator::deletePath()
 	pathIsValid_ = false;
 	valuesAreValid_ = false;
 	currentFrameValid_ = false;
+	bakedPathIsValid_ = false;
 }
 
 static void drawCamera(qreal scale)
@@ -566,6 +572,9 @@ void KeyFrameInterpolator::updateSplineCache()
   If you simply want to change interpolationTime() but not the frame() state, use
   setInterpolationTime() instead.
 
+  When pathIsBaked(), the frame() state is interpolated between the two closest baked samples
+  and the frame() constraint() is ignored (see bakePath()).
+
   Emits the interpolated() signal and makes the frame() emit the Frame::interpolated() signal. */
 void KeyFrameInterpolator::interpolateAtTime(qreal time)
 {
@@ -574,6 +583,28 @@ void KeyFrameInterpolator::interpolateAtTime(qreal time)
 	if ((keyFrame_.isEmpty()) || (!frame()))
 		return;
 
+	Vec pos;
+	Quaternion q;
+	if (pathIsBaked())
+	{
+		if (!bakedPathIsValid_)
+			updateBakedPath();
+
+		getBakedValuesAtTime(time, pos, q);
+		frame()->setPositionAndOrientation(pos, q);
+	}
+	else
+	{
+		getSplineValuesAtTime(time, pos, q);
+		frame()->setPositionAndOrientationWithConstraint(pos, q);
+	}
+
+	Q_EMIT interpolated();
+}
+
+// Evaluates the spline path at time. keyFrame_ must not be empty.
+void KeyFrameInterpolator::getSplineValuesAtTime(qreal time, Vec& pos, Quaternion& q)
+{
 	if (!valuesAreValid_)
 		updateModifiedFrameValues();
 
@@ -591,12 +622,110 @@ void KeyFrameInterpolator::interpolateAtTime(qreal time)
 
 	// Linear interpolation - debug
 	// Vec pos = alpha*(currentFrame_[2]->peekNext()->position()) + (1.0-alpha)*(currentFrame_[1]->peekNext()->position());
-	Vec pos = currentFrame_[1]->peekNext()->position() + alpha * (currentFrame_[1]->peekNext()->tgP() + alpha * (v1+alpha*v2));
-	Quaternion q = Quaternion::squad(currentFrame_[1]->peekNext()->orientation(), currentFrame_[1]->peekNext()->tgQ(),
+	pos = currentFrame_[1]->peekNext()->position() + alpha * (currentFrame_[1]->peekNext()->tgP() + alpha * (v1+alpha*v2));
+	q = Quaternion::squad(currentFrame_[1]->peekNext()->orientation(), currentFrame_[1]->peekNext()->tgQ(),
 			currentFrame_[2]->peekNext()->tgQ(), currentFrame_[2]->peekNext()->orientation(), alpha);
-	frame()->setPositionAndOrientationWithConstraint(pos, q);
+}
 
-	Q_EMIT interpolated();
+/*! Samples the path at \p sampleRate samples per second, so that subsequent interpolateAtTime()
+  calls simply interpolate between the two closest samples.
+
+  The spline is evaluated every 1/\p sampleRate seconds from firstTime() to lastTime() and the
+  results are stored in contiguous arrays. During playback, the samples surrounding the
+  interpolationTime() are found with a binary search: no keyFrame iterators are used and no memory
+  is allocated. This is especially useful for long paths with many keyFrames.
+
+  The samples are automatically updated when the path is modified (when keyFrames are added, or
+  when a keyFrame defined by a pointer is modified). A null or negative \p sampleRate is equivalent
+  to clearBakedPath().
+
+  \attention The frame() constraint() is not taken into account when pathIsBaked(). */
+void KeyFrameInterpolator::bakePath(qreal sampleRate)
+{
+	if (sampleRate <= 0.0)
+	{
+		clearBakedPath();
+		return;
+	}
+
+	bakeRate_ = sampleRate;
+	updateBakedPath();
+}
+
+/*! Removes the samples created by bakePath(). The path is then evaluated at each
+  interpolateAtTime() call. */
+void KeyFrameInterpolator::clearBakedPath()
+{
+	bakeRate_ = 0.0;
+	bakedPathIsValid_ = false;
+	bakedTime_.clear();
+	bakedPosition_.clear();
+	bakedOrientation_.clear();
+}
+
+void KeyFrameInterpolator::updateBakedPath()
+{
+	bakedTime_.clear();
+	bakedPosition_.clear();
+	bakedOrientation_.clear();
+
+	if (!keyFrame_.isEmpty())
+	{
+		const qreal first = firstTime();
+		const qreal last  = lastTime();
+		const int nb = int((last - first) * bakeRate_) + 2;
+		bakedTime_.reserve(nb);
+		bakedPosition_.reserve(nb);
+		bakedOrientation_.reserve(nb);
+
+		Vec pos;
+		Quaternion q;
+		for (int i=0; ; ++i)
+		{
+			qreal time = first + i / bakeRate_;
+			if (time > last)
+			{
+				// Make sure lastTime() is exactly sampled
+				if (bakedTime_.last() >= last)
+					break;
+				time = last;
+			}
+
+			getSplineValuesAtTime(time, pos, q);
+			bakedTime_.append(time);
+			bakedPosition_.append(pos);
+			bakedOrientation_.append(q);
+		}
+	}
+
+	bakedPathIsValid_ = true;
+}
+
+// Interpolates between the two baked samples surrounding time. bakedTime_ must not be empty.
+void KeyFrameInterpolator::getBakedValuesAtTime(qreal time, Vec& pos, Quaternion& q) const
+{
+	const qreal* begin = bakedTime_.constData();
+	const qreal* end = begin + bakedTime_.size();
+	const qreal* next = std::upper_bound(begin, end, time);
+
+	if (next == begin)
+	{
+		pos = bakedPosition_.at(0);
+		q = bakedOrientation_.at(0);
+		return;
+	}
+
+	if (next == end)
+	{
+		pos = bakedPosition_.at(bakedPosition_.size()-1);
+		q = bakedOrientation_.at(bakedOrientation_.size()-1);
+		return;
+	}
+
+	const int i = int(next - begin) - 1;
+	const qreal alpha = (time - begin[i]) / (begin[i+1] - begin[i]);
+	pos = (1.0-alpha) * bakedPosition_.at(i) + alpha * bakedPosition_.at(i+1);
+	q = Quaternion::slerp(bakedOrientation_.at(i), bakedOrientation_.at(i+1), alpha);
 }
 
 /*! Returns an XML \c QDomElement that represents the KeyFrameInterpolator.
@@ -673,6 +802,7 @@ void KeyFrameInterpolator::initFromDOMElement(const QDomElement& element)
 	pathIsValid_ = false;
 	valuesAreValid_ = false;
 	currentFrameValid_ = false;
+	bakedPathIsValid_ = false;
 
 	stopInterpolation();
 }
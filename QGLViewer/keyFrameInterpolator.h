@@ -273,6 +273,19 @@ public Q_SLOTS:
 	virtual void interpolateAtTime(qreal time);
 	//@}
 
+	/*! @name Baked path */
+	//@{
+public:
+	/*! Returns \c true when the path has been sampled using bakePath(). */
+	bool pathIsBaked() const { return bakeRate_ > 0.0; }
+	/*! Returns the number of samples per second used by bakePath(). 0.0 when the path is not
+	baked. */
+	qreal bakeRate() const { return bakeRate_; }
+public Q_SLOTS:
+	void bakePath(qreal sampleRate);
+	void clearBakedPath();
+	//@}
+
 	/*! @name Path drawing */
 	//@{
 public:
@@ -288,7 +301,7 @@ public:
 
 private Q_SLOTS:
 	virtual void update();
-	virtual void invalidateValues() { valuesAreValid_ = false; pathIsValid_ = false; splineCacheIsValid_ = false; }
+	virtual void invalidateValues() { valuesAreValid_ = false; pathIsValid_ = false; splineCacheIsValid_ = false; bakedPathIsValid_ = false; }
 
 private:
 	// Copy constructor and opertor= are declared private and undefined
@@ -299,6 +312,9 @@ private:
 	void updateCurrentKeyFrameForTime(qreal time);
 	void updateModifiedFrameValues();
 	void updateSplineCache();
+	void getSplineValuesAtTime(qreal time, Vec& pos, Quaternion& q);
+	void updateBakedPath();
+	void getBakedValuesAtTime(qreal time, Vec& pos, Quaternion& q) const;
 
 #ifndef DOXYGEN
 	// Internal private KeyFrame representation
@@ -350,6 +366,13 @@ private:
 	bool currentFrameValid_;
 	bool splineCacheIsValid_;
 	Vec v1, v2;
+
+	// B a k e d   p a t h
+	qreal bakeRate_;
+	bool bakedPathIsValid_;
+	QVector<qreal> bakedTime_;
+	QVector<Vec> bakedPosition_;
+	QVector<Quaternion> bakedOrientation_;
 };
 
 } // namespace qglviewer
@@ -469,8 +469,8 @@ public:
 	QStringList formatList = QImage::outputFormatList();
 	\endcode
 
-	If the library was compiled with the vectorial rendering option (default), three additional
-	vectorial formats are available: \c "EPS", \c "PS" and \c "XFIG". \c "SVG" and \c "PDF" formats
+	If the library was compiled with the vectorial rendering option (default), four additional
+	vectorial formats are available: \c "EPS", \c "PS", \c "XFIG" and \c "SVG". The \c "PDF" format
 	should soon be available. The <a href="http://artis.imag.fr/Software/VRender">VRender library</a>
 	was created by Cyril Soler.
 
@@ -100,10 +100,11 @@ void QGLViewer::initializeSnapshotFormats()
 	//  	      qWarning((*it++).);  QT4 change this. qWarning no longer accepts QString
 
 #ifndef NO_VECTORIAL_RENDER
-	// We add the 3 vectorial formats to the list
+	// We add the 4 vectorial formats to the list
 	formatList += "EPS";
 	formatList += "PS";
 	formatList += "XFIG";
+	formatList += "SVG";
 #endif
 
 	// Check that the interesting formats are available and add them in "formats"
@@ -116,6 +117,7 @@ void QGLViewer::initializeSnapshotFormats()
 	QtText += "PPM";	MenuText += "24bit RGB Bitmap (*.ppm)";	Ext += "ppm";
 	QtText += "BMP";	MenuText += "Windows Bitmap (*.bmp)";	Ext += "bmp";
 	QtText += "XFIG";	MenuText += "XFig (*.fig)";		Ext += "fig";
+	QtText += "SVG";	MenuText += "Scalable Vector Graphics (*.svg)";	Ext += "svg";
 
 	QStringList::iterator itText = QtText.begin();
 	QStringList::iterator itMenu = MenuText.begin();
@@ -196,6 +198,7 @@ class ProgressDialog
 public:
 	static void showProgressDialog(QGLWidget* parent);
 	static void updateProgress(float progress, const QString& stepString);
+	static bool wasCanceled();
 	static void hideProgressDialog();
 
 private:
@@ -209,7 +212,6 @@ void ProgressDialog::showProgressDialog(QGLWidget* parent)
 	progressDialog = new QProgressDialog(parent);
 	progressDialog->setWindowTitle("Image rendering progress");
 	progressDialog->setMinimumSize(300, 40);
-	progressDialog->setCancelButton(NULL);
 	progressDialog->show();
 }
 
@@ -224,6 +226,11 @@ void ProgressDialog::updateProgress(float progress, const QString& stepString)
 	qApp->processEvents();
 }
 
+bool ProgressDialog::wasCanceled()
+{
+	return progressDialog->wasCanceled();
+}
+
 void ProgressDialog::hideProgressDialog()
 {
 	progressDialog->close();
@@ -269,6 +276,7 @@ static int saveVectorialSnapshot(const QString& fileName, QGLWidget* widget, con
 	if (snapshotFormat == "EPS")	vparams.setFormat(vrender::VRenderParams::EPS);
 	if (snapshotFormat == "PS")	vparams.setFormat(vrender::VRenderParams::PS);
 	if (snapshotFormat == "XFIG")	vparams.setFormat(vrender::VRenderParams::XFIG);
+	if (snapshotFormat == "SVG")	vparams.setFormat(vrender::VRenderParams::SVG);
 
 	vparams.setOption(vrender::VRenderParams::CullHiddenFaces, !(VRinterface->includeHidden->isChecked()));
 	vparams.setOption(vrender::VRenderParams::OptimizeBackFaceCulling, VRinterface->cullBackFaces->isChecked());
@@ -286,14 +294,37 @@ static int saveVectorialSnapshot(const QString& fileName, QGLWidget* widget, con
 			qWarning("VRenderInterface::saveVectorialSnapshot: Unknown SortMethod");
 	}
 
-	vparams.setProgressFunction(&ProgressDialog::updateProgress);
+	// Primitives are captured here, with the GL context. The rest of the render
+	// runs in a separate thread, so that the interface stays responsive and the
+	// render can be canceled.
 	ProgressDialog::showProgressDialog(widget);
 	widget->makeCurrent();
 	widget->raise();
-	vrender::VectorialRender(drawVectorial, (void*) widget, vparams);
+
+	vrender::VRenderJob job(vparams);
+	job.capture(drawVectorial, (void*) widget);
+	job.start();
+
+	while (!job.wait(50))
+	{
+		ProgressDialog::updateProgress(job.progress(), job.progressText());
+
+		if (ProgressDialog::wasCanceled())
+			job.cancel();
+	}
+
 	ProgressDialog::hideProgressDialog();
 	widget->setCursor(QCursor(Qt::ArrowCursor));
 
+	if (job.status() == vrender::VRenderJob::Cancelled)
+	{
+		QFile::remove(fileName);
+		return -1;
+	}
+
+	if (job.status() == vrender::VRenderJob::Failed)
+		QMessageBox::warning(widget, QGLViewer::tr("Snapshot error", "Message box window title"), job.errorMessage());
+
 	// Should return vparams.error(), but this is currently not set.
 	return 0;
 }
@@ -575,7 +606,7 @@ void QGLViewer::saveSnapshot(bool automatic, bool overwrite)
 
 	bool saveOK;
 #ifndef NO_VECTORIAL_RENDER
-	if ( (snapshotFormat() == "EPS") || (snapshotFormat() == "PS") || (snapshotFormat() == "XFIG") )
+	if ( (snapshotFormat() == "EPS") || (snapshotFormat() == "PS") || (snapshotFormat() == "XFIG") || (snapshotFormat() == "SVG") )
 		// Vectorial snapshot. -1 means cancel, 0 is ok, >0 (should be) an error
 		saveOK = (saveVectorialSnapshot(fileInfo.filePath(), this, snapshotFormat()) <= 0);
 	else
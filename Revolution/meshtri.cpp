@@ -1,8 +1,12 @@
 #include "meshtri.h"
 #include "matrices.h"
 
+#include <algorithm>
 
-MeshTri::MeshTri()
+
+MeshTri::MeshTri():
+	m_backface_culling(false),
+	m_culled(false)
 {
 }
 
@@ -55,6 +59,74 @@ void MeshTri::gl_update()
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ebo);
 	glBufferData(GL_ELEMENT_ARRAY_BUFFER,m_indices.size() * sizeof(int), &(m_indices[0]), GL_STATIC_DRAW);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+	build_clusters();
+}
+
+
+void MeshTri::build_clusters()
+{
+	m_clusters.clear();
+	m_culled = false;
+
+	const int nb = int(m_indices.size()) - int(m_indices.size())%3;
+
+	for (int first = 0; first < nb; first += 3*CLUSTER_SIZE)
+	{
+		Cluster c;
+		c.first = first;
+		c.count = std::min(3*CLUSTER_SIZE, nb-first);
+
+		// boite et sphere englobantes
+		c.bb_min = m_points[m_indices[first]];
+		c.bb_max = c.bb_min;
+		for (int i = first; i < first+c.count; ++i)
+		{
+			const Vec3& P = m_points[m_indices[i]];
+			c.bb_min = glm::min(c.bb_min, P);
+			c.bb_max = glm::max(c.bb_max, P);
+		}
+		c.center = 0.5f*(c.bb_min + c.bb_max);
+		c.radius = 0.0f;
+		for (int i = first; i < first+c.count; ++i)
+			c.radius = std::max(c.radius, vec_length(m_points[m_indices[i]] - c.center));
+
+		// cone des normales: axe = moyenne des normales des faces,
+		// ouverture = plus grand ecart a cet axe
+		c.cone_axis = Vec3(0,0,0);
+		for (int i = first; i < first+c.count; i += 3)
+		{
+			const Vec3& A = m_points[m_indices[i]];
+			Vec3 N = vec_cross(m_points[m_indices[i+1]]-A, m_points[m_indices[i+2]]-A);
+			float l = vec_length(N);
+			if (l > 0.000001f)
+				c.cone_axis += N/l;
+		}
+
+		float min_dot = 1.0f;
+		if (vec_length(c.cone_axis) < 0.000001f)
+			min_dot = -1.0f;
+		else
+		{
+			c.cone_axis = vec_normalize(c.cone_axis);
+			for (int i = first; i < first+c.count; i += 3)
+			{
+				const Vec3& A = m_points[m_indices[i]];
+				Vec3 N = vec_cross(m_points[m_indices[i+1]]-A, m_points[m_indices[i+2]]-A);
+				float l = vec_length(N);
+				if (l > 0.000001f)
+					min_dot = std::min(min_dot, vec_dot(N/l, c.cone_axis));
+			}
+		}
+
+		// cone de plus de 90 degres: jamais entierement de dos
+		if (min_dot <= 0.0f)
+			c.cone_cutoff = 2.0f;
+		else
+			c.cone_cutoff = std::sqrt(1.0f - min_dot*min_dot);
+
+		m_clusters.push_back(c);
+	}
 }
 
 
@@ -66,6 +138,72 @@ void MeshTri::set_matrices(const Mat4& view, const Mat4& projection)
 }
 
 
+void MeshTri::cull(const GLdouble planes[6][4], const Vec3& eye)
+{
+	m_draw_counts.clear();
+	m_draw_offsets.clear();
+	int last_end = -1;
+
+	for (std::vector<Cluster>::const_iterator it = m_clusters.begin(); it != m_clusters.end(); ++it)
+	{
+		const Cluster& c = *it;
+		bool visible = true;
+
+		// plans du frustum: normales vers l'exterieur, point P dehors si N.P > d
+		for (int p = 0; p < 6 && visible; ++p)
+		{
+			Vec3 N(planes[p][0], planes[p][1], planes[p][2]);
+			float d = float(planes[p][3]);
+
+			if (vec_dot(N, c.center) - d > c.radius)
+				visible = false;
+			else
+			{
+				// coin de la boite le plus a l'interieur
+				Vec3 Q(N.x > 0.0f ? c.bb_min.x : c.bb_max.x,
+					   N.y > 0.0f ? c.bb_min.y : c.bb_max.y,
+					   N.z > 0.0f ? c.bb_min.z : c.bb_max.z);
+				if (vec_dot(N, Q) - d > 0.0f)
+					visible = false;
+			}
+		}
+
+		// cone des normales: tous les triangles vus de dos ?
+		if (visible && m_backface_culling)
+		{
+			Vec3 V = c.center - eye;
+			if (vec_dot(V, c.cone_axis) >= c.cone_cutoff * vec_length(V) + c.radius)
+				visible = false;
+		}
+
+		if (!visible)
+			continue;
+
+		// clusters contigus -> une seule plage
+		if (c.first == last_end)
+			m_draw_counts.back() += c.count;
+		else
+		{
+			m_draw_counts.push_back(c.count);
+			m_draw_offsets.push_back(reinterpret_cast<const GLvoid*>(c.first * sizeof(int)));
+		}
+		last_end = c.first + c.count;
+	}
+
+	m_culled = true;
+}
+
+
+void MeshTri::draw_elements()
+{
+	if (!m_culled)
+		glDrawElements(GL_TRIANGLES, m_indices.size(),GL_UNSIGNED_INT,0);
+	else
+		if (!m_draw_counts.empty())
+			glMultiDrawElements(GL_TRIANGLES, &m_draw_counts[0], GL_UNSIGNED_INT, &m_draw_offsets[0], GLsizei(m_draw_counts.size()));
+}
+
+
 void MeshTri::draw(const Vec3& color)
 {
 	m_shader_flat->startUseProgram();
@@ -77,7 +215,7 @@ void MeshTri::draw(const Vec3& color)
 
 	glBindVertexArray(m_vao);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,m_ebo);
-	glDrawElements(GL_TRIANGLES, m_indices.size(),GL_UNSIGNED_INT,0);
+	draw_elements();
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,0);
 	glBindVertexArray(0);
 
@@ -96,7 +234,7 @@ void MeshTri::draw_smooth(const Vec3& color)
 
 	glBindVertexArray(m_vao2);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,m_ebo);
-	glDrawElements(GL_TRIANGLES, m_indices.size(),GL_UNSIGNED_INT,0);
+	draw_elements();
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,0);
 	glBindVertexArray(0);
 
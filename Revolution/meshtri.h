@@ -31,6 +31,47 @@ class MeshTri
 	GLuint m_vao2;
 	GLuint m_vbo2;
 
+	/// taille max (en triangles) d'un cluster
+	static const int CLUSTER_SIZE = 128;
+
+	/// paquet de triangles consecutifs avec ses volumes englobants
+	struct Cluster
+	{
+		/// premier indice (dans m_indices) et nombre d'indices
+		int first;
+		int count;
+		/// boite englobante
+		Vec3 bb_min;
+		Vec3 bb_max;
+		/// sphere englobante
+		Vec3 center;
+		float radius;
+		/// cone des normales (axe et sinus du demi-angle, >=1 si pas de culling)
+		Vec3 cone_axis;
+		float cone_cutoff;
+	};
+
+	/// decoupage du maillage en clusters (mis a jour par gl_update)
+	std::vector<Cluster> m_clusters;
+
+	/// elimination des clusters tournant le dos a la camera
+	bool m_backface_culling;
+
+	/// plages d'indices visibles (resultat de cull) pour glMultiDrawElements
+	std::vector<GLsizei> m_draw_counts;
+	std::vector<const GLvoid*> m_draw_offsets;
+	bool m_culled;
+
+	/**
+	 * @brief decoupe m_indices en clusters de CLUSTER_SIZE triangles
+	 */
+	void build_clusters();
+
+	/**
+	 * @brief envoie les triangles (visibles) du maillage
+	 */
+	void draw_elements();
+
 
 	/**
 	 * @brief tourne un polygone autour de  l'axe Y
@@ -61,6 +102,24 @@ public:
 	 */
 	void set_matrices(const Mat4& view, const Mat4& projection);
 
+	/**
+	 * @brief selection des clusters visibles (a faire 1x en debut de draw, apres set_matrices)
+	 * @param planes plans du frustum (cf Camera::getFrustumPlanesCoefficients)
+	 * @param eye position de la camera
+	 */
+	void cull(const GLdouble planes[6][4], const Vec3& eye);
+
+	/**
+	 * @brief active/desactive l'elimination des clusters vus de dos
+	 * (a n'utiliser qu'avec glEnable(GL_CULL_FACE), sinon l'image change)
+	 */
+	void set_backface_culling(bool b) { m_backface_culling = b; }
+
+	/**
+	 * @brief etat de l'elimination des clusters vus de dos
+	 */
+	bool backface_culling() const { return m_backface_culling; }
+
 	/**
 	 * @brief dessine le maillage (rendu facetise sans utiliser les normales)
 	 * @param color couleur de rendu
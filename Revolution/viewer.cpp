@@ -53,6 +53,12 @@ void Viewer::draw()
 
 	m_mesh.set_matrices(getCurrentModelViewMatrix(),getCurrentProjectionMatrix());
 
+	// elimination des clusters hors du frustum (ou de dos)
+	GLdouble planes[6][4];
+	camera()->getFrustumPlanesCoefficients(planes);
+	qglviewer::Vec eye = camera()->position();
+	m_mesh.cull(planes, Vec3(eye.x, eye.y, eye.z));
+
 	if (m_render_mode==0)
 		m_mesh.draw(ROUGE);
 
@@ -99,6 +105,14 @@ void Viewer::keyPressEvent(QKeyEvent *e)
 		case Qt::Key_M: // touche 'x'
 				m_render_mode = (m_render_mode+1)%2;
 		break;
+
+		case Qt::Key_B: // elimination des faces arrieres (par triangle et par cluster)
+			m_mesh.set_backface_culling(!m_mesh.backface_culling());
+			if (m_mesh.backface_culling())
+				glEnable(GL_CULL_FACE);
+			else
+				glDisable(GL_CULL_FACE);
+		break;
 		default:
 			break;
 	}
@@ -0,0 +1,61 @@
+# Headless benchmark of the VRender stages (parsing, culling, sorting,
+# optimizations and export), on synthetic feedback buffers.
+# Run "vrender_bench --help" for options.
+
+QT += core gui opengl xml widgets
+TARGET = vrender_bench
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+
+# include path for QGLViewer
+INCLUDEPATH += .. ../QGLViewer/VRender
+
+DESTDIR =$$_PRO_FILE_PWD_/../bin/
+
+# VRender is not part of the QGLViewer library build (NO_VECTORIAL_RENDER):
+# its sources are compiled here. Only QGLViewer::tr() is used from the library.
+VRENDER = ../QGLViewer/VRender
+
+# System dependent options
+
+# Linux & macOS/X
+unix {
+QMAKE_CXXFLAGS += -std=c++11
+QMAKE_LFLAGS +=  -Wl,-rpath,$$_PRO_FILE_PWD_/../bin
+LIBS += -L$$_PRO_FILE_PWD_/../bin -lQGLViewer33
+}
+
+# Windows (64b)
+win32 {
+QMAKE_CXXFLAGS += -D_USE_MATH_DEFINES
+QMAKE_CXXFLAGS_WARN_ON += -wd4267 -wd4244 -wd4305
+LIBS += -L$$_PRO_FILE_PWD_/../bin -lQGLViewer33 -lopengl32
+}
+
+
+SOURCES += main.cpp \
+    scenes.cpp \
+    $$VRENDER/BackFaceCullingOptimizer.cpp \
+    $$VRENDER/BSPSortMethod.cpp \
+    $$VRENDER/EPSExporter.cpp \
+    $$VRENDER/Exporter.cpp \
+    $$VRENDER/FIGExporter.cpp \
+    $$VRENDER/gpc.cpp \
+    $$VRENDER/NVector3.cpp \
+    $$VRENDER/ParserGL.cpp \
+    $$VRENDER/Primitive.cpp \
+    $$VRENDER/PrimitiveCapture.cpp \
+    $$VRENDER/PrimitiveFile.cpp \
+    $$VRENDER/PrimitivePositioning.cpp \
+    $$VRENDER/PrimitiveSplitOptimizer.cpp \
+    $$VRENDER/PrimitiveStream.cpp \
+    $$VRENDER/RasterVisibilityOptimizer.cpp \
+    $$VRENDER/SVGExporter.cpp \
+    $$VRENDER/TopologicalSortMethod.cpp \
+    $$VRENDER/Vector2.cpp \
+    $$VRENDER/Vector3.cpp \
+    $$VRENDER/VisibilityOptimizer.cpp \
+    $$VRENDER/VRender.cpp
+
+HEADERS  += scenes.h
@@ -0,0 +1,458 @@
+//  Headless benchmark of the VRender stages. Synthetic feedback buffers (see
+// scenes.h) go through the same stages as in VectorialRender: parsing, back
+// face culling, sorting, hidden face culling, merging and export. For each
+// stage, the time, the number and size of the memory allocations, and the
+// size of its output (primitives, or bytes for the exporters) are reported.
+//
+//  Results can be saved with --csv, and compared to a previous run with
+// --baseline: the exit code is then 1 if a stage got slower than the given
+// tolerance, or if its output changed.
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QMap>
+#include <QStringList>
+#include <QTextStream>
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <stdio.h>
+
+#include "VRender.h"
+#include "ParserGL.h"
+#include "Exporter.h"
+#include "SortMethod.h"
+#include "Optimizer.h"
+#include "Primitive.h"
+
+#include "scenes.h"
+
+using namespace vrender;
+
+// Allocation counters. Primitives come from pools, whose blocks are counted.
+
+static std::atomic<long long> nb_allocations(0);
+static std::atomic<long long> allocated_bytes(0);
+
+void* operator new(size_t size)
+{
+	nb_allocations++;
+	allocated_bytes += size;
+
+	void* p = malloc(size ? size : 1);
+	if (!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+void operator delete(void* p) noexcept
+{
+	free(p);
+}
+
+struct StageResult
+{
+	QString scene;
+	int size;
+	QString sorter;
+	QString stage;
+	double ms;
+	long long allocations;
+	long long bytes;
+	long long output;
+
+	QString key() const { return scene + ',' + QString::number(size) + ',' + sorter + ',' + stage; }
+};
+
+struct Options
+{
+	QStringList scenes;
+	QList<int> sizes;
+	QStringList sorters;
+	QStringList formats;
+	QString visibility;
+	bool merge;
+	unsigned int seed;
+	QString csv;
+	QString baseline;
+	double tolerance;
+
+	Options() : visibility("exact"), merge(true), seed(1), tolerance(20.0)
+	{
+		scenes = scenes::names();
+		sizes << 10000 << 100000;
+		sorters << "bsp" << "topo";
+		formats << "eps" << "svg";
+	}
+};
+
+class Stage
+{
+public:
+	Stage(const QString& name) : name_(name)
+	{
+		allocations_ = nb_allocations;
+		bytes_ = allocated_bytes;
+		timer_.start();
+	}
+
+	StageResult done(long long output) const
+	{
+		StageResult r;
+		r.ms = timer_.nsecsElapsed() * 1e-6;
+		r.allocations = nb_allocations - allocations_;
+		r.bytes = allocated_bytes - bytes_;
+		r.stage = name_;
+		r.size = 0;
+		r.output = output;
+		return r;
+	}
+
+private:
+	QString name_;
+	QElapsedTimer timer_;
+	long long allocations_;
+	long long bytes_;
+};
+
+static const float WIDTH = 1024.0f;
+static const float HEIGHT = 768.0f;
+
+static void usage()
+{
+	printf("Usage: vrender_bench [options]\n"
+		   "  --scenes a,b,...     among %s (default: all)\n"
+		   "  --sizes n,m,...      numbers of triangles (default: 10000,100000)\n"
+		   "  --sorters a,b,...    among none,bsp,topo,advtopo (default: bsp,topo)\n"
+		   "  --visibility v       exact, raster or none (default: exact)\n"
+		   "  --no-merge           skips the merging of coplanar polygons\n"
+		   "  --formats a,b,...    among eps,eps3,ps,fig,svg (default: eps,svg)\n"
+		   "                       (eps3: EPS with PostScript Level 3 shadings)\n"
+		   "  --seed n             seed of the scene generator (default: 1)\n"
+		   "  --csv file           saves the results\n"
+		   "  --baseline file      compares to results saved with --csv\n"
+		   "  --tolerance pct      allowed slowdown with --baseline (default: 20)\n",
+		   qPrintable(scenes::names().join(",")));
+}
+
+static bool parseArguments(const QStringList& args, Options& options)
+{
+	for (int i = 1; i < args.size(); ++i)
+	{
+		const QString& a = args[i];
+		const bool hasValue = (i + 1 < args.size());
+
+		if (a == "--no-merge")
+			options.merge = false;
+		else if (a == "--help" || a == "-h" || !hasValue)
+			return false;
+		else
+		{
+			const QString value = args[++i];
+
+			if (a == "--scenes")
+				options.scenes = value.split(',');
+			else if (a == "--sizes")
+			{
+				options.sizes.clear();
+				foreach (const QString& s, value.split(','))
+					options.sizes << s.toInt();
+			}
+			else if (a == "--sorters")
+				options.sorters = value.split(',');
+			else if (a == "--formats")
+				options.formats = value.split(',');
+			else if (a == "--visibility")
+				options.visibility = value;
+			else if (a == "--seed")
+				options.seed = value.toUInt();
+			else if (a == "--csv")
+				options.csv = value;
+			else if (a == "--baseline")
+				options.baseline = value;
+			else if (a == "--tolerance")
+				options.tolerance = value.toDouble();
+			else
+				return false;
+		}
+	}
+
+	return true;
+}
+
+static SortMethod* createSortMethod(const QString& name)
+{
+	if (name == "none")
+		return new DontSortMethod();
+	if (name == "bsp")
+		return new BSPSortMethod();
+	if (name == "topo" || name == "advtopo")
+	{
+		TopologicalSortMethod* tsm = new TopologicalSortMethod();
+		tsm->setBreakCycles(name == "advtopo");
+		return tsm;
+	}
+	return NULL;
+}
+
+static Exporter* createExporter(const QString& name)
+{
+	Exporter* exporter = NULL;
+
+	if (name == "eps")		exporter = new EPSExporter();
+	else if (name == "eps3")
+	{
+		EPSExporter* eps = new EPSExporter();
+		eps->setLevel3Shading(true);
+		exporter = eps;
+	}
+	else if (name == "ps")	exporter = new PSExporter();
+	else if (name == "fig")	exporter = new FIGExporter();
+	else if (name == "svg")	exporter = new SVGExporter();
+	else return NULL;
+
+	exporter->setBoundingBox(0.0f, 0.0f, WIDTH, HEIGHT);
+	exporter->setBlackAndWhite(false);
+	exporter->setClearBackground(true);
+	exporter->setClearColor(1.0f, 1.0f, 1.0f);
+	return exporter;
+}
+
+static void deletePrimitives(std::vector<PtrPrimitive>& tab)
+{
+	for (size_t i = 0; i < tab.size(); ++i)
+		delete tab[i];
+	tab.clear();
+}
+
+// Runs all the stages on a copy of the buffer, with one sorter.
+static void runPipeline(const std::vector<GLfloat>& original, const QString& sorter, const Options& options, QList<StageResult>& results)
+{
+	VRenderParams vparams;
+	std::vector<PtrPrimitive> tab;
+
+	{
+		// The parser normalizes the buffer in place.
+		std::vector<GLfloat> buffer(original);
+
+		Stage stage("parse");
+		ParserGL parser;
+		parser.parseFeedbackBuffer(&buffer[0], int(buffer.size()), tab, vparams);
+
+		size_t j = 0;
+		for (size_t i = 0; i < tab.size(); ++i)
+			if (tab[i] != NULL)
+				tab[j++] = tab[i];
+		tab.resize(j);
+
+		results << stage.done(tab.size());
+	}
+
+	{
+		Stage stage("backface");
+		BackFaceCullingOptimizer optimizer;
+		optimizer.optimize(tab, vparams);
+		results << stage.done(tab.size());
+	}
+
+	{
+		SortMethod* method = createSortMethod(sorter);
+		Stage stage("sort");
+		method->sortPrimitives(tab, vparams);
+		results << stage.done(tab.size());
+		delete method;
+	}
+
+	if (options.visibility != "none")
+	{
+		Stage stage("visibility:" + options.visibility);
+
+		if (options.visibility == "raster")
+		{
+			RasterVisibilityOptimizer optimizer;
+			optimizer.optimize(tab, vparams);
+		}
+		else
+		{
+			VisibilityOptimizer optimizer;
+			optimizer.optimize(tab, vparams);
+		}
+
+		long long visible = 0;
+		for (size_t i = 0; i < tab.size(); ++i)
+			if (tab[i] != NULL)
+				++visible;
+
+		results << stage.done(visible);
+	}
+
+	if (options.merge)
+	{
+		Stage stage("merge");
+		PrimitiveSplitOptimizer optimizer;
+		optimizer.optimize(tab, vparams);
+		results << stage.done(tab.size());
+	}
+
+	foreach (const QString& format, options.formats)
+	{
+		const QString fileName = QDir::temp().filePath("vrender_bench." + format);
+		Exporter* exporter = createExporter(format);
+		if (!exporter)
+			continue;
+
+		Stage stage("export:" + format);
+		try
+		{
+			exporter->exportToFile(fileName, tab, vparams);
+		}
+		catch (std::exception& e)
+		{
+			fprintf(stderr, "Unable to export %s: %s\n", qPrintable(format), e.what());
+			delete exporter;
+			continue;
+		}
+		delete exporter;
+		results << stage.done(QFileInfo(fileName).size());
+
+		QFile::remove(fileName);
+	}
+
+	deletePrimitives(tab);
+}
+
+static QMap<QString, StageResult> readBaseline(const QString& fileName)
+{
+	QMap<QString, StageResult> baseline;
+	QFile file(fileName);
+
+	if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+	{
+		fprintf(stderr, "Unable to read baseline %s\n", qPrintable(fileName));
+		return baseline;
+	}
+
+	QTextStream in(&file);
+	in.readLine(); // header
+
+	while (!in.atEnd())
+	{
+		QStringList f = in.readLine().split(',');
+		if (f.size() < 8)
+			continue;
+
+		StageResult r;
+		r.scene = f[0];
+		r.size = f[1].toInt();
+		r.sorter = f[2];
+		r.stage = f[3];
+		r.ms = f[4].toDouble();
+		r.allocations = f[5].toLongLong();
+		r.bytes = f[6].toLongLong();
+		r.output = f[7].toLongLong();
+		baseline[r.key()] = r;
+	}
+
+	return baseline;
+}
+
+int main(int argc, char* argv[])
+{
+	QCoreApplication app(argc, argv);
+
+	Options options;
+	if (!parseArguments(app.arguments(), options))
+	{
+		usage();
+		return 2;
+	}
+
+	foreach (const QString& sorter, options.sorters)
+	{
+		SortMethod* method = createSortMethod(sorter);
+		if (!method)
+		{
+			fprintf(stderr, "Unknown sorter %s\n", qPrintable(sorter));
+			return 2;
+		}
+		delete method;
+	}
+
+	QMap<QString, StageResult> baseline;
+	if (!options.baseline.isEmpty())
+		baseline = readBaseline(options.baseline);
+
+	QList<StageResult> all;
+	int nb_regressions = 0;
+
+	printf("%-8s %9s %-8s %-18s %11s %11s %11s %12s\n", "scene", "size", "sorter", "stage", "ms", "allocs", "KB", "output");
+
+	foreach (const QString& scene, options.scenes)
+		foreach (int size, options.sizes)
+		{
+			std::vector<GLfloat> buffer;
+			if (!scenes::generate(scene, size, WIDTH, HEIGHT, options.seed, buffer))
+			{
+				fprintf(stderr, "Unknown scene %s\n", qPrintable(scene));
+				return 2;
+			}
+
+			foreach (const QString& sorter, options.sorters)
+			{
+				QList<StageResult> results;
+				runPipeline(buffer, sorter, options, results);
+
+				for (int i = 0; i < results.size(); ++i)
+				{
+					StageResult& r = results[i];
+					r.scene = scene;
+					r.size = size;
+					r.sorter = sorter;
+
+					QString status;
+					if (baseline.contains(r.key()))
+					{
+						const StageResult& b = baseline[r.key()];
+
+						// Differences below 1 ms are noise.
+						if (r.ms > b.ms * (1.0 + options.tolerance / 100.0) && r.ms - b.ms > 1.0)
+							status = QString("  SLOWER (%1 ms)").arg(b.ms, 0, 'f', 1);
+						if (r.output != b.output)
+							status += QString("  CHANGED (%1)").arg(b.output);
+						if (!status.isEmpty())
+							++nb_regressions;
+					}
+
+					printf("%-8s %9d %-8s %-18s %11.1f %11lld %11lld %12lld%s\n", qPrintable(r.scene), r.size, qPrintable(r.sorter),
+						   qPrintable(r.stage), r.ms, r.allocations, r.bytes / 1024, r.output, qPrintable(status));
+					fflush(stdout);
+				}
+
+				all << results;
+			}
+		}
+
+	if (!options.csv.isEmpty())
+	{
+		QFile file(options.csv);
+		if (!file.open(QIODevice::WriteOnly | QIODevice::Text))
+		{
+			fprintf(stderr, "Unable to write %s\n", qPrintable(options.csv));
+			return 2;
+		}
+
+		QTextStream out(&file);
+		out << "scene,size,sorter,stage,ms,allocations,bytes,output\n";
+		foreach (const StageResult& r, all)
+			out << r.key() << ',' << QString::number(r.ms, 'f', 3) << ',' << r.allocations << ',' << r.bytes << ',' << r.output << '\n';
+	}
+
+	if (!options.baseline.isEmpty())
+		printf("%d stage(s) slower or with a different output than the baseline.\n", nb_regressions);
+
+	return nb_regressions > 0 ? 1 : 0;
+}
@@ -0,0 +1,155 @@
+#include "scenes.h"
+
+#include <math.h>
+
+namespace
+{
+	// xorshift32: small, fast and identical everywhere, unlike rand().
+	class Random
+	{
+	public:
+		Random(unsigned int seed) : state_(seed ? seed : 0x9e3779b9u) {}
+
+		float uniform()
+		{
+			state_ ^= state_ << 13;
+			state_ ^= state_ >> 17;
+			state_ ^= state_ << 5;
+			return (state_ >> 8) / float(1 << 24);
+		}
+
+		float uniform(float a, float b) { return a + (b - a) * uniform(); }
+
+	private:
+		unsigned int state_;
+	};
+
+	struct Vertex
+	{
+		GLfloat x, y, z, r, g, b, a;
+	};
+
+	void addTriangle(std::vector<GLfloat>& buffer, const Vertex& v0, const Vertex& v1, const Vertex& v2)
+	{
+		buffer.push_back(GL_POLYGON_TOKEN);
+		buffer.push_back(3);
+
+		const Vertex* v[3] = { &v0, &v1, &v2 };
+		for (int i = 0; i < 3; ++i)
+		{
+			buffer.push_back(v[i]->x); buffer.push_back(v[i]->y); buffer.push_back(v[i]->z);
+			buffer.push_back(v[i]->r); buffer.push_back(v[i]->g); buffer.push_back(v[i]->b); buffer.push_back(v[i]->a);
+		}
+	}
+
+	Vertex vertex(float x, float y, float z, float r, float g, float b)
+	{
+		Vertex v = { x, y, z, r, g, b, 1.0f };
+		return v;
+	}
+
+	float clamp01(float v) { return v < 0.0f ? 0.0f : (v > 1.0f ? 1.0f : v); }
+
+	// Each triangle covers about 8 times the window area divided by the number of triangles.
+	void soup(int n, float w, float h, Random& random, std::vector<GLfloat>& buffer)
+	{
+		const float edge = sqrt(2.0f * 8.0f * w * h / n);
+
+		for (int i = 0; i < n; ++i)
+		{
+			float cx = random.uniform(0.0f, w), cy = random.uniform(0.0f, h), cz = random.uniform(0.1f, 0.9f);
+			float r = random.uniform(), g = random.uniform(), b = random.uniform();
+
+			Vertex v[3];
+			for (int j = 0; j < 3; ++j)
+				v[j] = vertex(cx + random.uniform(-edge, edge), cy + random.uniform(-edge, edge), cz + random.uniform(-0.05f, 0.05f), r, g, b);
+
+			addTriangle(buffer, v[0], v[1], v[2]);
+		}
+	}
+
+	// Front facing (counter clockwise) triangles. Depth and color vary along both grids.
+	void grids(int n, float w, float h, std::vector<GLfloat>& buffer)
+	{
+		const int res = qMax(1, int(sqrt(n / 4.0)));
+
+		for (int k = 0; k < 2; ++k)
+		{
+			const float slope = (k == 0) ? 0.3f : -0.3f;
+
+			std::vector<Vertex> grid((res + 1) * (res + 1));
+			for (int j = 0; j <= res; ++j)
+				for (int i = 0; i <= res; ++i)
+				{
+					float u = i / float(res), v = j / float(res);
+					float z = 0.5f + slope * (u - 0.5f) + 0.05f * sin(6.0f * v + 3.0f * k);
+					grid[j * (res + 1) + i] = vertex(u * w, v * h, z, clamp01(z), k == 0 ? 0.3f : 0.8f, clamp01(1.0f - z));
+				}
+
+			for (int j = 0; j < res; ++j)
+				for (int i = 0; i < res; ++i)
+				{
+					const Vertex& a = grid[j * (res + 1) + i];
+					const Vertex& b = grid[j * (res + 1) + i + 1];
+					const Vertex& c = grid[(j + 1) * (res + 1) + i + 1];
+					const Vertex& d = grid[(j + 1) * (res + 1) + i];
+					addTriangle(buffer, a, b, c);
+					addTriangle(buffer, a, c, d);
+				}
+		}
+	}
+
+	// 8 layers of flat colored cells, each made of 2 triangles, with about 30% of the cells missing.
+	void layers(int n, float w, float h, Random& random, std::vector<GLfloat>& buffer)
+	{
+		const int nb_layers = 8;
+		const int res = qMax(1, int(sqrt(n / (nb_layers * 2 * 0.7))));
+
+		for (int l = 0; l < nb_layers; ++l)
+		{
+			const float z = (l + 0.5f) / nb_layers;
+			const float ox = random.uniform(-0.2f, 0.2f) * w, oy = random.uniform(-0.2f, 0.2f) * h;
+			const float cw = w / res, ch = h / res;
+			const float r = random.uniform(), g = random.uniform(), b = random.uniform();
+
+			for (int j = 0; j < res; ++j)
+				for (int i = 0; i < res; ++i)
+				{
+					if (random.uniform() < 0.3f)
+						continue;
+
+					float x = ox + i * cw, y = oy + j * ch;
+					Vertex a = vertex(x, y, z, r, g, b);
+					Vertex bb = vertex(x + cw, y, z, r, g, b);
+					Vertex c = vertex(x + cw, y + ch, z, r, g, b);
+					Vertex d = vertex(x, y + ch, z, r, g, b);
+					addTriangle(buffer, a, bb, c);
+					addTriangle(buffer, a, c, d);
+				}
+		}
+	}
+}
+
+QStringList scenes::names()
+{
+	return QStringList() << "soup" << "grids" << "layers";
+}
+
+bool scenes::generate(const QString& name, int nb_triangles, float width, float height, unsigned int seed, std::vector<GLfloat>& buffer)
+{
+	Random random(seed);
+
+	buffer.clear();
+	buffer.reserve(size_t(nb_triangles) * (2 + 3 * 7));
+
+	if (name == "soup")
+		soup(nb_triangles, width, height, random, buffer);
+	else if (name == "grids")
+		grids(nb_triangles, width, height, buffer);
+	else if (name == "layers")
+		layers(nb_triangles, width, height, random, buffer);
+	else
+		return false;
+
+	return true;
+}
@@ -0,0 +1,30 @@
+#ifndef SCENES_H
+#define SCENES_H
+
+#include <vector>
+#include <QString>
+#include <QStringList>
+
+#include "Types.h"
+
+//  Synthetic feedback buffers, laid out as glRenderMode(GL_FEEDBACK) returns
+// them in GL_3D_COLOR mode: window coordinates in [0,width]x[0,height], depth
+// in [0,1], and RGBA colors. Only triangles are generated.
+//
+//  - soup:   randomly placed, sized and oriented triangles, each with a random
+//            color and interpenetrating its neighbors in depth.
+//  - grids:  two wavy grids crossing each other along a line, smoothly shaded.
+//  - layers: parallel layers of flat colored triangles, with holes, seen
+//            through each other. Coplanar neighbors can be merged.
+//
+//  The same seed always gives the same buffer, on all platforms.
+
+namespace scenes
+{
+	QStringList names();
+
+	// Returns false if the scene name is unknown.
+	bool generate(const QString& name, int nb_triangles, float width, float height, unsigned int seed, std::vector<GLfloat>& buffer);
+}
+
+#endif // SCENES_H
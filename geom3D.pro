@@ -1,9 +1,10 @@
 TEMPLATE = subdirs
 
-SUBDIRS = QGLViewer OGLRender Transfos Revolution Projet_modeling 
+SUBDIRS = QGLViewer OGLRender Transfos Revolution Projet_modeling VRenderBench
 
  # what subproject depends on others
 Transfos.depends = QGLViewer OGLRender
 Revolution.depends = QGLViewer OGLRender
 Projet_modeling.depends = QGLViewer OGLRender
+VRenderBench.depends = QGLViewer
 